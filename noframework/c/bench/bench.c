@@ -0,0 +1,497 @@
+// Benchmarks for the C implementation's own overhead: micro-benchmarks of
+// the tools and of JSON handling, and whole agent runs against a mock
+// server (bench/mock_server.py) replaying recorded transcripts. Results go
+// to stdout as one JSON document and a summary to stderr, on lines starting
+// with "bench: " among the agent's own log; `make bench` runs everything.
+#include "../src/agent.h"
+#include "../src/tools.h"
+#include "../src/index.h"
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MIN_TIME_MS 300
+#define BENCH_MIN_ITERATIONS 5
+#define BENCH_MAX_ITERATIONS 100000
+#define BENCH_READ_FILES 200
+
+typedef void (*BenchFunc)(void* context);
+
+typedef struct {
+    const char* root;
+    FileList* files;            // full paths below root
+    char** relative;            // the same, relative to root
+    FileList* text_files;       // readable by read_file, for the read benchmark
+    size_t text_bytes;
+    GitIgnore* gitignore;
+    RepoIndex* index;
+    char* request_json;         // a chat completion request with real observations
+    char* response_json;        // a chat completion response with a long answer
+    cJSON* request;
+    const char* react_reply;    // ReAct turn with several actions
+    const char* final_reply;    // ReAct turn with a final answer
+} BenchCorpus;
+
+static int compare_doubles(const void* a, const void* b) {
+    double left = *(const double*)a;
+    double right = *(const double*)b;
+    return left < right ? -1 : left > right;
+}
+
+// Times func until it has run for BENCH_MIN_TIME_MS and appends the
+// statistics; items is the work done per call (files, paths, bytes)
+static void bench_run(cJSON* results, const char* name, BenchFunc func, void* context,
+                      const char* unit, double items) {
+    func(context);      // warm caches and lazy initialisation
+    
+    size_t capacity = 1024;
+    double* samples = safe_malloc(capacity * sizeof(double));
+    size_t count = 0;
+    uint64_t started = platform_monotonic_ns();
+    uint64_t deadline = started + (uint64_t)BENCH_MIN_TIME_MS * 1000000;
+    
+    while (count < BENCH_MAX_ITERATIONS &&
+           (count < BENCH_MIN_ITERATIONS || platform_monotonic_ns() < deadline)) {
+        uint64_t before = platform_monotonic_ns();
+        func(context);
+        uint64_t after = platform_monotonic_ns();
+        if (count == capacity) {
+            capacity *= 2;
+            samples = safe_realloc(samples, capacity * sizeof(double));
+        }
+        samples[count++] = (double)(after - before);
+    }
+    
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) sum += samples[i];
+    qsort(samples, count, sizeof(double), compare_doubles);
+    double median = samples[count / 2];
+    
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "name", name);
+    cJSON_AddNumberToObject(result, "iterations", (double)count);
+    cJSON_AddNumberToObject(result, "min_ns", samples[0]);
+    cJSON_AddNumberToObject(result, "median_ns", median);
+    cJSON_AddNumberToObject(result, "mean_ns", sum / (double)count);
+    cJSON_AddNumberToObject(result, "p90_ns", samples[count * 9 / 10]);
+    if (unit) {
+        cJSON_AddStringToObject(result, "unit", unit);
+        cJSON_AddNumberToObject(result, "items", items);
+        cJSON_AddNumberToObject(result, "items_per_second", median > 0 ? items * 1e9 / median : 0);
+    }
+    cJSON_AddItemToArray(results, result);
+    fprintf(stderr, "bench: %-40s %10zu iterations %14.0f ns median\n", name, count, median);
+    
+    free(samples);
+}
+
+// Micro-benchmarks
+static void bench_traverse(void* context) {
+    BenchCorpus* corpus = (BenchCorpus*)context;
+    FileList* files = file_list_create();
+    GitIgnore* gitignore = gitignore_load(corpus->root);
+    traverse_directory(corpus->root, "*", files, gitignore, corpus->root);
+    gitignore_destroy(gitignore);
+    file_list_destroy(files);
+}
+
+static void bench_traverse_parallel(void* context) {
+    BenchCorpus* corpus = (BenchCorpus*)context;
+    FileList* files = file_list_create();
+    GitIgnore* gitignore = gitignore_load(corpus->root);
+    traverse_directory_parallel(corpus->root, "*", files, gitignore);
+    gitignore_destroy(gitignore);
+    file_list_destroy(files);
+}
+
+static void bench_gitignore(void* context) {
+    BenchCorpus* corpus = (BenchCorpus*)context;
+    volatile size_t ignored = 0;
+    for (size_t i = 0; i < corpus->files->count; i++) {
+        if (gitignore_should_ignore(corpus->gitignore, corpus->relative[i])) ignored++;
+    }
+}
+
+static void bench_read_file(void* context) {
+    BenchCorpus* corpus = (BenchCorpus*)context;
+    for (size_t i = 0; i < corpus->text_files->count; i++) {
+        free(read_file(corpus->text_files->files[i]));
+    }
+}
+
+static void bench_json_parse_request(void* context) {
+    cJSON_Delete(cJSON_Parse(((BenchCorpus*)context)->request_json));
+}
+
+static void bench_json_print_request(void* context) {
+    free(cJSON_PrintUnformatted(((BenchCorpus*)context)->request));
+}
+
+static void bench_json_parse_response(void* context) {
+    cJSON_Delete(cJSON_Parse(((BenchCorpus*)context)->response_json));
+}
+
+// What react_response_text does instead: find the content and unescape it
+static void bench_json_find_response(void* context) {
+    const char* json = ((BenchCorpus*)context)->response_json;
+    size_t length = 0;
+    const char* content = cJSON_FindPath(json, strlen(json), "choices.0.message.content", &length);
+    char* text = safe_malloc(length);
+    cJSON_UnescapeTo(text, content, length);
+    free(text);
+}
+
+static void bench_parse_actions(void* context) {
+    parsed_response_destroy(agent_parse_response(((BenchCorpus*)context)->react_reply));
+}
+
+static void bench_parse_final(void* context) {
+    parsed_response_destroy(agent_parse_response(((BenchCorpus*)context)->final_reply));
+}
+
+static void bench_index_build(void* context) {
+    repo_index_destroy(repo_index_build(((BenchCorpus*)context)->root));
+}
+
+static void bench_index_find(void* context) {
+    BenchCorpus* corpus = (BenchCorpus*)context;
+    free(find_all_matching_files_indexed(corpus->index, corpus->root, "*.c"));
+}
+
+static void bench_search_literal(void* context) {
+    SearchQuery query = {0};
+    query.pattern = "agent_run";
+    free(search_code(((BenchCorpus*)context)->index, &query));
+}
+
+static void bench_search_regex(void* context) {
+    SearchQuery query = {0};
+    query.pattern = "static (void|bool) [a-z_]+\\(";
+    query.regex = true;
+    free(search_code(((BenchCorpus*)context)->index, &query));
+}
+
+// Builds a request as the agent would send it after reading a few files
+static char* build_request_json(BenchCorpus* corpus) {
+    cJSON* request = cJSON_CreateObject();
+    cJSON_AddStringToObject(request, "model", "gpt-4o-mini");
+    cJSON_AddNumberToObject(request, "temperature", 0);
+    cJSON* messages = cJSON_AddArrayToObject(request, "messages");
+    
+    cJSON* system = cJSON_CreateObject();
+    cJSON_AddStringToObject(system, "role", "system");
+    cJSON_AddStringToObject(system, "content", REACT_SYSTEM_PROMPT);
+    cJSON_AddItemToArray(messages, system);
+    
+    for (size_t i = 0; i < corpus->text_files->count && i < 16; i++) {
+        cJSON* assistant = cJSON_CreateObject();
+        cJSON_AddStringToObject(assistant, "role", "assistant");
+        cJSON_AddStringToObject(assistant, "content", "Thought: read the next file\nAction: read_file");
+        cJSON_AddItemToArray(messages, assistant);
+        
+        char* observation = read_file(corpus->text_files->files[i]);
+        cJSON* user = cJSON_CreateObject();
+        cJSON_AddStringToObject(user, "role", "user");
+        cJSON_AddStringToObject(user, "content", observation);
+        cJSON_AddItemToArray(messages, user);
+        free(observation);
+    }
+    
+    corpus->request = request;
+    return cJSON_PrintUnformatted(request);
+}
+
+static char* build_response_json(const char* answer) {
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "id", "chatcmpl-bench");
+    cJSON_AddStringToObject(response, "object", "chat.completion");
+    cJSON* choices = cJSON_AddArrayToObject(response, "choices");
+    cJSON* choice = cJSON_CreateObject();
+    cJSON* message = cJSON_AddObjectToObject(choice, "message");
+    cJSON_AddStringToObject(message, "role", "assistant");
+    cJSON_AddStringToObject(message, "content", answer);
+    cJSON_AddStringToObject(choice, "finish_reason", "stop");
+    cJSON_AddItemToArray(choices, choice);
+    cJSON* usage = cJSON_AddObjectToObject(response, "usage");
+    cJSON_AddNumberToObject(usage, "prompt_tokens", 12000);
+    cJSON_AddNumberToObject(usage, "completion_tokens", 2000);
+    
+    char* json = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    return json;
+}
+
+static cJSON* load_json_file(const char* path) {
+    MappedFile mapped;
+    if (platform_map_file(path, &mapped) != 0) return NULL;
+    cJSON* json = cJSON_ParseWithLength(mapped.data, mapped.size);
+    platform_unmap_file(&mapped);
+    return json;
+}
+
+static const char* transcript_turn(const cJSON* transcript, int index) {
+    cJSON* responses = cJSON_GetObjectItem(transcript, "responses");
+    cJSON* turn = cJSON_GetArrayItem(responses, index);
+    return cJSON_IsString(turn) ? turn->valuestring : NULL;
+}
+
+static cJSON* run_micro_benchmarks(BenchCorpus* corpus, const cJSON* react_transcript) {
+    cJSON* results = cJSON_CreateArray();
+    double files = (double)corpus->files->count;
+    
+    bench_run(results, "traverse_directory", bench_traverse, corpus, "files", files);
+    bench_run(results, "traverse_directory_parallel", bench_traverse_parallel, corpus, "files", files);
+    bench_run(results, "gitignore_should_ignore", bench_gitignore, corpus, "paths", files);
+    bench_run(results, "read_file", bench_read_file, corpus, "bytes", (double)corpus->text_bytes);
+    
+    double request_bytes = (double)strlen(corpus->request_json);
+    bench_run(results, "cJSON_Parse/request", bench_json_parse_request, corpus, "bytes", request_bytes);
+    bench_run(results, "cJSON_PrintUnformatted/request", bench_json_print_request, corpus, "bytes", request_bytes);
+    bench_run(results, "cJSON_Parse/response", bench_json_parse_response, corpus, "bytes",
+              (double)strlen(corpus->response_json));
+    bench_run(results, "cJSON_FindPath/response_content", bench_json_find_response, corpus, "bytes",
+              (double)strlen(corpus->response_json));
+    
+    if (react_transcript && corpus->react_reply && corpus->final_reply) {
+        bench_run(results, "agent_parse_response/actions", bench_parse_actions, corpus, "bytes",
+                  (double)strlen(corpus->react_reply));
+        bench_run(results, "agent_parse_response/final_answer", bench_parse_final, corpus, "bytes",
+                  (double)strlen(corpus->final_reply));
+    }
+    
+    bench_run(results, "repo_index_build", bench_index_build, corpus, "files", files);
+    if (corpus->index) {
+        bench_run(results, "find_all_matching_files/indexed", bench_index_find, corpus, NULL, 0);
+        repo_index_build_trigrams(corpus->index);
+        bench_run(results, "search_code/literal", bench_search_literal, corpus, NULL, 0);
+        bench_run(results, "search_code/regex", bench_search_regex, corpus, NULL, 0);
+    }
+    return results;
+}
+
+// End-to-end: whole agent_run calls against the mock server. HTTP time is
+// what libcurl measured; the rest of the wall time is our own overhead.
+static cJSON* run_transcript(const char* name, const cJSON* transcript, const char* base_url,
+                             const char* directory, int runs) {
+    char model[256];
+    snprintf(model, sizeof(model), "openai/%s", name);
+    cJSON* prompt = cJSON_GetObjectItem(transcript, "prompt");
+    bool function_calling = cJSON_IsTrue(cJSON_GetObjectItem(transcript, "function_calling"));
+    bool stream = cJSON_IsTrue(cJSON_GetObjectItem(transcript, "stream"));
+    
+    double* wall = safe_calloc((size_t)runs, sizeof(double));
+    double* http = safe_calloc((size_t)runs, sizeof(double));
+    double* overhead = safe_calloc((size_t)runs, sizeof(double));
+    size_t requests = 0;
+    int steps = 0;
+    int failures = 0;
+    
+    for (int run = 0; run < runs; run++) {
+        TechWriterAgent* agent = agent_create(model, base_url);
+        if (!agent) {
+            failures++;
+            continue;
+        }
+        agent->function_calling = function_calling;
+        agent->stream = stream;
+        
+        uint64_t started = platform_monotonic_ns();
+        char* answer = agent_run(agent, cJSON_IsString(prompt) ? prompt->valuestring : "Describe the code.", directory);
+        wall[run] = (double)(platform_monotonic_ns() - started) / 1e6;
+        http[run] = agent->client->timing.sum_ms[HTTP_PHASE_TOTAL];
+        overhead[run] = wall[run] - http[run];
+        requests = agent->client->timing.requests;
+        steps = agent->step;
+        if (!answer || strcmp(answer, "Failed to complete analysis") == 0) failures++;
+        
+        free(answer);
+        agent_destroy(agent);
+    }
+    
+    qsort(wall, (size_t)runs, sizeof(double), compare_doubles);
+    qsort(http, (size_t)runs, sizeof(double), compare_doubles);
+    qsort(overhead, (size_t)runs, sizeof(double), compare_doubles);
+    
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "name", name);
+    cJSON_AddNumberToObject(result, "runs", runs);
+    cJSON_AddNumberToObject(result, "failures", failures);
+    cJSON_AddNumberToObject(result, "llm_requests", (double)requests);
+    cJSON_AddNumberToObject(result, "steps", steps);
+    cJSON_AddNumberToObject(result, "wall_ms_median", wall[runs / 2]);
+    cJSON_AddNumberToObject(result, "wall_ms_min", wall[0]);
+    cJSON_AddNumberToObject(result, "http_ms_median", http[runs / 2]);
+    cJSON_AddNumberToObject(result, "overhead_ms_median", overhead[runs / 2]);
+    cJSON_AddNumberToObject(result, "overhead_ms_min", overhead[0]);
+    fprintf(stderr, "bench: %-40s %10d runs %14.2f ms median, %.2f ms outside HTTP\n",
+            name, runs, wall[runs / 2], overhead[runs / 2]);
+    
+    free(wall);
+    free(http);
+    free(overhead);
+    return result;
+}
+
+static void collect_transcript(const char* name, void* userdata) {
+    if (string_ends_with(name, ".json")) file_list_add((FileList*)userdata, name);
+}
+
+static void print_usage(const char* program_name) {
+    fprintf(stderr, "Usage: %s [options]\n\n", program_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --corpus DIR          Directory the tools are benchmarked on (default: .)\n");
+    fprintf(stderr, "  --transcripts DIR     Recorded transcripts for parsing and end-to-end runs (default: bench/transcripts)\n");
+    fprintf(stderr, "  --base-url URL        Mock server replaying the transcripts; end-to-end runs are skipped without it\n");
+    fprintf(stderr, "  --runs N              End-to-end runs per transcript (default: 10)\n");
+    fprintf(stderr, "  --no-micro            Skip the micro-benchmarks\n");
+    fprintf(stderr, "  -h, --help            Show this help message and exit\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* corpus_dir = ".";
+    const char* transcripts_dir = "bench/transcripts";
+    const char* base_url = NULL;
+    int runs = 10;
+    bool micro = true;
+    
+    static struct option long_options[] = {
+        {"corpus", required_argument, 0, 0},
+        {"transcripts", required_argument, 0, 0},
+        {"base-url", required_argument, 0, 0},
+        {"runs", required_argument, 0, 0},
+        {"no-micro", no_argument, 0, 0},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    
+    int option_index = 0;
+    int c;
+    while ((c = getopt_long(argc, argv, "h", long_options, &option_index)) != -1) {
+        if (c == 'h') {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (c != 0) return 1;
+        const char* name = long_options[option_index].name;
+        if (strcmp(name, "corpus") == 0) {
+            corpus_dir = optarg;
+        } else if (strcmp(name, "transcripts") == 0) {
+            transcripts_dir = optarg;
+        } else if (strcmp(name, "base-url") == 0) {
+            base_url = optarg;
+        } else if (strcmp(name, "runs") == 0) {
+            runs = atoi(optarg) > 0 ? atoi(optarg) : 1;
+        } else if (strcmp(name, "no-micro") == 0) {
+            micro = false;
+        }
+    }
+    
+#ifdef PLATFORM_WINDOWS
+    if (!getenv("OPENAI_API_KEY")) _putenv_s("OPENAI_API_KEY", "bench");
+#else
+    setenv("OPENAI_API_KEY", "bench", 0);
+#endif
+    agent_global_init();
+    
+    char* root = platform_normalize_path(corpus_dir);
+    if (!platform_is_directory(root)) {
+        fprintf(stderr, "Error: corpus directory not found: %s\n", corpus_dir);
+        free(root);
+        return 1;
+    }
+    
+    // Transcripts, by file name without .json
+    FileList* names = file_list_create();
+    platform_list_directory(transcripts_dir, collect_transcript, names);
+    file_list_sort(names);
+    cJSON** transcripts = safe_calloc(names->count + 1, sizeof(cJSON*));
+    cJSON* react_transcript = NULL;
+    for (size_t i = 0; i < names->count; i++) {
+        char path[2048];
+        snprintf(path, sizeof(path), "%s%c%s", transcripts_dir, PATH_SEPARATOR_CHAR, names->files[i]);
+        transcripts[i] = load_json_file(path);
+        names->files[i][strlen(names->files[i]) - 5] = '\0';
+        if (transcripts[i] && !cJSON_IsTrue(cJSON_GetObjectItem(transcripts[i], "function_calling")) &&
+            !react_transcript) {
+            react_transcript = transcripts[i];
+        }
+    }
+    
+    cJSON* output = cJSON_CreateObject();
+    cJSON_AddNumberToObject(output, "format", 1);
+    char timestamp[32];
+    time_t now = time(NULL);
+    struct tm tm_buf;
+    platform_localtime(now, &tm_buf);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &tm_buf);
+    cJSON_AddStringToObject(output, "timestamp", timestamp);
+    cJSON_AddNumberToObject(output, "cpus", platform_cpu_count());
+    cJSON_AddStringToObject(output, "corpus", root);
+    
+    if (micro) {
+        BenchCorpus corpus = {0};
+        corpus.root = root;
+        corpus.files = file_list_create();
+        corpus.gitignore = gitignore_load(root);
+        traverse_directory_parallel(root, "*", corpus.files, corpus.gitignore);
+        corpus.relative = safe_calloc(corpus.files->count + 1, sizeof(char*));
+        corpus.text_files = file_list_create();
+        size_t root_length = strlen(root);
+        for (size_t i = 0; i < corpus.files->count; i++) {
+            const char* relative = corpus.files->files[i] + root_length;
+            while (*relative == '/' || *relative == '\\') relative++;
+            corpus.relative[i] = (char*)relative;
+            
+            FileSignature signature;
+            if (corpus.text_files->count < BENCH_READ_FILES &&
+                platform_file_signature(corpus.files->files[i], &signature) == 0 &&
+                signature.size > 0 && signature.size <= READ_FILE_MAX_CONTENT) {
+                char* observation = read_file(corpus.files->files[i]);
+                if (!strstr(observation, "\"error\"")) {
+                    file_list_add(corpus.text_files, corpus.files->files[i]);
+                    corpus.text_bytes += (size_t)signature.size;
+                }
+                free(observation);
+            }
+        }
+        corpus.index = repo_index_build(root);
+        corpus.request_json = build_request_json(&corpus);
+        corpus.react_reply = react_transcript ? transcript_turn(react_transcript, 1) : NULL;
+        cJSON* responses = react_transcript ? cJSON_GetObjectItem(react_transcript, "responses") : NULL;
+        corpus.final_reply = responses ? transcript_turn(react_transcript, cJSON_GetArraySize(responses) - 1) : NULL;
+        corpus.response_json = build_response_json(corpus.final_reply ? corpus.final_reply : REACT_SYSTEM_PROMPT);
+        cJSON_AddNumberToObject(output, "corpus_files", (double)corpus.files->count);
+        
+        cJSON_AddItemToObject(output, "benchmarks", run_micro_benchmarks(&corpus, react_transcript));
+        
+        free(corpus.request_json);
+        free(corpus.response_json);
+        cJSON_Delete(corpus.request);
+        repo_index_destroy(corpus.index);
+        gitignore_destroy(corpus.gitignore);
+        free(corpus.relative);
+        file_list_destroy(corpus.text_files);
+        file_list_destroy(corpus.files);
+    }
+    
+    if (base_url) {
+        cJSON* end_to_end = cJSON_AddArrayToObject(output, "end_to_end");
+        for (size_t i = 0; i < names->count; i++) {
+            if (!transcripts[i]) continue;
+            cJSON_AddItemToArray(end_to_end, run_transcript(names->files[i], transcripts[i], base_url, root, runs));
+        }
+    }
+    
+    char* json = cJSON_Print(output);
+    printf("%s\n", json);
+    free(json);
+    
+    cJSON_Delete(output);
+    for (size_t i = 0; i < names->count; i++) {
+        cJSON_Delete(transcripts[i]);
+    }
+    free(transcripts);
+    file_list_destroy(names);
+    free(root);
+    return 0;
+}
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""OpenAI-compatible chat completions endpoint that replays recorded transcripts.
+
+Each transcripts/NAME.json holds the assistant turns of one run. A request for
+model NAME gets the turn after the assistant messages it already contains, so
+an agent replays the same conversation every time. "{directory}" in a turn is
+replaced with the base directory from the request's first user message.
+
+Like OpenAI's prompt cache, the usage reports as cached_tokens the part of
+the request (in 128-token blocks, from 1024 tokens on) that repeats the
+start of an earlier request for the same model.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+BASE_DIRECTORY = re.compile(r"Base directory for analysis: (.*)")
+
+
+def load_transcripts(directory):
+    transcripts = {}
+    for name in sorted(os.listdir(directory)):
+        if name.endswith(".json"):
+            with open(os.path.join(directory, name)) as f:
+                transcripts[name[:-5]] = json.load(f)
+    return transcripts
+
+
+def substitute(value, directory):
+    # Turns embed the directory inside JSON strings, so insert it escaped
+    if isinstance(value, str):
+        return value.replace("{directory}", json.dumps(directory)[1:-1])
+    if isinstance(value, list):
+        return [substitute(item, directory) for item in value]
+    if isinstance(value, dict):
+        return {key: substitute(item, directory) for key, item in value.items()}
+    return value
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def send_json(self, status, payload):
+        body = json.dumps(payload).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        raw = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        request = json.loads(raw)
+        transcript = self.server.transcripts.get(request.get("model", ""))
+        if transcript is None:
+            self.send_json(404, {"error": {"message": "no transcript for model %s" % request.get("model")}})
+            return
+
+        messages = request.get("messages", [])
+        directory = ""
+        for message in messages:
+            match = message.get("role") == "user" and BASE_DIRECTORY.search(message.get("content") or "")
+            if match:
+                directory = match.group(1).strip()
+                break
+
+        responses = transcript["responses"]
+        step = sum(1 for message in messages if message.get("role") == "assistant")
+        turn = substitute(responses[min(step, len(responses) - 1)], directory)
+        message = {"role": "assistant", "content": turn} if isinstance(turn, str) else dict(turn, role="assistant")
+        message.setdefault("content", None)
+        usage = {"prompt_tokens": len(raw) // 4, "completion_tokens": len(json.dumps(message)) // 4,
+                 "prompt_tokens_details": {"cached_tokens": self.cached_tokens(request.get("model", ""), raw)}}
+
+        if self.server.latency_ms:
+            time.sleep(self.server.latency_ms / 1000.0)
+
+        if request.get("stream") and isinstance(turn, str):
+            self.send_stream(turn, usage)
+        else:
+            self.send_json(200, {"choices": [{"message": message, "finish_reason": "stop"}], "usage": usage})
+
+    def cached_tokens(self, model, raw):
+        with self.server.lock:
+            previous = self.server.prefixes.get(model, [])
+            common = max([len(os.path.commonprefix([raw, earlier])) for earlier in previous] + [0])
+            self.server.prefixes[model] = (previous + [raw])[-16:]
+        tokens = common // 4
+        return tokens // 128 * 128 if tokens >= 1024 else 0
+
+    def send_stream(self, text, usage):
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+        chunks = [text[i:i + 256] for i in range(0, len(text), 256)]
+        events = [{"choices": [{"delta": {"content": chunk}}]} for chunk in chunks]
+        events.append({"choices": [{"delta": {}, "finish_reason": "stop"}], "usage": usage})
+        for event in events + ["[DONE]"]:
+            data = ("data: %s\n\n" % (event if isinstance(event, str) else json.dumps(event))).encode()
+            try:
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(data), data))
+            except (BrokenPipeError, ConnectionResetError):
+                # The client stops reading once it has all the actions
+                return
+        self.wfile.write(b"0\r\n\r\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--transcripts", required=True, help="directory of transcript JSON files")
+    parser.add_argument("--port", type=int, default=0, help="port to listen on (default: any free port)")
+    parser.add_argument("--port-file", help="write the port here once listening")
+    parser.add_argument("--latency-ms", type=float, default=0, help="delay before every response")
+    args = parser.parse_args()
+
+    ThreadingHTTPServer.request_queue_size = 128
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), Handler)
+    server.daemon_threads = True
+    server.transcripts = load_transcripts(args.transcripts)
+    server.latency_ms = args.latency_ms
+    server.prefixes = {}
+    server.lock = threading.Lock()
+
+    port = server.server_address[1]
+    if args.port_file:
+        with open(args.port_file + ".tmp", "w") as f:
+            f.write("%d\n" % port)
+        os.replace(args.port_file + ".tmp", args.port_file)
+    print("Serving %d transcripts on port %d" % (len(server.transcripts), port), file=sys.stderr)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
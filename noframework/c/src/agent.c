@@ -1,26 +1,45 @@
 #include "agent.h"
 #include "tools.h"
+#include "index.h"
+#include "prefetch.h"
+#include "mapreduce.h"
+#include "manifest.h"
 #include <time.h>
 #include <ctype.h>
+#include <stdarg.h>
 
-const char* REACT_SYSTEM_PROMPT = 
-"You are a technical documentation assistant that analyses codebases and generates comprehensive documentation.\n"
+#define SYSTEM_PROMPT_INTRO \
+"You are a technical documentation assistant that analyses codebases and generates comprehensive documentation.\n" \
+"\n" \
+"When given a directory path and a specific analysis request, you will:\n" \
+"1. Explore the codebase structure to understand its organization\n" \
+"2. Read relevant files to comprehend the implementation details\n" \
+"3. Generate detailed technical documentation based on your analysis\n" \
 "\n"
-"When given a directory path and a specific analysis request, you will:\n"
-"1. Explore the codebase structure to understand its organization\n"
-"2. Read relevant files to comprehend the implementation details\n"
-"3. Generate detailed technical documentation based on your analysis\n"
+
+#define SYSTEM_PROMPT_GUIDELINES \
+"Important guidelines:\n" \
+"- Always start by exploring the directory structure to understand the codebase layout\n" \
+"- Read files strategically based on the documentation needs\n" \
+"- Pay attention to configuration files, main entry points, and key modules\n" \
+"- Generate clear, well-structured documentation that would help developers understand the codebase\n" \
 "\n"
+
+const char* REACT_SYSTEM_PROMPT = 
+SYSTEM_PROMPT_INTRO
 "You have access to tools that help you explore and understand codebases:\n"
 "- find_all_matching_files: Find files matching patterns in directories\n"
-"- read_file: Read the contents of specific files\n"
+"- read_file: Read the contents of specific files. Large files are truncated; page through them with\n"
+"  optional \"offset\"/\"length\" (bytes) or \"start_line\"/\"end_line\" parameters\n"
+"- search_code: Find the lines that contain a string (\"pattern\"), or match an extended regular expression\n"
+"  with \"regex\": true, and get file:line snippets. Use it to locate definitions and uses without reading\n"
+"  whole files; optional \"ignore_case\", \"directory\", \"file_pattern\" (e.g. *.py) and \"max_results\"\n"
 "\n"
-"Important guidelines:\n"
-"- Always start by exploring the directory structure to understand the codebase layout\n"
-"- Read files strategically based on the documentation needs\n"
-"- Pay attention to configuration files, main entry points, and key modules\n"
-"- Generate clear, well-structured documentation that would help developers understand the codebase\n"
+"When several tool calls do not depend on each other (for example reading a handful of files), write up to\n"
+"8 Action/Action Input pairs in one response. They run together and you receive one numbered Observation\n"
+"per action, in the same order.\n"
 "\n"
+SYSTEM_PROMPT_GUIDELINES
 "Use the following format:\n"
 "\n"
 "Thought: I need to [describe what you need to do next]\n"
@@ -33,7 +52,129 @@ const char* REACT_SYSTEM_PROMPT =
 "\n"
 "Begin your analysis now.";
 
+const char* FUNCTION_CALLING_SYSTEM_PROMPT =
+SYSTEM_PROMPT_INTRO
+"Use the provided tools to explore the codebase. Call several tools at once (up to 8) when the calls do not\n"
+"depend on each other, for example to read a handful of files.\n"
+"\n"
+SYSTEM_PROMPT_GUIDELINES
+"When you have enough information, reply without calling a tool. That reply must be the complete technical\n"
+"documentation and nothing else.\n"
+"\n"
+"Begin your analysis now.";
+
+// Tool definitions sent with every function-calling request
+static const char* TOOL_SCHEMAS =
+"[{\"type\":\"function\",\"function\":{\"name\":\"find_all_matching_files\","
+"\"description\":\"Find files matching a pattern in a directory, skipping files excluded by .gitignore\","
+"\"parameters\":{\"type\":\"object\",\"properties\":{"
+"\"directory\":{\"type\":\"string\",\"description\":\"Directory to search\"},"
+"\"pattern\":{\"type\":\"string\",\"description\":\"Glob pattern for file names, e.g. *.c (default *)\"}},"
+"\"required\":[\"directory\"]}}},"
+"{\"type\":\"function\",\"function\":{\"name\":\"read_file\","
+"\"description\":\"Read a text file. Large files are truncated; page through them with a byte or line range\","
+"\"parameters\":{\"type\":\"object\",\"properties\":{"
+"\"file_path\":{\"type\":\"string\",\"description\":\"Path of the file to read\"},"
+"\"offset\":{\"type\":\"integer\",\"description\":\"First byte to read\"},"
+"\"length\":{\"type\":\"integer\",\"description\":\"Number of bytes to read\"},"
+"\"start_line\":{\"type\":\"integer\",\"description\":\"First line to read (1-based)\"},"
+"\"end_line\":{\"type\":\"integer\",\"description\":\"Last line to read (inclusive)\"}},"
+"\"required\":[\"file_path\"]}}},"
+"{\"type\":\"function\",\"function\":{\"name\":\"search_code\","
+"\"description\":\"Find the lines of the repository's text files that contain a string or match a regular "
+"expression; returns file, line number and line text\","
+"\"parameters\":{\"type\":\"object\",\"properties\":{"
+"\"pattern\":{\"type\":\"string\",\"description\":\"Text to find, or a POSIX extended regular expression\"},"
+"\"regex\":{\"type\":\"boolean\",\"description\":\"Treat pattern as a regular expression (default false)\"},"
+"\"ignore_case\":{\"type\":\"boolean\",\"description\":\"Ignore ASCII case (default false)\"},"
+"\"directory\":{\"type\":\"string\",\"description\":\"Only search below this directory\"},"
+"\"file_pattern\":{\"type\":\"string\",\"description\":\"Only search files whose name matches this glob, e.g. *.py\"},"
+"\"max_results\":{\"type\":\"integer\",\"description\":\"Maximum number of matching lines (default 50)\"}},"
+"\"required\":[\"pattern\"]}}}]";
+
+// Step-scoped allocations come from the calling thread's current arena when
+// one is active and fall back to the heap otherwise
+static void* step_alloc(size_t size) {
+    Arena* arena = arena_current();
+    return arena ? arena_alloc(arena, size) : safe_malloc(size);
+}
+
+static void step_free(void* ptr) {
+    Arena* arena = arena_current();
+    if (!ptr || (arena && arena_owns(arena, ptr))) return;
+    free(ptr);
+}
+
+static char* step_strdup(const char* str) {
+    size_t length = strlen(str);
+    char* copy = step_alloc(length + 1);
+    memcpy(copy, str, length + 1);
+    return copy;
+}
+
+// Copy [start, end) without surrounding whitespace
+static char* step_strndup_trimmed(const char* start, const char* end) {
+    while (start < end && isspace((unsigned char)*start)) start++;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+    
+    size_t length = end - start;
+    char* copy = step_alloc(length + 1);
+    memcpy(copy, start, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static void* CJSON_CDECL cjson_step_malloc(size_t size) {
+    Arena* arena = arena_current();
+    return arena ? arena_alloc(arena, size) : malloc(size);
+}
+
+static void CJSON_CDECL cjson_step_free(void* ptr) {
+    step_free(ptr);
+}
+
+static const char* ROLE_NAMES[] = {"system", "user", "assistant", "tool"};
+
+const char* message_role_name(MessageRole role) {
+    return ROLE_NAMES[role];
+}
+
+// Rough prompt cost: about four bytes per token plus per-message framing
+static size_t estimate_tokens(const Message* message) {
+    size_t bytes = strlen(ROLE_NAMES[message->role]);
+    if (message->content) bytes += strlen(message->content);
+    if (message->tool_calls) bytes += strlen(message->tool_calls);
+    if (message->tool_call_id) bytes += strlen(message->tool_call_id);
+    return (bytes + 3) / 4 + 4;
+}
+
+// Messages are only appended between edits of the history, so their
+// strings are bumped from one arena instead of allocated one by one.
+// Small blocks keep idle agents of a batch cheap; large observations get
+// blocks of their own.
+#define MESSAGE_ARENA_BLOCK (8 * 1024)
+
+static char* message_strdup(Arena* arena, const char* str) {
+    return str ? arena_strndup(arena, str, strlen(str)) : NULL;
+}
+
+void agent_global_init(void) {
+    static bool initialized = false;
+    if (initialized) return;
+    initialized = true;
+    
+    // cJSON trees built while a step is running live in the step arena
+    cJSON_Hooks hooks = {cjson_step_malloc, cjson_step_free};
+    cJSON_InitHooks(&hooks);
+}
+
 TechWriterAgent* agent_create(const char* model_name, const char* base_url) {
+    return agent_create_pooled(model_name, base_url, NULL);
+}
+
+static void request_prefix_init(TechWriterAgent* agent, StringBuffer* prefix, bool with_tools);
+
+TechWriterAgent* agent_create_pooled(const char* model_name, const char* base_url, HttpPool* pool) {
     // Parse model name (vendor/model)
     char* slash = strchr(model_name, '/');
     if (!slash) {
@@ -82,7 +223,7 @@ TechWriterAgent* agent_create(const char* model_name, const char* base_url) {
     // Create agent
     TechWriterAgent* agent = safe_calloc(1, sizeof(TechWriterAgent));
     agent->model_id = safe_strdup(model_id);
-    agent->client = http_client_create(api_base_url, api_key);
+    agent->client = http_client_create_pooled(api_base_url, api_key, pool);
     if (!agent->client) {
         free(agent->model_id);
         free(agent);
@@ -92,172 +233,957 @@ TechWriterAgent* agent_create(const char* model_name, const char* base_url) {
     // Initialize memory
     agent->memory_capacity = 10;
     agent->memory = safe_calloc(agent->memory_capacity, sizeof(Message));
-    
-    // Create log directory and file
-    platform_make_directory("logs");
-    char log_filename[256];
-    time_t now = time(NULL);
-    snprintf(log_filename, sizeof(log_filename), "logs/tech-writer-%ld.log", (long)now);
-    agent->log_file = fopen(log_filename, "w");
-    
-    log_message(LOG_INFO, "Starting ReAct agent with model: %s", model_id);
+    agent->message_arena = arena_create(MESSAGE_ARENA_BLOCK);
+    agent->token_budget = DEFAULT_TOKEN_BUDGET;
+    string_buffer_init(&agent->encoded_messages, 64 * 1024);
+    string_buffer_init(&agent->files_read, 256);
+    content_hash_init(&agent->messages_hash);
+    request_prefix_init(agent, &agent->request_prefixes[0], false);
+    request_prefix_init(agent, &agent->request_prefixes[1], true);
+    
+    agent->step_arena = arena_create(64 * 1024);
+    agent->parallel_tools = true;
+    agent->prefetch_reads = true;
+    agent->log_level = AGENT_DEFAULT_LOG_LEVEL;
+    platform_mutex_init(&agent->log_lock);
+    agent_global_init();
     
     return agent;
 }
 
+static void llm_request_destroy(LlmRequest* request);
+
 void agent_destroy(TechWriterAgent* agent) {
     if (!agent) return;
     
+    http_client_log_timing(agent->client);
     http_client_destroy(agent->client);
     free(agent->model_id);
     
-    for (size_t i = 0; i < agent->memory_count; i++) {
-        free(agent->memory[i].role);
-        free(agent->memory[i].content);
-    }
     free(agent->memory);
+    arena_destroy(agent->message_arena);
+    string_buffer_free(&agent->encoded_messages);
+    string_buffer_free(&agent->files_read);
+    string_buffer_free(&agent->request_prefixes[0]);
+    string_buffer_free(&agent->request_prefixes[1]);
+    if (agent->request) {
+        // Destroyed with a request in flight
+        Arena* previous_arena = arena_set_current(agent->step_arena);
+        llm_request_destroy(agent->request);
+        arena_set_current(previous_arena);
+    }
+    free(agent->final_answer);
+    free(agent->base_directory);
+    repo_index_destroy(agent->index);
+    read_prefetch_destroy(agent->prefetch);
+    arena_destroy(agent->step_arena);
     
     if (agent->log_file) {
         fclose(agent->log_file);
     }
+    platform_mutex_destroy(&agent->log_lock);
     
     free(agent);
 }
 
-void agent_add_message(TechWriterAgent* agent, const char* role, const char* content) {
+// Content may come escaped already (without quotes), e.g. by the tool thread
+// that produced it; otherwise it is escaped here
+static void message_encode(StringBuffer* encoded, const Message* message, const StringBuffer* escaped) {
+    if (encoded->size > 0) {
+        string_buffer_append(encoded, ",", 1);
+    }
+    const char* role = ROLE_NAMES[message->role];
+    string_buffer_append(encoded, "{\"role\":", 8);
+    json_append_string(encoded, role, strlen(role));
+    string_buffer_append(encoded, ",\"content\":", 11);
+    if (escaped) {
+        string_buffer_append(encoded, "\"", 1);
+        string_buffer_append(encoded, escaped->data, escaped->size);
+        string_buffer_append(encoded, "\"", 1);
+    } else if (message->content) {
+        json_append_string(encoded, message->content, strlen(message->content));
+    } else {
+        string_buffer_append(encoded, "null", 4);
+    }
+    if (message->tool_calls) {
+        string_buffer_append(encoded, ",\"tool_calls\":", 14);
+        string_buffer_append(encoded, message->tool_calls, strlen(message->tool_calls));
+    }
+    if (message->tool_call_id) {
+        string_buffer_append(encoded, ",\"tool_call_id\":", 16);
+        json_append_string(encoded, message->tool_call_id, strlen(message->tool_call_id));
+    }
+    string_buffer_append(encoded, "}", 1);
+}
+
+// Content is in the message arena already and becomes the message's
+static void agent_push_escaped(TechWriterAgent* agent, MessageRole role, char* content,
+                               const char* tool_calls, const char* tool_call_id,
+                               const StringBuffer* escaped) {
     if (agent->memory_count >= agent->memory_capacity) {
         agent->memory_capacity *= 2;
         agent->memory = safe_realloc(agent->memory, agent->memory_capacity * sizeof(Message));
     }
     
-    agent->memory[agent->memory_count].role = safe_strdup(role);
-    agent->memory[agent->memory_count].content = safe_strdup(content);
-    agent->memory_count++;
+    Message* message = &agent->memory[agent->memory_count++];
+    message->role = role;
+    message->content = content;
+    message->tool_calls = message_strdup(agent->message_arena, tool_calls);
+    message->tool_call_id = message_strdup(agent->message_arena, tool_call_id);
+    message->tokens = estimate_tokens(message);
+    message->compacted = false;
+    agent->memory_tokens += message->tokens;
+    
+    // Escape the message once; every later request reuses the encoded bytes
+    message_encode(&agent->encoded_messages, message, escaped);
 }
 
-char* agent_call_llm(TechWriterAgent* agent) {
-    // Build request JSON
-    cJSON* request = cJSON_CreateObject();
-    cJSON_AddStringToObject(request, "model", agent->model_id);
+static void agent_push_message(TechWriterAgent* agent, MessageRole role, const char* content,
+                               const char* tool_calls, const char* tool_call_id) {
+    agent_push_escaped(agent, role, message_strdup(agent->message_arena, content),
+                       tool_calls, tool_call_id, NULL);
+}
+
+// Rebuild the encoded request messages after memory was edited in place.
+// The edits left replaced and dropped strings behind in the message arena,
+// so the live ones move to a fresh arena.
+static void agent_reencode_messages(TechWriterAgent* agent) {
+    Arena* packed = arena_create(MESSAGE_ARENA_BLOCK);
+    for (size_t i = 0; i < agent->memory_count; i++) {
+        Message* message = &agent->memory[i];
+        message->content = message_strdup(packed, message->content);
+        message->tool_calls = message_strdup(packed, message->tool_calls);
+        message->tool_call_id = message_strdup(packed, message->tool_call_id);
+    }
+    arena_destroy(agent->message_arena);
+    agent->message_arena = packed;
     
-    cJSON* messages = cJSON_CreateArray();
+    string_buffer_clear(&agent->encoded_messages);
+    content_hash_init(&agent->messages_hash);
+    agent->messages_hashed = 0;
     for (size_t i = 0; i < agent->memory_count; i++) {
-        cJSON* msg = cJSON_CreateObject();
-        cJSON_AddStringToObject(msg, "role", agent->memory[i].role);
-        cJSON_AddStringToObject(msg, "content", agent->memory[i].content);
-        cJSON_AddItemToArray(messages, msg);
+        message_encode(&agent->encoded_messages, &agent->memory[i], NULL);
+    }
+}
+
+void agent_add_message(TechWriterAgent* agent, MessageRole role, const char* content) {
+    agent_push_message(agent, role, content, NULL, NULL);
+}
+
+char* agent_message_buffer(TechWriterAgent* agent, size_t size) {
+    return arena_alloc(agent->message_arena, size);
+}
+
+void agent_add_message_owned(TechWriterAgent* agent, MessageRole role, char* content) {
+    agent_push_escaped(agent, role, content, NULL, NULL, NULL);
+}
+
+// The old content stays in the arena until the history is re-encoded
+static void message_set_content(TechWriterAgent* agent, Message* message, const char* content) {
+    message->content = message_strdup(agent->message_arena, content);
+    agent->memory_tokens -= message->tokens;
+    message->tokens = estimate_tokens(message);
+    agent->memory_tokens += message->tokens;
+}
+
+static bool is_observation(const Message* message) {
+    if (message->role == ROLE_TOOL) return true;
+    return message->role == ROLE_USER && message->content &&
+           string_starts_with(message->content, "Observation");
+}
+
+#define COMPACTED_MARKER "[compacted]"
+
+// One-line stand-in for an old observation: which files or listings it
+// held, so the model knows what to re-read if it needs the details again
+static char* summarize_observation(const char* content) {
+    StringBuffer summary;
+    string_buffer_init(&summary, 256);
+    
+    const char* body = content;
+    if (string_starts_with(content, "Observation")) {
+        string_buffer_append(&summary, "Observation: ", 13);
+        if (string_starts_with(content, "Observation: ")) body += 13;
+    }
+    string_buffer_append(&summary, COMPACTED_MARKER " ", strlen(COMPACTED_MARKER) + 1);
+    
+    // read_file results start with {"file":"<path>"
+    const char* file_key = "{\"file\":\"";
+    size_t files = 0;
+    for (const char* p = strstr(content, file_key); p; p = strstr(p, file_key)) {
+        p += strlen(file_key);
+        const char* end = p;
+        while (*end && *end != '"') end += (*end == '\\' && end[1]) ? 2 : 1;
+        string_buffer_append(&summary, files == 0 ? "Contents of " : ", ", files == 0 ? 12 : 2);
+        string_buffer_append(&summary, p, end - p);
+        files++;
+    }
+    
+    const char* text;
+    if (files > 0) {
+        text = " were removed to save context; read the files again if you need them.";
+    } else if (string_starts_with(body, "{\"query\":") || strstr(content, "(search_code):")) {
+        text = "Search results removed to save context; search again if you need them.";
+    } else if (body[0] == '[' || strstr(content, "(find_all_matching_files):")) {
+        text = "File listing removed to save context; list the directory again if you need it.";
+    } else {
+        text = "Earlier tool output removed to save context; run the tool again if you need it.";
+    }
+    string_buffer_append(&summary, text, strlen(text));
+    return summary.data;
+}
+
+void agent_enforce_budget(TechWriterAgent* agent) {
+    bool changed = false;
+    
+    // The newest observations (after the last assistant turn) are always kept
+    size_t last_assistant = 0;
+    for (size_t i = agent->memory_count; i-- > 0; ) {
+        if (agent->memory[i].role == ROLE_ASSISTANT) {
+            last_assistant = i;
+            break;
+        }
     }
-    cJSON_AddItemToObject(request, "messages", messages);
-    cJSON_AddNumberToObject(request, "temperature", 0);
     
-    char* request_str = cJSON_PrintUnformatted(request);
-    cJSON_Delete(request);
+    if (agent->token_budget > 0 && agent->memory_tokens > agent->token_budget) {
+        // Compact oldest first down to 3/4 of the budget so this does not run
+        // every step. Every compaction changes the history after the first
+        // stub and so misses the provider's prompt cache for the rest of the
+        // request; with a stable prefix it goes down to half, to run less often.
+        size_t target = agent->stable_prefix ? agent->token_budget / 2 : agent->token_budget / 4 * 3;
+        size_t before = agent->memory_tokens;
+        size_t compacted = 0;
+        
+        for (size_t i = 2; i < last_assistant && agent->memory_tokens > target; i++) {
+            Message* message = &agent->memory[i];
+            if (!is_observation(message) || message->compacted) continue;
+            
+            char* summary = summarize_observation(message->content);
+            if (strlen(summary) >= strlen(message->content)) {
+                // Already shorter than its stub
+                free(summary);
+                continue;
+            }
+            message_set_content(agent, message, summary);
+            message->compacted = true;
+            free(summary);
+            compacted++;
+        }
+        
+        if (compacted > 0) {
+            log_message(LOG_INFO, "Compacted %zu observations: %zu -> %zu tokens",
+                        compacted, before, agent->memory_tokens);
+            changed = true;
+        }
+    }
     
-    // Make HTTP request
-    HttpResponse* response = http_post_json(agent->client, "chat/completions", request_str);
-    free(request_str);
+    // Past the message limit, drop whole steps (an assistant turn and the
+    // observations answering it) after the system prompt, the task and any
+    // context seeded before the first step; with a stable prefix, a quarter
+    // of the limit at once
+    size_t message_limit = MAX_MEMORY_SIZE;
+    if (agent->stable_prefix && agent->memory_count > MAX_MEMORY_SIZE) {
+        message_limit = MAX_MEMORY_SIZE / 4 * 3;
+    }
+    size_t start = 2;
+    while (start < agent->memory_count && agent->memory[start].role != ROLE_ASSISTANT) start++;
+    while (agent->memory_count > message_limit) {
+        if (start >= agent->memory_count) break;
+        size_t end = start + 1;
+        while (end < agent->memory_count && agent->memory[end].role != ROLE_ASSISTANT) end++;
+        if (end >= agent->memory_count) break;
+        
+        for (size_t i = start; i < end; i++) {
+            agent->memory_tokens -= agent->memory[i].tokens;
+        }
+        memmove(&agent->memory[start], &agent->memory[end], (agent->memory_count - end) * sizeof(Message));
+        agent->memory_count -= end - start;
+        changed = true;
+    }
+    
+    if (changed) {
+        agent_reencode_messages(agent);
+    }
+}
+
+// Incremental ReAct scanner for streamed completions. Once a complete
+// Action Input JSON object has arrived it lets the model continue only with
+// another Thought or Action, and stops the generation at anything else (a
+// hallucinated Observation). Final answer text is copied to the agent's
+// answer stream as it is generated.
+typedef struct {
+    FILE* answer_stream;
+    size_t scan_offset;     // resume point for the marker search
+    size_t answer_start;    // start of the final answer text
+    size_t answer_written;  // final answer bytes written so far
+    size_t input_offset;    // next Action Input byte to scan
+    int depth;              // JSON nesting depth inside Action Input
+    bool in_answer;
+    bool in_input;
+    bool after_input;       // an Action Input is complete; deciding what follows
+    bool in_string;
+    bool escaped;
+} ReactStream;
+
+static bool react_stream_callback(const char* text, size_t length, size_t delta_start, void* userdata) {
+    ReactStream* state = (ReactStream*)userdata;
+    
+    if (!state->in_answer) {
+        const char* final_marker = "Final Answer:";
+        const char* input_marker = "Action Input:";
+        
+        char* final_pos = strstr(text + state->scan_offset, final_marker);
+        if (final_pos) {
+            // A final answer always wins, even after an Action Input
+            state->in_answer = true;
+            state->in_input = false;
+            state->after_input = false;
+            state->answer_start = (final_pos - text) + strlen(final_marker);
+        } else if (!state->in_input && !state->after_input) {
+            char* input_pos = strstr(text + state->scan_offset, input_marker);
+            if (input_pos) {
+                state->in_input = true;
+                state->depth = 0;
+                state->input_offset = (input_pos - text) + strlen(input_marker);
+            }
+        }
+        
+        // Markers may straddle deltas, so keep a marker's worth of overlap
+        size_t overlap = strlen(final_marker) - 1;
+        state->scan_offset = length > overlap ? length - overlap : 0;
+    }
+    
+    if (state->in_answer) {
+        // Match agent_parse_response: leading whitespace is not part of the answer
+        while (state->answer_start < length && isspace((unsigned char)text[state->answer_start])) {
+            state->answer_start++;
+        }
+        if (state->answer_written < state->answer_start) {
+            state->answer_written = state->answer_start;
+        }
+        if (state->answer_stream && state->answer_written < length) {
+            fwrite(text + state->answer_written, 1, length - state->answer_written, state->answer_stream);
+            fflush(state->answer_stream);
+            state->answer_written = length;
+        }
+        return true;
+    }
+    
+    if (state->in_input) {
+        for (; state->input_offset < length && state->in_input; state->input_offset++) {
+            char c = text[state->input_offset];
+            
+            if (state->depth == 0) {
+                if (isspace((unsigned char)c)) continue;
+                if (c != '{') {
+                    // Not a JSON object; let the model finish normally
+                    state->in_input = false;
+                    return true;
+                }
+                state->depth = 1;
+                continue;
+            }
+            
+            if (state->in_string) {
+                if (state->escaped) state->escaped = false;
+                else if (c == '\\') state->escaped = true;
+                else if (c == '"') state->in_string = false;
+            } else if (c == '"') {
+                state->in_string = true;
+            } else if (c == '{' || c == '[') {
+                state->depth++;
+            } else if ((c == '}' || c == ']') && --state->depth == 0) {
+                state->in_input = false;
+                state->after_input = true;
+            }
+        }
+    }
     
+    if (state->after_input) {
+        size_t pos = state->input_offset;
+        while (pos < length && isspace((unsigned char)text[pos])) pos++;
+        
+        const char* continuations[] = {"Action:", "Thought:"};
+        for (size_t i = 0; i < sizeof(continuations) / sizeof(continuations[0]); i++) {
+            size_t marker_len = strlen(continuations[i]);
+            size_t available = length - pos;
+            if (strncmp(text + pos, continuations[i], available < marker_len ? available : marker_len) != 0) {
+                continue;
+            }
+            if (available < marker_len) {
+                // Could still become a continuation; wait for more text
+                return true;
+            }
+            // Another action follows: scan it like the first one
+            state->after_input = false;
+            state->scan_offset = pos;
+            return react_stream_callback(text, length, delta_start, userdata);
+        }
+        
+        if (pos < length) {
+            log_message(LOG_DEBUG, "Action Input complete, stopping generation");
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// Line of the agent's log file. The file (and the logs directory) is only
+// created by the first line at or above agent->log_level, so runs that log
+// nothing cost nothing; agents whose files are created in the same second
+// get a sequence suffix.
+static void agent_log(TechWriterAgent* agent, LogLevel level, const char* format, ...) {
+    if (level < agent->log_level) return;
+    
+    platform_mutex_lock(&agent->log_lock);
+    if (!agent->log_file && !agent->log_failed) {
+        static volatile unsigned long log_sequence = 0;
+        unsigned long sequence = platform_atomic_increment(&log_sequence);
+        platform_make_directory("logs");
+        char log_filename[256];
+        time_t now = time(NULL);
+        if (sequence == 1) {
+            snprintf(log_filename, sizeof(log_filename), "logs/tech-writer-%ld.log", (long)now);
+        } else {
+            snprintf(log_filename, sizeof(log_filename), "logs/tech-writer-%ld-%lu.log", (long)now, sequence);
+        }
+        agent->log_file = fopen(log_filename, "w");
+        agent->log_failed = agent->log_file == NULL;
+    }
+    if (agent->log_file) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(agent->log_file, format, args);
+        va_end(args);
+        fputc('\n', agent->log_file);
+    }
+    platform_mutex_unlock(&agent->log_lock);
+}
+
+static void log_llm_timing(TechWriterAgent* agent, const HttpResponse* response) {
+    const HttpTiming* timing = &response->timing;
+    agent_log(agent, LOG_DEBUG, "LLM timing: dns %.1f ms, connect %.1f ms, tls %.1f ms, "
+              "ttfb %.1f ms, total %.1f ms%s",
+              timing->ms[HTTP_PHASE_DNS], timing->ms[HTTP_PHASE_CONNECT], timing->ms[HTTP_PHASE_TLS],
+              timing->ms[HTTP_PHASE_TTFB], timing->ms[HTTP_PHASE_TOTAL],
+              timing->reused ? " (reused connection)" : "");
+}
+
+// Starts the trace record of a step; its totals go to agent->stats as
+// responses and tool results come in
+static void agent_trace_step_start(TechWriterAgent* agent) {
+    TraceStep* step = &agent->trace_step;
+    memset(step, 0, sizeof(TraceStep));
+    step->step = agent->step + 1;
+    step->start_ns = platform_monotonic_ns();
+    step->prompt_tokens = -1;
+    step->cached_tokens = -1;
+    step->completion_tokens = -1;
+    step->tools = agent->trace_tools;
+}
+
+// Closes the step's record once, when it ends or the run stops in it
+static void agent_trace_step_end(TechWriterAgent* agent) {
+    if (!agent->step_started) return;
+    agent->step_started = false;
+    
+    TraceStep* step = &agent->trace_step;
+    step->end_ns = platform_monotonic_ns();
+    step->memory_messages = agent->memory_count;
+    step->memory_tokens = agent->memory_tokens;
+    step->memory_bytes = agent->encoded_messages.size;
+    agent->stats.steps++;
+    
+    agent_log(agent, LOG_INFO, "Step %d: request %zu bytes, response %zu bytes, tokens %ld/%ld "
+              "(%ld cached), %zu tool calls, %.1f ms",
+              step->step, step->request_bytes, step->response_bytes, step->prompt_tokens,
+              step->completion_tokens, step->cached_tokens, step->tool_count,
+              (double)(step->end_ns - step->start_ns) / 1e6);
+    trace_write_step(agent->trace_run, step);
+}
+
+// Request JSON up to the start of the pre-encoded messages, the same for
+// every request of an agent: {"model":...[,"tools":...],"messages":[
+static void request_prefix_init(TechWriterAgent* agent, StringBuffer* prefix, bool with_tools) {
+    string_buffer_init(prefix, with_tools ? 2048 : 256);
+    string_buffer_append(prefix, "{\"model\":", 9);
+    json_append_string(prefix, agent->model_id, strlen(agent->model_id));
+    if (with_tools) {
+        string_buffer_append(prefix, ",\"tools\":", 9);
+        string_buffer_append(prefix, TOOL_SCHEMAS, strlen(TOOL_SCHEMAS));
+    }
+    string_buffer_append(prefix, ",\"messages\":[", 13);
+}
+
+// The chat completion request of one step, laid out as {prefix, encoded
+// messages, suffix}. Lives in the step arena until the response is handled.
+struct LlmRequest {
+    HttpBodyPart parts[3];
+    bool native;
+    bool stream;
+    bool cacheable;
+    ContentHash cache_key;
+    ReactStream react;
+    uint64_t created_ns;
+};
+
+// The history only grows between requests, so only bytes added since the
+// last call are hashed
+static void agent_hash_messages(TechWriterAgent* agent) {
+    StringBuffer* messages = &agent->encoded_messages;
+    content_hash_update(&agent->messages_hash, messages->data + agent->messages_hashed,
+                        messages->size - agent->messages_hashed);
+    agent->messages_hashed = messages->size;
+}
+
+static LlmRequest* llm_request_create(TechWriterAgent* agent, bool native) {
+    LlmRequest* request = step_alloc(sizeof(LlmRequest));
+    memset(request, 0, sizeof(LlmRequest));
+    request->native = native;
+    request->created_ns = platform_monotonic_ns();
+    request->stream = agent->stream && !native;
+    request->react.answer_stream = agent->answer_stream;
+    
+    // {"model":...,"messages":[ <encoded_messages> ],"temperature":0}
+    const StringBuffer* prefix = &agent->request_prefixes[native ? 1 : 0];
+    const char* suffix;
+    if (native) {
+        suffix = "],\"tool_choice\":\"auto\",\"temperature\":0}";
+    } else if (request->stream) {
+        suffix = "],\"temperature\":0,\"stream\":true}";
+    } else {
+        suffix = "],\"temperature\":0}";
+    }
+    
+    request->parts[0].data = prefix->data;
+    request->parts[0].size = prefix->size;
+    request->parts[1].data = agent->encoded_messages.data;
+    request->parts[1].size = agent->encoded_messages.size;
+    request->parts[2].data = suffix;
+    request->parts[2].size = strlen(suffix);
+    
+    request->cacheable = response_cache_enabled();
+    if (request->cacheable) {
+        agent_hash_messages(agent);
+        StringBuffer* messages = &agent->encoded_messages;
+        
+        // Key: endpoint, mode, prefix, history hash and length, suffix
+        uint64_t history[3] = {agent->messages_hash.a, agent->messages_hash.b, messages->size};
+        ContentHash* key = &request->cache_key;
+        content_hash_init(key);
+        content_hash_update(key, agent->client->base_url, strlen(agent->client->base_url) + 1);
+        content_hash_update(key, request->stream ? "s" : "n", 1);
+        content_hash_update(key, request->parts[0].data, request->parts[0].size);
+        content_hash_update(key, history, sizeof(history));
+        content_hash_update(key, request->parts[2].data, request->parts[2].size);
+    }
+    
+    return request;
+}
+
+// Counts a response towards the step's trace and, unless it was replayed
+// from the response cache, the run's totals
+static void agent_record_response(TechWriterAgent* agent, const LlmRequest* request,
+                                  const HttpResponse* response, bool cached) {
+    TraceStep* step = &agent->trace_step;
+    size_t request_bytes = request->parts[0].size + request->parts[1].size + request->parts[2].size;
+    if (step->llm_requests == 0) step->llm_start_ns = request->created_ns;
+    step->llm_requests++;
+    step->llm_end_ns = platform_monotonic_ns();
+    step->cached = cached;
+    step->request_bytes += request_bytes;
+    step->response_bytes += response->size;
+    
+    if (cached) {
+        agent->stats.cached_responses++;
+        return;
+    }
+    for (int phase = 0; phase < HTTP_PHASE_COUNT; phase++) {
+        step->http.ms[phase] += response->timing.ms[phase];
+    }
+    step->http.reused = response->timing.reused;
+    agent->stats.llm_requests++;
+    agent->stats.request_bytes += request_bytes;
+    agent->stats.response_bytes += response->size;
+    agent->stats.http_ms += response->timing.ms[HTTP_PHASE_TOTAL];
+    if (response->attempts > 1) agent->stats.http_retries += (size_t)(response->attempts - 1);
+    if (response->hedged) agent->stats.hedged_responses++;
+}
+
+// Tokens the API reports for a response; streamed responses carry none.
+// OpenAI and Gemini report the prompt tokens served from their prompt
+// cache as prompt_tokens_details.cached_tokens.
+static void agent_record_tokens(TechWriterAgent* agent, long prompt_tokens, long completion_tokens,
+                                long cached_tokens) {
+    TraceStep* step = &agent->trace_step;
+    step->prompt_tokens = (step->prompt_tokens > 0 ? step->prompt_tokens : 0) + prompt_tokens;
+    step->cached_tokens = (step->cached_tokens > 0 ? step->cached_tokens : 0) + cached_tokens;
+    step->completion_tokens = (step->completion_tokens > 0 ? step->completion_tokens : 0) + completion_tokens;
+    if (!step->cached) {
+        agent->stats.prompt_tokens += (size_t)prompt_tokens;
+        agent->stats.cached_tokens += (size_t)cached_tokens;
+        agent->stats.completion_tokens += (size_t)completion_tokens;
+    }
+}
+
+static void agent_record_usage(TechWriterAgent* agent, const cJSON* json) {
+    cJSON* usage = cJSON_GetObjectItem(json, "usage");
+    cJSON* prompt = cJSON_GetObjectItem(usage, "prompt_tokens");
+    cJSON* completion = cJSON_GetObjectItem(usage, "completion_tokens");
+    cJSON* cached = cJSON_GetObjectItem(cJSON_GetObjectItem(usage, "prompt_tokens_details"), "cached_tokens");
+    if (!cJSON_IsNumber(prompt) || !cJSON_IsNumber(completion)) return;
+    agent_record_tokens(agent, (long)prompt->valuedouble, (long)completion->valuedouble,
+                        cJSON_IsNumber(cached) ? (long)cached->valuedouble : 0);
+}
+
+// The number at path in a JSON span, or -1
+static long json_find_count(const char* json, size_t length, const char* path) {
+    const char* value = cJSON_FindPath(json, length, path, NULL);
+    if (!value || !(isdigit((unsigned char)*value) || *value == '-')) return -1;
+    return (long)strtod(value, NULL);
+}
+
+// agent_record_usage for a response body that was not parsed into a tree
+static void agent_record_usage_raw(TechWriterAgent* agent, const char* body, size_t size) {
+    size_t length = 0;
+    const char* usage = cJSON_FindPath(body, size, "usage", &length);
+    if (!usage) return;
+    long prompt = json_find_count(usage, length, "prompt_tokens");
+    long completion = json_find_count(usage, length, "completion_tokens");
+    long cached = json_find_count(usage, length, "prompt_tokens_details.cached_tokens");
+    if (prompt < 0 || completion < 0) return;
+    agent_record_tokens(agent, prompt, completion, cached > 0 ? cached : 0);
+}
+
+// With the response cache enabled, a request whose exact bytes were
+// answered before is replayed from disk instead of being sent
+static HttpResponse* llm_request_cached(TechWriterAgent* agent, LlmRequest* request) {
+    if (!request->cacheable) return NULL;
+    
+    size_t length = 0;
+    char* cached = response_cache_get(&request->cache_key, &length);
+    if (!cached) return NULL;
+    
+    log_message(LOG_INFO, "Replaying LLM response from cache");
+    HttpResponse* response = safe_calloc(1, sizeof(HttpResponse));
+    response->data = cached;
+    response->size = length;
+    response->capacity = length + 1;
+    response->status_code = 200;
+    if (request->stream) {
+        react_stream_callback(response->data, response->size, 0, &request->react);
+    }
+    agent_record_response(agent, request, response, true);
+    return response;
+}
+
+static HttpTransfer* llm_request_transfer(TechWriterAgent* agent, LlmRequest* request) {
+    return http_transfer_create(agent->client, "chat/completions", request->parts, 3, request->stream,
+                                request->stream ? react_stream_callback : NULL, &request->react);
+}
+
+// Bookkeeping once a sent request has its response (NULL on failure)
+static void llm_request_complete(TechWriterAgent* agent, LlmRequest* request, const HttpResponse* response) {
+    if (response) {
+        log_llm_timing(agent, response);
+        agent_record_response(agent, request, response, false);
+        if (request->cacheable && response->status_code == 200 && response->size > 0) {
+            response_cache_put(&request->cache_key, response->data, response->size);
+        }
+    }
+}
+
+static HttpResponse* llm_request_send(TechWriterAgent* agent, LlmRequest* request) {
+    HttpResponse* response = llm_request_cached(agent, request);
+    if (!response) {
+        response = http_transfer_perform(llm_request_transfer(agent, request));
+        llm_request_complete(agent, request, response);
+    }
+    return response;
+}
+
+static void llm_request_destroy(LlmRequest* request) {
+    if (!request) return;
+    step_free(request);
+}
+
+// Content of a ReAct completion, taking ownership of the response; allocated
+// in arena if given (e.g. to become a message), else on the heap
+static char* react_response_text(TechWriterAgent* agent, LlmRequest* request, HttpResponse* response,
+                                 Arena* arena) {
     if (!response) {
         return NULL;
     }
     
-    // Parse response
-    cJSON* json = cJSON_Parse(response->data);
-    if (!json) {
+    if (request->stream) {
+        if (response->status_code != 200 || response->size == 0) {
+            log_message(LOG_ERROR, "No content in streamed LLM response");
+            http_response_destroy(response);
+            return NULL;
+        }
+        
+        // The response buffer already holds the assembled content
+        char* result = response->data;
+        if (arena) {
+            result = arena_strndup(arena, response->data, response->size);
+        } else {
+            response->data = NULL;
+        }
+        http_response_destroy(response);
+        return result;
+    }
+    
+    // Only choices[0].message.content and the usage are needed, so they are
+    // read in place rather than through a tree of the whole response, and
+    // the content is unescaped straight into its destination
+    const char* body = response->data;
+    size_t size = response->size;
+    const char* start = body;
+    while (start < body + size && isspace((unsigned char)*start)) start++;
+    if (start == body + size || *start != '{') {
         log_message(LOG_ERROR, "Failed to parse LLM response");
         http_response_destroy(response);
         return NULL;
     }
+    agent_record_usage_raw(agent, body, size);
     
-    cJSON* choices = cJSON_GetObjectItem(json, "choices");
-    if (!choices || !cJSON_IsArray(choices) || cJSON_GetArraySize(choices) == 0) {
+    size_t length = 0;
+    const char* content = cJSON_FindPath(body, size, "choices.0.message.content", &length);
+    if (!content && !cJSON_FindPath(body, size, "choices.0", NULL)) {
         log_message(LOG_ERROR, "No choices in LLM response");
-        cJSON_Delete(json);
         http_response_destroy(response);
         return NULL;
     }
     
-    cJSON* choice = cJSON_GetArrayItem(choices, 0);
-    cJSON* message = cJSON_GetObjectItem(choice, "message");
-    cJSON* content = cJSON_GetObjectItem(message, "content");
-    
     char* result = NULL;
-    if (content && cJSON_IsString(content)) {
-        result = safe_strdup(content->valuestring);
+    if (content && *content == '"') {
+        result = arena ? arena_alloc(arena, length) : safe_malloc(length);
+        if (!cJSON_UnescapeTo(result, content, length)) {
+            log_message(LOG_ERROR, "Failed to parse LLM response");
+            if (!arena) free(result);
+            result = NULL;
+        }
     }
     
-    cJSON_Delete(json);
     http_response_destroy(response);
-    
     return result;
 }
 
+char* agent_call_llm(TechWriterAgent* agent) {
+    LlmRequest* request = llm_request_create(agent, false);
+    char* result = react_response_text(agent, request, llm_request_send(agent, request), NULL);
+    llm_request_destroy(request);
+    return result;
+}
+
+// Earliest start of the section that follows an Action Input
+static const char* find_input_end(const char* input, const char* limit) {
+    const char* markers[] = {"\nThought:", "\nAction:", "\nObservation:", "\nFinal Answer:"};
+    const char* end = limit;
+    for (size_t i = 0; i < sizeof(markers) / sizeof(markers[0]); i++) {
+        const char* pos = strstr(input, markers[i]);
+        if (pos && pos < end) end = pos;
+    }
+    return end;
+}
+
 ParsedResponse* agent_parse_response(const char* response) {
-    ParsedResponse* parsed = safe_calloc(1, sizeof(ParsedResponse));
+    ParsedResponse* parsed = step_alloc(sizeof(ParsedResponse));
+    memset(parsed, 0, sizeof(ParsedResponse));
+    
+    const char* response_end = response + strlen(response);
     
     // Check for Final Answer
     const char* final_answer_marker = "Final Answer:";
-    char* final_pos = strstr(response, final_answer_marker);
+    const char* final_pos = strstr(response, final_answer_marker);
     if (final_pos) {
         parsed->type = RESPONSE_FINAL;
         final_pos += strlen(final_answer_marker);
-        while (*final_pos && isspace(*final_pos)) final_pos++;
-        parsed->final_answer = safe_strdup(final_pos);
+        while (*final_pos && isspace((unsigned char)*final_pos)) final_pos++;
+        size_t final_len = response_end - final_pos;
+        parsed->final_answer = step_alloc(final_len + 1);
+        memcpy(parsed->final_answer, final_pos, final_len + 1);
         return parsed;
     }
     
-    // Look for Action and Action Input
+    // Collect every Action / Action Input pair. A (hallucinated) Observation
+    // ends the batch: anything after it depends on output the model has not seen.
     const char* action_marker = "Action:";
     const char* input_marker = "Action Input:";
     
-    char* action_pos = strstr(response, action_marker);
-    char* input_pos = strstr(response, input_marker);
+    const char* limit = strstr(response, "\nObservation:");
+    if (!limit) limit = response_end;
     
-    if (action_pos && input_pos && input_pos > action_pos) {
-        parsed->type = RESPONSE_ACTION;
+    const char* scan = response;
+    while (true) {
+        const char* action_pos = strstr(scan, action_marker);
+        if (!action_pos || action_pos >= limit) break;
+        const char* input_pos = strstr(action_pos, input_marker);
+        if (!input_pos || input_pos >= limit) break;
         
-        // Extract action
+        if (parsed->action_count == MAX_PARALLEL_ACTIONS) {
+            log_message(LOG_WARNING, "Ignoring actions beyond the first %d", MAX_PARALLEL_ACTIONS);
+            break;
+        }
+        ParsedAction* action = &parsed->actions[parsed->action_count++];
+        
+        // Extract action (the name ends at the line end)
         action_pos += strlen(action_marker);
-        while (*action_pos && isspace(*action_pos)) action_pos++;
+        const char* action_end = strchr(action_pos, '\n');
+        if (!action_end || action_end > input_pos) action_end = input_pos;
+        action->name = step_strndup_trimmed(action_pos, action_end);
         
-        char* action_end = strstr(action_pos, "\n");
-        if (action_end) {
-            size_t action_len = action_end - action_pos;
-            parsed->action = safe_malloc(action_len + 1);
-            strncpy(parsed->action, action_pos, action_len);
-            parsed->action[action_len] = '\0';
-            parsed->action = string_trim(parsed->action);
+        // Extract action input up to the next section
+        input_pos += strlen(input_marker);
+        const char* input_end = find_input_end(input_pos, limit);
+        action->input = step_strndup_trimmed(input_pos, input_end);
+        
+        scan = input_end;
+    }
+    
+    parsed->type = parsed->action_count > 0 ? RESPONSE_ACTION : RESPONSE_UNKNOWN;
+    return parsed;
+}
+
+void parsed_response_destroy(ParsedResponse* parsed) {
+    if (!parsed) return;
+    for (size_t i = 0; i < parsed->action_count; i++) {
+        step_free(parsed->actions[i].name);
+        step_free(parsed->actions[i].input);
+    }
+    step_free(parsed->final_answer);
+    step_free(parsed);
+}
+
+// Switch a function-calling agent to the ReAct text protocol
+static void agent_use_react(TechWriterAgent* agent) {
+    agent->function_calling = false;
+    
+    Message* system = agent->memory_count > 0 ? &agent->memory[0] : NULL;
+    if (system && system->role == ROLE_SYSTEM) {
+        message_set_content(agent, system, REACT_SYSTEM_PROMPT);
+        agent_reencode_messages(agent);
+    }
+}
+
+// Whether an error response says the endpoint does not take the tools
+// field. Only the first request can tell: later ones carry tool messages a
+// ReAct conversation could not replay.
+static bool native_tools_rejected(const TechWriterAgent* agent, const HttpResponse* response) {
+    if (agent->step != 0 || (response->status_code != 400 && response->status_code != 422)) {
+        return false;
+    }
+    
+    cJSON* json = cJSON_Parse(response->data);
+    cJSON* error = cJSON_GetObjectItem(json, "error");
+    bool rejected = false;
+    const char* fields[] = {"param", "code"};
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]) && !rejected; i++) {
+        cJSON* field = cJSON_GetObjectItem(error, fields[i]);
+        rejected = cJSON_IsString(field) &&
+            (string_starts_with(field->valuestring, "tools") || strstr(field->valuestring, "tool_choice"));
+    }
+    cJSON_Delete(json);
+    return rejected;
+}
+
+// Function-calling completion: records the reply in memory and returns the
+// parsed step, taking ownership of the response
+static ParsedResponse* native_response_parse(TechWriterAgent* agent, HttpResponse* response) {
+    if (!response) {
+        return NULL;
+    }
+    
+    // Endpoints without function calling reject the tools field
+    if (native_tools_rejected(agent, response)) {
+        log_message(LOG_WARNING, "API rejected function calling, falling back to ReAct");
+        agent_use_react(agent);
+        http_response_destroy(response);
+        return NULL;
+    }
+    if (response->status_code != 200) {
+        log_message(LOG_ERROR, "LLM request failed with HTTP %ld", response->status_code);
+        http_response_destroy(response);
+        return NULL;
+    }
+    
+    cJSON* json = cJSON_Parse(response->data);
+    http_response_destroy(response);
+    if (!json) {
+        log_message(LOG_ERROR, "Failed to parse LLM response");
+        return NULL;
+    }
+    agent_record_usage(agent, json);
+    
+    cJSON* choice = cJSON_GetArrayItem(cJSON_GetObjectItem(json, "choices"), 0);
+    cJSON* message = cJSON_GetObjectItem(choice, "message");
+    cJSON* content = cJSON_GetObjectItem(message, "content");
+    cJSON* tool_calls = cJSON_GetObjectItem(message, "tool_calls");
+    
+    const char* text = (content && cJSON_IsString(content)) ? content->valuestring : NULL;
+    int call_count = cJSON_IsArray(tool_calls) ? cJSON_GetArraySize(tool_calls) : 0;
+    ParsedResponse* parsed = NULL;
+    
+    if (call_count > 0) {
+        parsed = step_alloc(sizeof(ParsedResponse));
+        memset(parsed, 0, sizeof(ParsedResponse));
+        parsed->type = RESPONSE_ACTION;
+        
+        // Every recorded call needs a tool reply, so drop the ones that will not run
+        if (call_count > MAX_PARALLEL_ACTIONS) {
+            log_message(LOG_WARNING, "Ignoring tool calls beyond the first %d", MAX_PARALLEL_ACTIONS);
+            while (call_count > MAX_PARALLEL_ACTIONS) {
+                cJSON_DeleteItemFromArray(tool_calls, --call_count);
+            }
         }
         
-        // Extract action input
-        input_pos += strlen(input_marker);
-        while (*input_pos && isspace(*input_pos)) input_pos++;
+        cJSON* call = NULL;
+        cJSON_ArrayForEach(call, tool_calls) {
+            cJSON* id = cJSON_GetObjectItem(call, "id");
+            cJSON* function = cJSON_GetObjectItem(call, "function");
+            cJSON* name = cJSON_GetObjectItem(function, "name");
+            cJSON* arguments = cJSON_GetObjectItem(function, "arguments");
+            
+            ParsedAction* action = &parsed->actions[parsed->action_count++];
+            action->id = step_strdup(cJSON_IsString(id) ? id->valuestring : "");
+            action->name = step_strdup(cJSON_IsString(name) ? name->valuestring : "");
+            action->input = step_strdup(cJSON_IsString(arguments) ? arguments->valuestring : "{}");
+        }
         
-        // Find the end of the JSON input (look for next section or end)
-        char* input_end = strstr(input_pos, "\nThought:");
-        if (!input_end) input_end = strstr(input_pos, "\nAction:");
-        if (!input_end) input_end = strstr(input_pos, "\nObservation:");
-        if (!input_end) input_end = strstr(input_pos, "\nFinal Answer:");
-        if (!input_end) input_end = (char*)response + strlen(response);
+        char* calls_json = cJSON_PrintUnformatted(tool_calls);
+        agent_push_message(agent, ROLE_ASSISTANT, text, calls_json, NULL);
+        cJSON_free(calls_json);
+    } else if (text) {
+        agent_add_message(agent, ROLE_ASSISTANT, text);
         
-        size_t input_len = input_end - input_pos;
-        parsed->action_input = safe_malloc(input_len + 1);
-        strncpy(parsed->action_input, input_pos, input_len);
-        parsed->action_input[input_len] = '\0';
-        parsed->action_input = string_trim(parsed->action_input);
+        // A model that ignores the tools may still answer in ReAct format;
+        // anything else without a tool call is the final answer
+        const char* start = text;
+        while (isspace((unsigned char)*start)) start++;
+        if (string_starts_with(start, "Thought:") || string_starts_with(start, "Action:")) {
+            parsed = agent_parse_response(text);
+        }
+        if (!parsed || parsed->type == RESPONSE_UNKNOWN) {
+            parsed_response_destroy(parsed);
+            parsed = step_alloc(sizeof(ParsedResponse));
+            memset(parsed, 0, sizeof(ParsedResponse));
+            parsed->type = RESPONSE_FINAL;
+            parsed->final_answer = step_strdup(start);
+        }
     } else {
-        parsed->type = RESPONSE_UNKNOWN;
+        log_message(LOG_ERROR, "No content or tool calls in LLM response");
     }
     
+    cJSON_Delete(json);
     return parsed;
 }
 
-void parsed_response_destroy(ParsedResponse* parsed) {
-    if (!parsed) return;
-    free(parsed->action);
-    free(parsed->action_input);
-    free(parsed->final_answer);
-    free(parsed);
+ParsedResponse* agent_call_llm_native(TechWriterAgent* agent) {
+    LlmRequest* request = llm_request_create(agent, true);
+    ParsedResponse* parsed = native_response_parse(agent, llm_request_send(agent, request));
+    llm_request_destroy(request);
+    return parsed;
 }
 
 char* agent_execute_tool(TechWriterAgent* agent, const char* tool_name, const char* action_input) {
@@ -271,6 +1197,9 @@ char* agent_execute_tool(TechWriterAgent* agent, const char* tool_name, const ch
     
     char* result = NULL;
     
+    // Tool results outlive the step: build them on the heap
+    Arena* step_arena = arena_set_current(NULL);
+    
     if (strcmp(tool_name, "find_all_matching_files") == 0) {
         cJSON* directory = cJSON_GetObjectItem(input, "directory");
         cJSON* pattern = cJSON_GetObjectItem(input, "pattern");
@@ -278,84 +1207,561 @@ char* agent_execute_tool(TechWriterAgent* agent, const char* tool_name, const ch
         const char* dir_str = (directory && cJSON_IsString(directory)) ? directory->valuestring : "";
         const char* pat_str = (pattern && cJSON_IsString(pattern)) ? pattern->valuestring : "*";
         
-        result = find_all_matching_files(dir_str, pat_str);
+        result = find_all_matching_files_indexed(agent->index, dir_str, pat_str);
     } else if (strcmp(tool_name, "read_file") == 0) {
         cJSON* file_path = cJSON_GetObjectItem(input, "file_path");
         
         if (file_path && cJSON_IsString(file_path)) {
-            result = read_file(file_path->valuestring);
+            ReadFileRange range = {0};
+            bool has_range = false;
+            const char* keys[] = {"offset", "length", "start_line", "end_line"};
+            size_t* fields[] = {&range.offset, &range.length, &range.start_line, &range.end_line};
+            for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+                cJSON* value = cJSON_GetObjectItem(input, keys[i]);
+                if (value && cJSON_IsNumber(value) && value->valuedouble >= 0) {
+                    *fields[i] = (size_t)value->valuedouble;
+                    has_range = true;
+                }
+            }
+            if (!has_range && agent->prefetch) {
+                result = read_prefetch_take(agent->prefetch, file_path->valuestring);
+            }
+            if (!result) {
+                result = read_file_range(file_path->valuestring, has_range ? &range : NULL);
+            }
         } else {
             result = safe_strdup("{\"error\": \"file_path parameter required\"}");
         }
+    } else if (strcmp(tool_name, "search_code") == 0) {
+        SearchQuery query = {0};
+        cJSON* pattern = cJSON_GetObjectItem(input, "pattern");
+        cJSON* regex = cJSON_GetObjectItem(input, "regex");
+        cJSON* ignore_case = cJSON_GetObjectItem(input, "ignore_case");
+        cJSON* directory = cJSON_GetObjectItem(input, "directory");
+        cJSON* file_pattern = cJSON_GetObjectItem(input, "file_pattern");
+        cJSON* max_results = cJSON_GetObjectItem(input, "max_results");
+        
+        query.pattern = (pattern && cJSON_IsString(pattern)) ? pattern->valuestring : NULL;
+        query.regex = regex && cJSON_IsTrue(regex);
+        query.ignore_case = ignore_case && cJSON_IsTrue(ignore_case);
+        query.directory = (directory && cJSON_IsString(directory)) ? directory->valuestring : NULL;
+        query.file_pattern = (file_pattern && cJSON_IsString(file_pattern)) ? file_pattern->valuestring : NULL;
+        if (max_results && cJSON_IsNumber(max_results) && max_results->valuedouble >= 1) {
+            query.max_results = (size_t)max_results->valuedouble;
+        }
+        result = search_code(agent->index, &query);
     } else {
         char error[256];
         snprintf(error, sizeof(error), "{\"error\": \"Unknown tool: %s\"}", tool_name);
         result = safe_strdup(error);
     }
     
+    arena_set_current(step_arena);
     cJSON_Delete(input);
     
-    if (agent->log_file) {
-        fprintf(agent->log_file, "Tool result: %zu chars\n", strlen(result));
-    }
+    agent_log(agent, LOG_DEBUG, "Tool result: %zu chars", strlen(result));
     
     return result;
 }
 
-char* agent_run(TechWriterAgent* agent, const char* prompt, const char* directory) {
+// Tool calls of one step, claimed one at a time by the batch workers
+typedef struct {
+    TechWriterAgent* agent;
+    const ParsedAction* actions;
+    char** results;
+    StringBuffer* escaped;      // optional: each result JSON-escaped by its worker
+    size_t count;
+    size_t next;
+    PlatformMutex lock;
+} ToolBatch;
+
+static void* tool_batch_worker(void* arg) {
+    ToolBatch* batch = (ToolBatch*)arg;
+    
+    while (true) {
+        platform_mutex_lock(&batch->lock);
+        size_t index = batch->next++;
+        platform_mutex_unlock(&batch->lock);
+        if (index >= batch->count) break;
+        
+        const ParsedAction* action = &batch->actions[index];
+        uint64_t started = platform_monotonic_ns();
+        char* result = agent_execute_tool(batch->agent, action->name, action->input);
+        batch->results[index] = result;
+        if (batch->escaped) {
+            // Spliced into the encoded history as is
+            size_t length = strlen(result);
+            StringBuffer* escaped = &batch->escaped[index];
+            string_buffer_init(escaped, cJSON_EscapedLength(result, length) + 1);
+            escaped->size = cJSON_EscapeTo(escaped->data, result, length) - escaped->data;
+            escaped->data[escaped->size] = '\0';
+        }
+        if (index < MAX_PARALLEL_ACTIONS) {
+            TraceTool* trace = &batch->agent->trace_tools[index];
+            trace->name = action->name;
+            trace->start_ns = started;
+            trace->end_ns = platform_monotonic_ns();
+            trace->result_bytes = strlen(result);
+        }
+    }
+    
+    return NULL;
+}
+
+// Builds the repository index before the first listing of a run, so every
+// later find_all_matching_files is a lookup, and its trigrams before the
+// first search. Done before the step's tools run in parallel.
+static void agent_prepare_index(TechWriterAgent* agent, const ParsedAction* actions, size_t count) {
+    if (!agent->base_directory) return;
+    
+    bool listing = false;
+    bool search = false;
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(actions[i].name, "find_all_matching_files") == 0) listing = true;
+        if (strcmp(actions[i].name, "search_code") == 0) search = true;
+    }
+    bool build_index = (listing || search) && !agent->index;
+    bool build_trigrams = search && !(agent->index && agent->index->trigrams);
+    if (!build_index && !build_trigrams) return;
+    
+    Arena* step_arena = arena_set_current(NULL);
+    if (build_index) agent->index = repo_index_build(agent->base_directory);
+    if (build_trigrams && agent->index) repo_index_build_trigrams(agent->index);
+    arena_set_current(step_arena);
+}
+
+// Keeps the paths the model reads for the run's manifest; runs on the
+// calling thread before the tools start
+static void agent_note_files_read(TechWriterAgent* agent, const ParsedAction* actions, size_t count) {
+    if (!agent->base_directory) return;
+    size_t base_length = strlen(agent->base_directory);
+    
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(actions[i].name, "read_file") != 0) continue;
+        cJSON* input = cJSON_Parse(actions[i].input);
+        cJSON* file_path = cJSON_GetObjectItem(input, "file_path");
+        if (cJSON_IsString(file_path)) {
+            const char* path = file_path->valuestring;
+            if (strncmp(path, agent->base_directory, base_length) == 0 && path[base_length] == PATH_SEPARATOR_CHAR) {
+                path += base_length + 1;
+            }
+            
+            // One line per path
+            size_t length = strlen(path);
+            const char* lines = agent->files_read.data;
+            bool known = false;
+            for (const char* line = lines; line && *line && !known; line = strchr(line, '\n') + 1) {
+                known = strncmp(line, path, length) == 0 && line[length] == '\n';
+            }
+            if (!known && length > 0 && !strchr(path, '\n')) {
+                string_buffer_append(&agent->files_read, path, length);
+                string_buffer_append(&agent->files_read, "\n", 1);
+            }
+        }
+        cJSON_Delete(input);
+    }
+}
+
+static void agent_trace_tools(TechWriterAgent* agent, size_t count) {
+    TraceStep* step = &agent->trace_step;
+    step->tool_count = count < MAX_PARALLEL_ACTIONS ? count : MAX_PARALLEL_ACTIONS;
+    agent->stats.tool_calls += count;
+    for (size_t i = 0; i < step->tool_count; i++) {
+        const TraceTool* tool = &agent->trace_tools[i];
+        agent->stats.tool_ms += (double)(tool->end_ns - tool->start_ns) / 1e6;
+    }
+}
+
+// Work on the next request that does not depend on the step's results,
+// done by the calling thread while the tools run
+static void agent_prepare_request(TechWriterAgent* agent) {
+    if (response_cache_enabled()) agent_hash_messages(agent);
+}
+
+static void agent_run_tools(TechWriterAgent* agent, const ParsedAction* actions, size_t count,
+                            char** results, StringBuffer* escaped) {
+    agent_prepare_index(agent, actions, count);
+    agent_note_files_read(agent, actions, count);
+    
+    ToolBatch batch = {0};
+    batch.agent = agent;
+    batch.actions = actions;
+    batch.results = results;
+    batch.escaped = escaped;
+    batch.count = count;
+    platform_mutex_init(&batch.lock);
+    
+    // A lone action with nothing to ready meanwhile runs inline rather than
+    // paying for a thread
+    if (!agent->parallel_tools || (count == 1 && !response_cache_enabled())) {
+        tool_batch_worker(&batch);
+        platform_mutex_destroy(&batch.lock);
+        agent_trace_tools(agent, count);
+        return;
+    }
+    
+    // Tools mostly wait on the filesystem, so run one worker per action.
+    // The calling thread readies the next request meanwhile, then runs any
+    // action a worker could not be started for.
+    if (count > 1) log_message(LOG_INFO, "Running %zu tool calls in parallel", count);
+    
+    PlatformThread threads[MAX_PARALLEL_ACTIONS];
+    bool started[MAX_PARALLEL_ACTIONS] = {false};
+    for (size_t i = 0; i < count && i < MAX_PARALLEL_ACTIONS; i++) {
+        started[i] = platform_thread_create(&threads[i], tool_batch_worker, &batch) == 0;
+    }
+    agent_prepare_request(agent);
+    tool_batch_worker(&batch);
+    for (size_t i = 0; i < count && i < MAX_PARALLEL_ACTIONS; i++) {
+        if (started[i]) platform_thread_join(threads[i]);
+    }
+    
+    platform_mutex_destroy(&batch.lock);
+    agent_trace_tools(agent, count);
+}
+
+void agent_execute_tools(TechWriterAgent* agent, const ParsedAction* actions, size_t count, char** results) {
+    agent_run_tools(agent, actions, count, results, NULL);
+}
+
+// Starts the conversation from a map-reduce summary of the repository, so
+// the model reads files only to check what the summary leaves open
+static void agent_add_repository_summary(TechWriterAgent* agent, const char* prompt, const char* directory) {
+    MapReduceOptions options = {0};
+    options.chunk_tokens = (agent->token_budget > 0 ? agent->token_budget : DEFAULT_TOKEN_BUDGET) / 4;
+    options.max_active = agent->map_reduce_jobs;
+    char* summary = map_reduce_summarize(agent, prompt, directory, &options);
+    if (!summary) {
+        log_message(LOG_WARNING, "No repository summary; exploring the repository step by step");
+        return;
+    }
+    
+    const char* intro = "Summary of the files of the repository, written from all of them in a map-reduce pass:\n\n";
+    const char* outro = "\n\nUse the tools only to check details the summary leaves open, then write the documentation.";
+    size_t size = strlen(intro) + strlen(summary) + strlen(outro) + 1;
+    char* content = agent_message_buffer(agent, size);
+    snprintf(content, size, "%s%s%s", intro, summary, outro);
+    agent_add_message_owned(agent, ROLE_USER, content);
+    free(summary);
+}
+
+static bool string_list_contains(char* const* list, size_t count, const char* item) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(list[i], item) == 0) return true;
+    }
+    return false;
+}
+
+static void append_text(StringBuffer* buffer, const char* text) {
+    string_buffer_append(buffer, text, strlen(text));
+}
+
+// --incremental: starts the conversation from the previous document and
+// the files changed since its commit, so the model revises it instead of
+// exploring the repository again. Changed files are included up to
+// token_budget bytes, a quarter of it in tokens; the rest are only listed.
+static void agent_add_previous_analysis(TechWriterAgent* agent, const char* directory) {
+    const AnalysisManifest* previous = agent->previous;
+    size_t budget = agent->token_budget > 0 ? agent->token_budget : DEFAULT_TOKEN_BUDGET;
+    size_t included = 0;
+    
+    StringBuffer content;
+    string_buffer_init(&content, strlen(previous->document) + strlen(agent->changes) + 4096);
+    char text[2200];
+    snprintf(text, sizeof(text),
+             "This repository was documented before, at commit %.12s, for the same task. "
+             "These files have changed since (A added, M modified, D deleted):\n", previous->commit);
+    append_text(&content, text);
+    append_text(&content, agent->changes);
+    append_text(&content, "\nNew contents of the changed files:\n");
+    
+    for (const char* line = agent->changes; *line; ) {
+        const char* end = strchr(line, '\n');
+        if (!end) end = line + strlen(line);
+        const char* tab = memchr(line, '\t', (size_t)(end - line));
+        
+        if (tab && *line != 'D') {
+            char relative[1024];
+            snprintf(relative, sizeof(relative), "%.*s", (int)(end - tab - 1), tab + 1);
+            char path[2048];
+            snprintf(path, sizeof(path), "%s%c%s", directory, PATH_SEPARATOR_CHAR, relative);
+            bool was_read = string_list_contains(previous->files_read, previous->files_read_count, relative);
+            
+            char* observation = included < budget ? read_file_observation(path, NULL) : NULL;
+            if (observation) {
+                included += strlen(observation);
+                snprintf(text, sizeof(text), "\n%s%s:\n", path, was_read ? " (read for the previous document)" : "");
+                append_text(&content, text);
+                append_text(&content, observation);
+                append_text(&content, "\n");
+                free(observation);
+            } else {
+                snprintf(text, sizeof(text), "\n%s: not included, read it if it matters\n", path);
+                append_text(&content, text);
+            }
+        }
+        line = *end ? end + 1 : end;
+    }
+    
+    append_text(&content, "\nRevise the previous document for these changes: keep what still holds, update what "
+                "they affect, and read other files only where the changes call for it. The Final Answer is the "
+                "whole updated document.\n\nPrevious document:\n\n");
+    append_text(&content, previous->document);
+    
+    agent_add_message(agent, ROLE_USER, content.data);
+    string_buffer_free(&content);
+    log_message(LOG_INFO, "Updating the analysis of commit %.12s", previous->commit);
+}
+
+void agent_start(TechWriterAgent* agent, const char* prompt, const char* directory) {
     log_message(LOG_INFO, "Starting ReAct agent with model: %s", agent->model_id);
     
     // Initialize conversation
-    agent_add_message(agent, "system", REACT_SYSTEM_PROMPT);
+    agent_add_message(agent, ROLE_SYSTEM,
+                      agent->function_calling ? FUNCTION_CALLING_SYSTEM_PROMPT : REACT_SYSTEM_PROMPT);
     
+    // With a stable prefix the task comes before the directory, so runs of
+    // one prompt over several repositories share the prompt-cached prefix
     char user_prompt[2048];
-    snprintf(user_prompt, sizeof(user_prompt), 
-             "Base directory for analysis: %s\n\n%s", directory, prompt);
-    agent_add_message(agent, "user", user_prompt);
-    
-    char* final_answer = NULL;
+    if (agent->stable_prefix) {
+        snprintf(user_prompt, sizeof(user_prompt),
+                 "%s\n\nBase directory for analysis: %s", prompt, directory);
+    } else {
+        snprintf(user_prompt, sizeof(user_prompt), 
+                 "Base directory for analysis: %s\n\n%s", directory, prompt);
+    }
+    agent_add_message(agent, ROLE_USER, user_prompt);
+    
+    free(agent->base_directory);
+    repo_index_destroy(agent->index);
+    agent->base_directory = safe_strdup(directory);
+    agent->index = NULL;
+    agent->state = AGENT_READY;
+    
+    memset(&agent->stats, 0, sizeof(AgentStats));
+    agent->started_ns = platform_monotonic_ns();
+    if (trace_enabled()) {
+        char label[1024];
+        snprintf(label, sizeof(label), "%s %s", agent->model_id, directory);
+        agent->trace_run = trace_begin_run(label);
+    }
     
-    // ReAct loop
-    for (int step = 0; step < MAX_STEPS; step++) {
-        log_message(LOG_INFO, "Step %d/%d", step + 1, MAX_STEPS);
-        
-        // Get LLM response
-        char* response = agent_call_llm(agent);
-        if (!response) {
-            log_message(LOG_ERROR, "Failed to get LLM response");
-            break;
+    string_buffer_clear(&agent->files_read);
+    if (agent->previous && agent->changes && agent->changes[0] == '\0') {
+        // Nothing to update: the previous document stands as it is
+        log_message(LOG_INFO, "Nothing changed since commit %.12s; reusing its document", agent->previous->commit);
+        agent->final_answer = safe_strdup(agent->previous->document);
+        agent->state = AGENT_DONE;
+    } else if (agent->previous && agent->changes) {
+        agent_add_previous_analysis(agent, directory);
+    } else if (agent->map_reduce_jobs > 0) {
+        agent_add_repository_summary(agent, prompt, directory);
+    }
+}
+
+// Everything a step allocates in between is released at once
+static void agent_end_step(TechWriterAgent* agent) {
+    agent_trace_step_end(agent);
+    parsed_response_destroy(agent->pending);
+    agent->pending = NULL;
+    arena_reset(agent->step_arena);
+    agent->step++;
+    agent->step_started = false;
+    agent->state = agent->step < MAX_STEPS ? AGENT_READY : AGENT_DONE;
+}
+
+static void agent_fail_step(TechWriterAgent* agent) {
+    log_message(LOG_ERROR, "Failed to get LLM response");
+    agent_trace_step_end(agent);
+    agent->state = AGENT_DONE;
+}
+
+// Turn the LLM's reply into the next state; the reply is recorded in memory
+static void agent_handle_response(TechWriterAgent* agent, LlmRequest* request, HttpResponse* response) {
+    ParsedResponse* parsed = NULL;
+    
+    if (request->native) {
+        parsed = native_response_parse(agent, response);
+        if (!parsed) {
+            // Retried in ReAct format after a fallback
+            if (agent->function_calling) {
+                agent_fail_step(agent);
+            } else {
+                agent->state = AGENT_READY;
+            }
+            return;
+        }
+    } else {
+        char* text = react_response_text(agent, request, response, agent->message_arena);
+        if (!text) {
+            agent_fail_step(agent);
+            return;
         }
         
-        log_message(LOG_DEBUG, "LLM Response: %s", response);
-        
-        // Add assistant response to memory
-        agent_add_message(agent, "assistant", response);
+        log_message(LOG_DEBUG, "LLM Response: %s", text);
         
         // Parse response
-        ParsedResponse* parsed = agent_parse_response(response);
+        parsed = agent_parse_response(text);
         
-        if (parsed->type == RESPONSE_FINAL) {
-            final_answer = safe_strdup(parsed->final_answer);
-            log_message(LOG_INFO, "Final answer received");
-            parsed_response_destroy(parsed);
-            free(response);
-            break;
-        } else if (parsed->type == RESPONSE_ACTION) {
-            // Execute tool
-            char* observation = agent_execute_tool(agent, parsed->action, parsed->action_input);
-            
-            // Add observation to memory
-            char obs_message[strlen(observation) + 20];
-            snprintf(obs_message, sizeof(obs_message), "Observation: %s", observation);
-            agent_add_message(agent, "user", obs_message);
-            
-            free(observation);
+        // Add assistant response to memory, without any Observation the
+        // model hallucinated after its actions
+        char* hallucinated = strstr(text, "\nObservation:");
+        if (parsed->type == RESPONSE_ACTION && hallucinated) {
+            *hallucinated = '\0';
         }
-        
+        agent_add_message_owned(agent, ROLE_ASSISTANT, text);
+    }
+    
+    agent->pending = parsed;
+    if (parsed->type == RESPONSE_FINAL) {
+        agent->final_answer = safe_strdup(parsed->final_answer);
+        log_message(LOG_INFO, "Final answer received");
+        agent_trace_step_end(agent);
         parsed_response_destroy(parsed);
-        free(response);
+        agent->pending = NULL;
+        agent->state = AGENT_DONE;
+    } else if (parsed->type == RESPONSE_ACTION) {
+        agent->state = AGENT_RUNNING_TOOLS;
+    } else {
+        agent_end_step(agent);
+    }
+}
+
+HttpTransfer* agent_step_begin(TechWriterAgent* agent) {
+    Arena* previous_arena = arena_set_current(agent->step_arena);
+    
+    if (!agent->step_started) {
+        log_message(LOG_INFO, "Step %d/%d", agent->step + 1, MAX_STEPS);
+        agent_enforce_budget(agent);
+        agent_trace_step_start(agent);
+        agent->step_started = true;
     }
     
+    // Get the next step from the LLM
+    LlmRequest* request = llm_request_create(agent, agent->function_calling);
+    HttpTransfer* transfer = NULL;
+    HttpResponse* cached = llm_request_cached(agent, request);
+    
+    if (cached) {
+        agent_handle_response(agent, request, cached);
+        llm_request_destroy(request);
+    } else {
+        transfer = llm_request_transfer(agent, request);
+        if (transfer) {
+            agent->request = request;
+            agent->state = AGENT_AWAITING_LLM;
+        } else {
+            llm_request_destroy(request);
+            agent_fail_step(agent);
+        }
+    }
+    
+    arena_set_current(previous_arena);
+    return transfer;
+}
+
+void agent_step_response(TechWriterAgent* agent, HttpResponse* response) {
+    Arena* previous_arena = arena_set_current(agent->step_arena);
+    
+    LlmRequest* request = agent->request;
+    agent->request = NULL;
+    llm_request_complete(agent, request, response);
+    agent_handle_response(agent, request, response);
+    llm_request_destroy(request);
+    
+    arena_set_current(previous_arena);
+}
+
+// Queues the likely next reads of every listing of the step, ranking the
+// files the model's turn mentioned first; they are read while it thinks
+static void agent_prefetch_reads(TechWriterAgent* agent, const ParsedResponse* parsed, char** observations) {
+    const Message* last = agent->memory_count > 0 ? &agent->memory[agent->memory_count - 1] : NULL;
+    const char* context = last && last->role == ROLE_ASSISTANT ? last->content : NULL;
+    
+    for (size_t i = 0; i < parsed->action_count; i++) {
+        if (strcmp(parsed->actions[i].name, "find_all_matching_files") != 0) continue;
+        if (!agent->prefetch) {
+            Arena* step_arena = arena_set_current(NULL);
+            agent->prefetch = read_prefetch_create();
+            arena_set_current(step_arena);
+        }
+        read_prefetch_listing(agent->prefetch, observations[i], context);
+    }
+}
+
+void agent_step_tools(TechWriterAgent* agent) {
+    Arena* previous_arena = arena_set_current(agent->step_arena);
+    ParsedResponse* parsed = agent->pending;
+    
+    // Execute tools; each observation comes back escaped for the request
+    size_t count = parsed->action_count;
+    char* observations[MAX_PARALLEL_ACTIONS];
+    StringBuffer escaped[MAX_PARALLEL_ACTIONS];
+    agent_run_tools(agent, parsed->actions, count, observations, escaped);
+    if (agent->prefetch_reads) {
+        agent_prefetch_reads(agent, parsed, observations);
+    }
+    
+    if (parsed->actions[0].id) {
+        // Native tool calls: one tool message per call
+        for (size_t i = 0; i < count; i++) {
+            agent_push_escaped(agent, ROLE_TOOL, message_strdup(agent->message_arena, observations[i]),
+                               NULL, parsed->actions[i].id, &escaped[i]);
+            free(observations[i]);
+            string_buffer_free(&escaped[i]);
+        }
+    } else {
+        // All observations go back in one turn, built in place in the
+        // message arena. Its encoded content is spliced from the headers and the escaped
+        // observations (escaping is per byte, so pieces concatenate).
+        StringBuffer content;
+        size_t total = 1;
+        size_t escaped_total = 1;
+        for (size_t i = 0; i < count; i++) {
+            total += strlen(observations[i]) + strlen(parsed->actions[i].name) + 48;
+            escaped_total += escaped[i].size + 2 * strlen(parsed->actions[i].name) + 48;
+        }
+        char* obs_message = agent_message_buffer(agent, total);
+        string_buffer_init(&content, escaped_total);
+        size_t used = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t header = used;
+            if (count == 1) {
+                used += snprintf(obs_message + used, total - used, "Observation: ");
+            } else {
+                used += snprintf(obs_message + used, total - used, "%sObservation %zu (%s): ",
+                                 i > 0 ? "\n\n" : "", i + 1, parsed->actions[i].name);
+            }
+            string_buffer_reserve(&content, cJSON_EscapedLength(obs_message + header, used - header));
+            content.size = cJSON_EscapeTo(content.data + content.size, obs_message + header,
+                                          used - header) - content.data;
+            string_buffer_append(&content, escaped[i].data, escaped[i].size);
+            
+            size_t observation_len = strlen(observations[i]);
+            memcpy(obs_message + used, observations[i], observation_len + 1);
+            used += observation_len;
+            free(observations[i]);
+            string_buffer_free(&escaped[i]);
+        }
+        agent_push_escaped(agent, ROLE_USER, obs_message, NULL, NULL, &content);
+        string_buffer_free(&content);
+    }
+    
+    agent_end_step(agent);
+    arena_set_current(previous_arena);
+}
+
+char* agent_finish(TechWriterAgent* agent) {
+    arena_reset(agent->step_arena);
+    agent->stats.wall_ms = (double)(platform_monotonic_ns() - agent->started_ns) / 1e6;
+    if (agent->stats.prompt_tokens > 0) {
+        log_message(LOG_INFO, "Prompt cache: %zu of %zu prompt tokens cached (%.1f%%)",
+                    agent->stats.cached_tokens, agent->stats.prompt_tokens,
+                    100.0 * (double)agent->stats.cached_tokens / (double)agent->stats.prompt_tokens);
+    }
+    
+    char* final_answer = agent->final_answer;
+    agent->final_answer = NULL;
     if (!final_answer) {
         log_message(LOG_ERROR, "Failed to complete analysis within %d steps", MAX_STEPS);
         final_answer = safe_strdup("Failed to complete analysis");
@@ -364,7 +1770,25 @@ char* agent_run(TechWriterAgent* agent, const char* prompt, const char* director
     return final_answer;
 }
 
-// Utility functions
+char* agent_run(TechWriterAgent* agent, const char* prompt, const char* directory) {
+    agent_start(agent, prompt, directory);
+    
+    // ReAct loop, one blocking request at a time
+    while (agent->state != AGENT_DONE) {
+        if (agent->state == AGENT_RUNNING_TOOLS) {
+            agent_step_tools(agent);
+            continue;
+        }
+        
+        HttpTransfer* transfer = agent_step_begin(agent);
+        if (transfer) {
+            agent_step_response(agent, http_transfer_perform(transfer));
+        }
+    }
+    
+    return agent_finish(agent);
+}
+
 char* extract_repo_info(const char* repo_url, char** owner, char** repo_name) {
     // Extract repo name from URL (e.g., https://github.com/owner/repo.git)
     char* url_copy = safe_strdup(repo_url);
@@ -392,7 +1816,128 @@ char* extract_repo_info(const char* repo_url, char** owner, char** repo_name) {
     return *repo_name;
 }
 
+// File types a prompt may ask about by language name
+static const struct {
+    const char* name;
+    const char* patterns;
+} LANGUAGE_PATTERNS[] = {
+    {"python", "*.py *.pyi"},
+    {"javascript", "*.js *.jsx *.mjs *.cjs"},
+    {"typescript", "*.ts *.tsx"},
+    {"golang", "*.go"},
+    {"rust", "*.rs"},
+    {"java", "*.java"},
+    {"kotlin", "*.kt *.kts"},
+    {"ruby", "*.rb"},
+    {"php", "*.php"},
+    {"swift", "*.swift"},
+    {"scala", "*.scala"},
+    {"c++", "*.cpp *.cc *.cxx *.hpp *.hh *.h"},
+    {"c#", "*.cs"},
+    {"zig", "*.zig"},
+    {"markdown", "*.md"},
+};
+
+static bool starts_with_ignore_case(const char* str, const char* prefix) {
+    for (; *prefix; str++, prefix++) {
+        if (tolower((unsigned char)*str) != tolower((unsigned char)*prefix)) return false;
+    }
+    return true;
+}
+
+static bool is_extension_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '+' || c == '-';
+}
+
+static void append_pattern(StringBuffer* patterns, const char* pattern, size_t length) {
+    // Skip duplicates; the list stays short
+    for (const char* line = patterns->data; line && *line; ) {
+        const char* end = strchr(line, '\n');
+        if ((size_t)(end - line) == length && strncmp(line, pattern, length) == 0) return;
+        line = end + 1;
+    }
+    string_buffer_append(patterns, pattern, length);
+    string_buffer_append(patterns, "\n", 1);
+}
+
+char* sparse_patterns_for_prompt(const char* prompt) {
+    StringBuffer patterns;
+    string_buffer_init(&patterns, 256);
+    size_t file_types = 0;
+    
+    // Extensions written as "*.py" or ".py"
+    for (const char* p = prompt; *p; p++) {
+        if (*p != '.' || !is_extension_char(p[1])) continue;
+        bool glob = p > prompt && p[-1] == '*';
+        bool word_start = p == prompt || isspace((unsigned char)p[-1]) || strchr("`'\"(,", p[-1]);
+        if (!glob && !word_start) continue;
+        
+        size_t length = 1;
+        while (is_extension_char(p[length])) length++;
+        if (length > 12) continue;
+        
+        char pattern[16];
+        snprintf(pattern, sizeof(pattern), "*%.*s", (int)length, p);
+        append_pattern(&patterns, pattern, strlen(pattern));
+        file_types++;
+    }
+    
+    // Language names, matched case-insensitively as whole words
+    for (size_t i = 0; i < sizeof(LANGUAGE_PATTERNS) / sizeof(LANGUAGE_PATTERNS[0]); i++) {
+        const char* name = LANGUAGE_PATTERNS[i].name;
+        size_t name_length = strlen(name);
+        for (const char* p = prompt; *p; p++) {
+            if (!starts_with_ignore_case(p, name)) continue;
+            if (p > prompt && isalnum((unsigned char)p[-1])) continue;
+            if (isalnum((unsigned char)p[name_length])) continue;
+            
+            const char* list = LANGUAGE_PATTERNS[i].patterns;
+            while (*list) {
+                size_t length = strcspn(list, " ");
+                append_pattern(&patterns, list, length);
+                list += length;
+                while (*list == ' ') list++;
+            }
+            file_types++;
+            break;
+        }
+    }
+    
+    if (file_types == 0) {
+        string_buffer_free(&patterns);
+        return NULL;
+    }
+    
+    // Top-level files (README, manifests, build files) are always useful
+    append_pattern(&patterns, "/*", 2);
+    append_pattern(&patterns, "!/*/", 4);
+    return patterns.data;
+}
+
+static void append_command(char* command, const char* text, size_t size) {
+    size_t used = strlen(command);
+    snprintf(command + used, size - used, "%s", text);
+}
+
+// Append the sparse checkout patterns as quoted command arguments
+static void append_pattern_arguments(char* command, size_t size, const char* patterns) {
+    for (const char* line = patterns; *line; ) {
+        const char* end = strchr(line, '\n');
+        if (!end) end = line + strlen(line);
+        size_t used = strlen(command);
+        snprintf(command + used, size - used, " \"%.*s\"", (int)(end - line), line);
+        line = *end ? end + 1 : end;
+    }
+}
+
 char* clone_or_update_repo(const char* repo_url, const char* cache_dir) {
+    return clone_or_update_repo_with(repo_url, cache_dir, NULL);
+}
+
+char* clone_or_update_repo_with(const char* repo_url, const char* cache_dir, const CloneOptions* options) {
+    CloneOptions defaults = {0};
+    if (!options) options = &defaults;
+    
     char* owner = NULL;
     char* repo_name = NULL;
     
@@ -417,16 +1962,44 @@ char* clone_or_update_repo(const char* repo_url, const char* cache_dir) {
     // Check if already cloned
     char git_path[1024];
     snprintf(git_path, sizeof(git_path), "%s%c.git", cache_path, PATH_SEPARATOR_CHAR);
+    char sparse_file[1100];
+    snprintf(sparse_file, sizeof(sparse_file), "%s%cinfo%csparse-checkout",
+             git_path, PATH_SEPARATOR_CHAR, PATH_SEPARATOR_CHAR);
     
-    char command[2048];
+    char depth[32] = "";
+    if (options->depth > 0) {
+        snprintf(depth, sizeof(depth), " --depth %d", options->depth);
+    }
+    
+    char command[8192];
     if (platform_is_directory(git_path)) {
+        // fetch + reset rather than pull: a cache clone has no local work to
+        // merge, and a hard reset also recovers from a diverged or dirty tree
         log_message(LOG_INFO, "Updating existing repository: %s", cache_path);
-        snprintf(command, sizeof(command), "cd \"%s\" && git pull --quiet", cache_path);
+        snprintf(command, sizeof(command), "cd \"%s\" && git fetch --quiet%s origin HEAD", cache_path, depth);
+        if (options->sparse_patterns) {
+            append_command(command, " && git sparse-checkout set --no-cone", sizeof(command));
+            append_pattern_arguments(command, sizeof(command), options->sparse_patterns);
+        } else if (platform_file_exists(sparse_file)) {
+            append_command(command, " && git sparse-checkout disable", sizeof(command));
+        }
+        append_command(command, " && git reset --quiet --hard FETCH_HEAD", sizeof(command));
     } else {
         log_message(LOG_INFO, "Cloning repository: %s", repo_url);
-        snprintf(command, sizeof(command), "git clone --quiet \"%s\" \"%s\"", repo_url, cache_path);
+        snprintf(command, sizeof(command), "git clone --quiet%s%s%s \"%s\" \"%s\"",
+                 depth, options->partial ? " --filter=blob:none" : "",
+                 options->sparse_patterns ? " --no-checkout" : "", repo_url, cache_path);
+        if (options->sparse_patterns) {
+            // With --filter=blob:none only the blobs of matching files are fetched
+            size_t used = strlen(command);
+            snprintf(command + used, sizeof(command) - used,
+                     " && cd \"%s\" && git sparse-checkout set --no-cone", cache_path);
+            append_pattern_arguments(command, sizeof(command), options->sparse_patterns);
+            append_command(command, " && git checkout --quiet", sizeof(command));
+        }
     }
     
+    log_message(LOG_DEBUG, "Running: %s", command);
     int result = platform_execute_command(command, NULL, 0);
     
     free(owner);
@@ -441,10 +2014,8 @@ char* clone_or_update_repo(const char* repo_url, const char* cache_dir) {
     return safe_strdup(cache_path);
 }
 
-void save_results(const char* content, const char* repo_name, const char* model, 
-                  const char* output_dir, const char* extension, const char* file_name) {
-    platform_make_directory(output_dir);
-    
+char* build_output_path(const char* repo_name, const char* model,
+                        const char* output_dir, const char* extension, const char* file_name) {
     char output_path[1024];
     if (file_name) {
         snprintf(output_path, sizeof(output_path), "%s%c%s", output_dir, PATH_SEPARATOR_CHAR, file_name);
@@ -452,40 +2023,47 @@ void save_results(const char* content, const char* repo_name, const char* model,
         // Parse model vendor/id
         char* model_copy = safe_strdup(model);
         char* slash = strchr(model_copy, '/');
+        const char* vendor = model_copy;
+        const char* model_id = model_copy;
         if (slash) {
             *slash = '\0';
-            const char* vendor = model_copy;
-            const char* model_id = slash + 1;
-            
-            // Sanitize model ID
-            char sanitized_model[256];
-            size_t j = 0;
-            for (size_t i = 0; model_id[i] && j < sizeof(sanitized_model) - 1; i++) {
-                if (isalnum(model_id[i]) || model_id[i] == '-' || model_id[i] == '_') {
-                    sanitized_model[j++] = model_id[i];
-                } else {
-                    sanitized_model[j++] = '-';
-                }
+            model_id = slash + 1;
+        }
+        
+        // Sanitize model ID
+        char sanitized_model[256];
+        size_t j = 0;
+        for (size_t i = 0; model_id[i] && j < sizeof(sanitized_model) - 1; i++) {
+            if (isalnum((unsigned char)model_id[i]) || model_id[i] == '-' || model_id[i] == '_') {
+                sanitized_model[j++] = model_id[i];
+            } else {
+                sanitized_model[j++] = '-';
             }
-            sanitized_model[j] = '\0';
-            
-            time_t now = time(NULL);
-            snprintf(output_path, sizeof(output_path), "%s%c%ld-%s-%s-%s%s",
-                     output_dir, PATH_SEPARATOR_CHAR, (long)now, repo_name, vendor, sanitized_model, extension);
         }
+        sanitized_model[j] = '\0';
+        
+        time_t now = time(NULL);
+        snprintf(output_path, sizeof(output_path), "%s%c%ld-%s-%s-%s%s",
+                 output_dir, PATH_SEPARATOR_CHAR, (long)now, repo_name, vendor, sanitized_model, extension);
         free(model_copy);
     }
     
+    return safe_strdup(output_path);
+}
+
+void save_results(const char* content, const char* output_path) {
     FILE* file = fopen(output_path, "w");
     if (file) {
         fputs(content, file);
         fclose(file);
         log_message(LOG_INFO, "Results saved to: %s", output_path);
+    } else {
+        log_message(LOG_ERROR, "Cannot write results to: %s", output_path);
     }
 }
 
 void create_metadata(const char* output_file, const char* model, 
-                     const char* repo_url, const char* repo_name) {
+                     const char* repo_url, const char* repo_name, const AgentStats* stats) {
     // Replace extension with .metadata.json
     char metadata_path[1024];
     strcpy(metadata_path, output_file);
@@ -505,9 +2083,31 @@ void create_metadata(const char* output_file, const char* model,
     
     time_t now = time(NULL);
     char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    struct tm local_time;
+    platform_localtime(now, &local_time);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &local_time);
     cJSON_AddStringToObject(metadata, "timestamp", timestamp);
     
+    if (stats) {
+        cJSON* totals = cJSON_AddObjectToObject(metadata, "stats");
+        cJSON_AddNumberToObject(totals, "steps", (double)stats->steps);
+        cJSON_AddNumberToObject(totals, "llm_requests", (double)stats->llm_requests);
+        cJSON_AddNumberToObject(totals, "cached_responses", (double)stats->cached_responses);
+        cJSON_AddNumberToObject(totals, "request_bytes", (double)stats->request_bytes);
+        cJSON_AddNumberToObject(totals, "response_bytes", (double)stats->response_bytes);
+        cJSON_AddNumberToObject(totals, "prompt_tokens", (double)stats->prompt_tokens);
+        cJSON_AddNumberToObject(totals, "cached_prompt_tokens", (double)stats->cached_tokens);
+        cJSON_AddNumberToObject(totals, "prompt_cache_hit_rate",
+                                stats->prompt_tokens ? (double)stats->cached_tokens / (double)stats->prompt_tokens : 0);
+        cJSON_AddNumberToObject(totals, "completion_tokens", (double)stats->completion_tokens);
+        cJSON_AddNumberToObject(totals, "http_ms", stats->http_ms);
+        cJSON_AddNumberToObject(totals, "http_retries", (double)stats->http_retries);
+        cJSON_AddNumberToObject(totals, "hedged_responses", (double)stats->hedged_responses);
+        cJSON_AddNumberToObject(totals, "tool_calls", (double)stats->tool_calls);
+        cJSON_AddNumberToObject(totals, "tool_ms", stats->tool_ms);
+        cJSON_AddNumberToObject(totals, "wall_ms", stats->wall_ms);
+    }
+    
     char* json_str = cJSON_Print(metadata);
     
     FILE* file = fopen(metadata_path, "w");
@@ -4,18 +4,69 @@
 #include "platform.h"
 #include "http.h"
 #include "cJSON.h"
+#include "cache.h"
+#include "trace.h"
 
 #define MAX_STEPS 50
 #define MAX_MEMORY_SIZE 100
+#define DEFAULT_TOKEN_BUDGET 64000
+#define AGENT_DEFAULT_LOG_LEVEL LOG_INFO    // step summaries; LOG_DEBUG adds timing and tool results
+#define MAX_PARALLEL_ACTIONS 8
 
 extern const char* REACT_SYSTEM_PROMPT;
+extern const char* FUNCTION_CALLING_SYSTEM_PROMPT;
 
-// Message structure for conversation history
+typedef enum {
+    ROLE_SYSTEM,
+    ROLE_USER,
+    ROLE_ASSISTANT,
+    ROLE_TOOL
+} MessageRole;
+
+// Message structure for conversation history; its strings live in the
+// agent's message arena
 typedef struct {
-    char* role;
-    char* content;
+    MessageRole role;
+    char* content;          // NULL for an assistant turn that only calls tools
+    char* tool_calls;       // assistant: raw JSON array of native tool calls
+    char* tool_call_id;     // tool: id of the call this message answers
+    size_t tokens;          // approximate prompt tokens this message costs
+    bool compacted;         // observation replaced by its summary stub
 } Message;
 
+// Where an agent is in its ReAct loop; lets an event loop drive many
+// agents without a thread each
+typedef enum {
+    AGENT_READY,            // the next LLM request can be built
+    AGENT_AWAITING_LLM,     // a request is in flight
+    AGENT_RUNNING_TOOLS,    // the step's actions are waiting to run
+    AGENT_DONE
+} AgentState;
+
+// Totals of one agent_run, reported in the metadata file
+typedef struct {
+    size_t steps;
+    size_t llm_requests;        // sent, not answered from the response cache
+    size_t cached_responses;
+    size_t request_bytes;
+    size_t response_bytes;
+    size_t prompt_tokens;       // as reported in the responses' usage
+    size_t cached_tokens;       // of prompt_tokens, served from the provider's prompt cache
+    size_t completion_tokens;
+    double http_ms;
+    size_t http_retries;        // attempts beyond the first
+    size_t hedged_responses;    // answered by a hedged copy of the request
+    size_t tool_calls;
+    double tool_ms;             // summed, so parallel calls can exceed the wall time
+    double wall_ms;
+} AgentStats;
+
+struct ParsedResponse;
+struct RepoIndex;
+struct ReadPrefetch;
+struct AnalysisManifest;
+typedef struct LlmRequest LlmRequest;
+
 // Agent structure
 typedef struct {
     HttpClient* client;
@@ -23,7 +74,44 @@ typedef struct {
     Message* memory;
     size_t memory_count;
     size_t memory_capacity;
-    FILE* log_file;
+    size_t memory_tokens;   // sum of Message.tokens
+    Arena* message_arena;   // strings of memory, repacked when the history is edited
+    size_t token_budget;    // compact old observations beyond this (0: unlimited)
+    StringBuffer encoded_messages;  // memory as JSON array elements, escaped once
+    ContentHash messages_hash;      // running hash of encoded_messages for the response cache
+    size_t messages_hashed;         // bytes of encoded_messages covered by messages_hash
+    StringBuffer request_prefixes[2];   // request JSON before the messages, without and with tools
+    Arena* step_arena;      // temporaries of one ReAct step, reset every iteration
+    FILE* log_file;         // created on the first line at or above log_level
+    LogLevel log_level;
+    bool log_failed;        // could not create log_file; not retried
+    PlatformMutex log_lock; // tool threads log too
+    bool stream;            // request streamed (SSE) completions
+    bool function_calling;  // native tools/tool_calls instead of ReAct text
+    FILE* answer_stream;    // optional sink for a final answer as it streams
+    AgentState state;
+    int step;               // completed steps
+    bool step_started;      // the current step has been logged and budgeted
+    bool parallel_tools;    // run a step's tool calls on threads of their own while
+                            // the calling thread readies the next request
+    bool prefetch_reads;    // read likely read_file targets of a listing while the model thinks
+    bool stable_prefix;     // keep requests' prefixes byte-stable for provider prompt caching
+    size_t map_reduce_jobs; // summarize the repository by map-reduce before the first step,
+                            // this many calls at once (0: off)
+    const struct AnalysisManifest* previous;    // --incremental: update this analysis's document
+    const char* changes;    // with previous: git diff --name-status since its commit ("": none)
+    StringBuffer files_read;    // read_file paths of the run, relative to base_directory, one per line
+    LlmRequest* request;    // in flight while AGENT_AWAITING_LLM
+    struct ParsedResponse* pending;     // actions to run while AGENT_RUNNING_TOOLS
+    char* final_answer;
+    char* base_directory;   // directory under analysis, from agent_start
+    struct RepoIndex* index;    // listing of base_directory, built on first use
+    struct ReadPrefetch* prefetch;  // created by the first listing when prefetch_reads is set
+    AgentStats stats;
+    uint64_t started_ns;        // agent_start
+    unsigned long trace_run;    // 0 when tracing is off
+    TraceStep trace_step;       // the step in progress
+    TraceTool trace_tools[MAX_PARALLEL_ACTIONS];
 } TechWriterAgent;
 
 // Response types
@@ -34,30 +122,85 @@ typedef enum {
 } ResponseType;
 
 typedef struct {
+    char* id;       // native tool call id, NULL for ReAct actions
+    char* name;
+    char* input;
+} ParsedAction;
+
+typedef struct ParsedResponse {
     ResponseType type;
-    char* action;
-    char* action_input;
+    ParsedAction actions[MAX_PARALLEL_ACTIONS];     // in the order the model wrote them
+    size_t action_count;
     char* final_answer;
 } ParsedResponse;
 
 // Agent functions
 TechWriterAgent* agent_create(const char* model_name, const char* base_url);
+// Agent whose HTTP client shares connections and rate limits through pool
+TechWriterAgent* agent_create_pooled(const char* model_name, const char* base_url, HttpPool* pool);
+// Process-wide setup done by the first agent_create; call it before
+// creating agents from several threads
+void agent_global_init(void);
 void agent_destroy(TechWriterAgent* agent);
 char* agent_run(TechWriterAgent* agent, const char* prompt, const char* directory);
 
+// agent_run as a resumable state machine. After agent_start, until the
+// state is AGENT_DONE:
+//   AGENT_READY: agent_step_begin returns the request to send and moves to
+//     AGENT_AWAITING_LLM, or returns NULL having answered it from the
+//     response cache (or failed)
+//   AGENT_AWAITING_LLM: hand the completed request's response (NULL on
+//     failure) to agent_step_response
+//   AGENT_RUNNING_TOOLS: agent_step_tools, from any one thread at a time
+// agent_finish then returns the final answer.
+void agent_start(TechWriterAgent* agent, const char* prompt, const char* directory);
+HttpTransfer* agent_step_begin(TechWriterAgent* agent);
+void agent_step_response(TechWriterAgent* agent, HttpResponse* response);
+void agent_step_tools(TechWriterAgent* agent);
+char* agent_finish(TechWriterAgent* agent);
+
 // Internal functions
-void agent_add_message(TechWriterAgent* agent, const char* role, const char* content);
+const char* message_role_name(MessageRole role);
+void agent_add_message(TechWriterAgent* agent, MessageRole role, const char* content);
+// Space in the message arena to build content in place; agent_add_message_owned
+// then adds it to memory without a copy
+char* agent_message_buffer(TechWriterAgent* agent, size_t size);
+void agent_add_message_owned(TechWriterAgent* agent, MessageRole role, char* content);
+// Keep memory within token_budget and MAX_MEMORY_SIZE by compacting old
+// observations into stubs and, past the message limit, dropping old steps
+void agent_enforce_budget(TechWriterAgent* agent);
 char* agent_call_llm(TechWriterAgent* agent);
+// Function-calling round trip: records the reply in memory and returns the
+// parsed step, or NULL on failure. When the API rejects tools it switches
+// the agent back to ReAct (function_calling = false) and returns NULL.
+ParsedResponse* agent_call_llm_native(TechWriterAgent* agent);
 ParsedResponse* agent_parse_response(const char* response);
 void parsed_response_destroy(ParsedResponse* parsed);
 char* agent_execute_tool(TechWriterAgent* agent, const char* tool_name, const char* action_input);
+// Run a batch of actions concurrently; results[i] receives the heap
+// allocated observation for actions[i]
+void agent_execute_tools(TechWriterAgent* agent, const ParsedAction* actions, size_t count, char** results);
 
 // Utility functions
 char* extract_repo_info(const char* repo_url, char** owner, char** repo_name);
 char* clone_or_update_repo(const char* repo_url, const char* cache_dir);
-void save_results(const char* content, const char* repo_name, const char* model, 
-                  const char* output_dir, const char* extension, const char* file_name);
+
+// How clone_or_update_repo_with fetches a repository
+typedef struct {
+    int depth;                  // shallow history of this many commits (0: full)
+    bool partial;               // --filter=blob:none: file contents are fetched on checkout
+    const char* sparse_patterns;    // check out only these (newline-separated, gitignore syntax)
+} CloneOptions;
+
+char* clone_or_update_repo_with(const char* repo_url, const char* cache_dir, const CloneOptions* options);
+// Sparse checkout patterns for the file types a prompt mentions ("*.py",
+// ".ts", "Python files"), plus top-level files. NULL when it names none.
+char* sparse_patterns_for_prompt(const char* prompt);
+char* build_output_path(const char* repo_name, const char* model,
+                        const char* output_dir, const char* extension, const char* file_name);
+void save_results(const char* content, const char* output_path);
+// stats (NULL to leave them out) are added as "stats"
 void create_metadata(const char* output_file, const char* model, 
-                     const char* repo_url, const char* repo_name);
+                     const char* repo_url, const char* repo_name, const AgentStats* stats);
 
 #endif // AGENT_H
\ No newline at end of file
@@ -49,6 +49,16 @@
 #include <locale.h>
 #endif
 
+/* SIMD fast paths for string scanning, see scan_escape / scan_string_special */
+#if !defined(CJSON_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CJSON_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#elif !defined(CJSON_NO_SIMD) && defined(__GNUC__) && defined(__aarch64__)
+#define CJSON_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 #if defined(_MSC_VER)
 #pragma warning (pop)
 #endif
@@ -815,60 +825,231 @@ fail:
     return 0;
 }
 
-/* Parse the input text into an unescaped cinput, and populate item. */
-static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer)
+/* String scanning. scan_escape returns the offset of the first byte that needs escaping when printing (quote, backslash or control
+ * character); scan_string_special returns the offset of the first quote or backslash when parsing. Both return length when there is
+ * none. Clean runs are checked 16 or 32 bytes at a time where SIMD is available, with runtime dispatch to AVX2 on x86. */
+static size_t scan_escape_scalar(const unsigned char *input, size_t length)
 {
-    const unsigned char *input_pointer = buffer_at_offset(input_buffer) + 1;
-    const unsigned char *input_end = buffer_at_offset(input_buffer) + 1;
-    unsigned char *output_pointer = NULL;
-    unsigned char *output = NULL;
+    size_t offset = 0;
+    for (offset = 0; offset < length; offset++)
+    {
+        if ((input[offset] < 32) || (input[offset] == '\"') || (input[offset] == '\\'))
+        {
+            break;
+        }
+    }
+    return offset;
+}
 
-    /* not a string */
-    if (buffer_at_offset(input_buffer)[0] != '\"')
+static size_t scan_string_special_scalar(const unsigned char *input, size_t length)
+{
+    size_t offset = 0;
+    for (offset = 0; offset < length; offset++)
     {
-        goto fail;
+        if ((input[offset] == '\"') || (input[offset] == '\\'))
+        {
+            break;
+        }
     }
+    return offset;
+}
+
+#if defined(CJSON_SIMD_X86)
+static size_t scan_escape_sse2(const unsigned char *input, size_t length)
+{
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control_max = _mm_set1_epi8(31);
+    size_t offset = 0;
 
+    for (; offset + 16 <= length; offset += 16)
     {
-        /* calculate approximate size of the output (overestimate) */
-        size_t allocation_length = 0;
-        size_t skipped_bytes = 0;
-        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(input + offset));
+        /* unsigned chunk <= 31 is chunk == min(chunk, 31) */
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(chunk, control_max), chunk),
+                                       _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0)
         {
-            /* is escape sequence */
-            if (input_end[0] == '\\')
-            {
-                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
-                {
-                    /* prevent buffer overflow when last input character is a backslash */
-                    goto fail;
-                }
-                skipped_bytes++;
-                input_end++;
-            }
-            input_end++;
+            return offset + (size_t)__builtin_ctz((unsigned int)mask);
         }
-        if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
+    }
+
+    return offset + scan_escape_scalar(input + offset, length - offset);
+}
+
+static size_t scan_string_special_sse2(const unsigned char *input, size_t length)
+{
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    size_t offset = 0;
+
+    for (; offset + 16 <= length; offset += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(input + offset));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask != 0)
         {
-            goto fail; /* string ended unexpectedly */
+            return offset + (size_t)__builtin_ctz((unsigned int)mask);
         }
+    }
 
-        /* This is at most how much we need for the output */
-        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
-        if (output == NULL)
+    return offset + scan_string_special_scalar(input + offset, length - offset);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_escape_avx2(const unsigned char *input, size_t length)
+{
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control_max = _mm256_set1_epi8(31);
+    size_t offset = 0;
+
+    for (; offset + 32 <= length; offset += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(const void*)(input + offset));
+        __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control_max), chunk),
+                                          _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(special);
+        if (mask != 0)
         {
-            goto fail; /* allocation failure */
+            return offset + (size_t)__builtin_ctz(mask);
+        }
+    }
+
+    return offset + scan_escape_sse2(input + offset, length - offset);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_string_special_avx2(const unsigned char *input, size_t length)
+{
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    size_t offset = 0;
+
+    for (; offset + 32 <= length; offset += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(const void*)(input + offset));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)));
+        if (mask != 0)
+        {
+            return offset + (size_t)__builtin_ctz(mask);
+        }
+    }
+
+    return offset + scan_string_special_sse2(input + offset, length - offset);
+}
+
+static cJSON_bool cpu_has_avx2(void)
+{
+    /* __builtin_cpu_supports only reads the CPU model filled in at startup */
+    return __builtin_cpu_supports("avx2") ? true : false;
+}
+#elif defined(CJSON_SIMD_NEON)
+/* offset of the first non-zero byte of a comparison result, or 16 */
+static size_t neon_first_set(uint8x16_t matches)
+{
+    /* narrow each byte to a nibble so the result fits one 64 bit lane */
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+    if (bits == 0)
+    {
+        return 16;
+    }
+    return (size_t)(__builtin_ctzll(bits) >> 2);
+}
+
+static size_t scan_escape_neon(const unsigned char *input, size_t length)
+{
+    const uint8x16_t quote = vdupq_n_u8('\"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t control_end = vdupq_n_u8(32);
+    size_t offset = 0;
+
+    for (; offset + 16 <= length; offset += 16)
+    {
+        uint8x16_t chunk = vld1q_u8(input + offset);
+        uint8x16_t special = vorrq_u8(vcltq_u8(chunk, control_end), vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)));
+        if (vmaxvq_u8(special) != 0)
+        {
+            return offset + neon_first_set(special);
+        }
+    }
+
+    return offset + scan_escape_scalar(input + offset, length - offset);
+}
+
+static size_t scan_string_special_neon(const unsigned char *input, size_t length)
+{
+    const uint8x16_t quote = vdupq_n_u8('\"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    size_t offset = 0;
+
+    for (; offset + 16 <= length; offset += 16)
+    {
+        uint8x16_t chunk = vld1q_u8(input + offset);
+        uint8x16_t special = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+        if (vmaxvq_u8(special) != 0)
+        {
+            return offset + neon_first_set(special);
         }
     }
 
-    output_pointer = output;
+    return offset + scan_string_special_scalar(input + offset, length - offset);
+}
+#endif
+
+static size_t scan_escape(const unsigned char *input, size_t length)
+{
+#if defined(CJSON_SIMD_X86)
+    if (length >= 32 && cpu_has_avx2())
+    {
+        return scan_escape_avx2(input, length);
+    }
+    return scan_escape_sse2(input, length);
+#elif defined(CJSON_SIMD_NEON)
+    return scan_escape_neon(input, length);
+#else
+    return scan_escape_scalar(input, length);
+#endif
+}
+
+static size_t scan_string_special(const unsigned char *input, size_t length)
+{
+#if defined(CJSON_SIMD_X86)
+    if (length >= 32 && cpu_has_avx2())
+    {
+        return scan_string_special_avx2(input, length);
+    }
+    return scan_string_special_sse2(input, length);
+#elif defined(CJSON_SIMD_NEON)
+    return scan_string_special_neon(input, length);
+#else
+    return scan_string_special_scalar(input, length);
+#endif
+}
+
+/* Parse the input text into an unescaped cinput, and populate item. */
+/* Decode the contents of a string literal, [*input, input_end), into output, which needs at most input_end - *input bytes.
+ * Returns the end of the output, or NULL with *input at the invalid escape sequence. */
+static unsigned char *unescape_string(unsigned char *output_pointer, const unsigned char **input, const unsigned char * const input_end)
+{
+    const unsigned char *input_pointer = *input;
+
     /* loop through the string literal */
     while (input_pointer < input_end)
     {
         if (*input_pointer != '\\')
         {
-            *output_pointer++ = *input_pointer++;
+            /* bulk copy up to the next escape sequence */
+            size_t run = scan_string_special(input_pointer, (size_t)(input_end - input_pointer));
+            if (run == 0)
+            {
+                /* an unescaped quote cannot occur before input_end, copy it like before */
+                run = 1;
+            }
+            memcpy(output_pointer, input_pointer, run);
+            output_pointer += run;
+            input_pointer += run;
         }
         /* escape sequence */
         else
@@ -876,7 +1057,8 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
             unsigned char sequence_length = 2;
             if ((input_end - input_pointer) < 1)
             {
-                goto fail;
+                *input = input_pointer;
+                return NULL;
             }
 
             switch (input_pointer[1])
@@ -908,17 +1090,82 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
                     if (sequence_length == 0)
                     {
                         /* failed to convert UTF16-literal to UTF-8 */
-                        goto fail;
+                        *input = input_pointer;
+                        return NULL;
                     }
                     break;
 
                 default:
-                    goto fail;
+                    *input = input_pointer;
+                    return NULL;
             }
             input_pointer += sequence_length;
         }
     }
 
+    *input = input_pointer;
+    return output_pointer;
+}
+
+static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer)
+{
+    const unsigned char *input_pointer = buffer_at_offset(input_buffer) + 1;
+    const unsigned char *input_end = buffer_at_offset(input_buffer) + 1;
+    unsigned char *output_pointer = NULL;
+    unsigned char *output = NULL;
+
+    /* not a string */
+    if (buffer_at_offset(input_buffer)[0] != '\"')
+    {
+        goto fail;
+    }
+
+    {
+        /* calculate approximate size of the output (overestimate) */
+        size_t allocation_length = 0;
+        size_t skipped_bytes = 0;
+        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        {
+            /* skip ahead to the next quote or backslash */
+            input_end += scan_string_special(input_end, input_buffer->length - (size_t)(input_end - input_buffer->content));
+            if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end == '\"'))
+            {
+                break;
+            }
+
+            /* is escape sequence */
+            if (input_end[0] == '\\')
+            {
+                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
+                {
+                    /* prevent buffer overflow when last input character is a backslash */
+                    goto fail;
+                }
+                skipped_bytes++;
+                input_end++;
+            }
+            input_end++;
+        }
+        if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
+        {
+            goto fail; /* string ended unexpectedly */
+        }
+
+        /* This is at most how much we need for the output */
+        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
+        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+        if (output == NULL)
+        {
+            goto fail; /* allocation failure */
+        }
+    }
+
+    output_pointer = unescape_string(output, &input_pointer, input_end);
+    if (output_pointer == NULL)
+    {
+        goto fail;
+    }
+
     /* zero terminate the output */
     *output_pointer = '\0';
 
@@ -945,37 +1192,22 @@ fail:
     return false;
 }
 
-/* Render the cstring provided to an escaped version that can be printed. */
-static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffer * const output_buffer)
+/* count the additional characters needed to escape a string */
+static size_t escape_characters_needed(const unsigned char * const input, size_t length)
 {
     const unsigned char *input_pointer = NULL;
-    unsigned char *output = NULL;
-    unsigned char *output_pointer = NULL;
-    size_t output_length = 0;
     /* numbers of additional characters needed for escaping */
     size_t escape_characters = 0;
 
-    if (output_buffer == NULL)
+    for (input_pointer = input; input_pointer < input + length; input_pointer++)
     {
-        return false;
-    }
-
-    /* empty string */
-    if (input == NULL)
-    {
-        output = ensure(output_buffer, sizeof("\"\""));
-        if (output == NULL)
+        /* skip the run of characters that are printed as is */
+        input_pointer += scan_escape(input_pointer, (size_t)(input + length - input_pointer));
+        if (input_pointer == input + length)
         {
-            return false;
+            break;
         }
-        strcpy((char*)output, "\"\"");
 
-        return true;
-    }
-
-    /* set "flag" to 1 if something needs to be escaped */
-    for (input_pointer = input; *input_pointer; input_pointer++)
-    {
         switch (*input_pointer)
         {
             case '\"':
@@ -997,36 +1229,27 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
                 break;
         }
     }
-    output_length = (size_t)(input_pointer - input) + escape_characters;
-
-    output = ensure(output_buffer, output_length + sizeof("\"\""));
-    if (output == NULL)
-    {
-        return false;
-    }
 
-    /* no characters have to be escaped */
-    if (escape_characters == 0)
-    {
-        output[0] = '\"';
-        memcpy(output + 1, input, output_length);
-        output[output_length + 1] = '\"';
-        output[output_length + 2] = '\0';
+    return escape_characters;
+}
 
-        return true;
-    }
+/* write the escaped form of input to output, returns the end of the output */
+static unsigned char *escape_string(unsigned char *output_pointer, const unsigned char * const input, size_t length)
+{
+    const unsigned char *input_pointer = NULL;
 
-    output[0] = '\"';
-    output_pointer = output + 1;
-    /* copy the string */
-    for (input_pointer = input; *input_pointer != '\0'; (void)input_pointer++, output_pointer++)
+    for (input_pointer = input; input_pointer < input + length; (void)input_pointer++, output_pointer++)
     {
-        if ((*input_pointer > 31) && (*input_pointer != '\"') && (*input_pointer != '\\'))
+        /* bulk copy the run of normal characters */
+        size_t run = scan_escape(input_pointer, (size_t)(input + length - input_pointer));
+        memcpy(output_pointer, input_pointer, run);
+        input_pointer += run;
+        output_pointer += run;
+        if (input_pointer == input + length)
         {
-            /* normal character, copy */
-            *output_pointer = *input_pointer;
+            break;
         }
-        else
+
         {
             /* character needs to be escaped */
             *output_pointer++ = '\\';
@@ -1054,13 +1277,362 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
                     *output_pointer = 't';
                     break;
                 default:
-                    /* escape and print as unicode codepoint */
-                    sprintf((char*)output_pointer, "u%04x", *input_pointer);
+                    /* escape and print as unicode codepoint (u%04x without a trailing NUL) */
+                    output_pointer[0] = 'u';
+                    output_pointer[1] = '0';
+                    output_pointer[2] = '0';
+                    output_pointer[3] = "0123456789abcdef"[*input_pointer >> 4];
+                    output_pointer[4] = "0123456789abcdef"[*input_pointer & 0x0F];
                     output_pointer += 4;
                     break;
             }
         }
     }
+
+    return output_pointer;
+}
+
+CJSON_PUBLIC(size_t) cJSON_EscapedLength(const char *string, size_t length)
+{
+    if (string == NULL)
+    {
+        return 0;
+    }
+
+    return length + escape_characters_needed((const unsigned char*)string, length);
+}
+
+CJSON_PUBLIC(char *) cJSON_EscapeTo(char *output, const char *string, size_t length)
+{
+    if ((output == NULL) || (string == NULL))
+    {
+        return output;
+    }
+
+    return (char*)escape_string((unsigned char*)output, (const unsigned char*)string, length);
+}
+
+static const unsigned char *skip_json_whitespace(const unsigned char *pointer, const unsigned char * const end)
+{
+    while ((pointer < end) && (*pointer <= 32))
+    {
+        pointer++;
+    }
+
+    return pointer;
+}
+
+/* pointer is at the opening quote; returns a pointer just past the closing one, NULL if there is none */
+static const unsigned char *skip_json_string(const unsigned char *pointer, const unsigned char * const end)
+{
+    pointer++;
+    while (pointer < end)
+    {
+        pointer += scan_string_special(pointer, (size_t)(end - pointer));
+        if (pointer >= end)
+        {
+            break;
+        }
+        if (*pointer == '\"')
+        {
+            return pointer + 1;
+        }
+        /* backslash: the next character is escaped */
+        pointer += 2;
+    }
+
+    return NULL;
+}
+
+/* pointer is at the start of a value; returns a pointer just past it, NULL if it is malformed */
+static const unsigned char *skip_json_value(const unsigned char *pointer, const unsigned char * const end, size_t depth)
+{
+    const unsigned char *start = pointer;
+    unsigned char close = 0;
+
+    if (pointer >= end)
+    {
+        return NULL;
+    }
+    if (*pointer == '\"')
+    {
+        return skip_json_string(pointer, end);
+    }
+    if ((*pointer != '{') && (*pointer != '['))
+    {
+        /* number, true, false or null */
+        while ((pointer < end) && (*pointer > 32) && (*pointer != ',') && (*pointer != ':') && (*pointer != '}') && (*pointer != ']'))
+        {
+            pointer++;
+        }
+        return (pointer > start) ? pointer : NULL;
+    }
+
+    if (depth >= CJSON_NESTING_LIMIT)
+    {
+        return NULL;
+    }
+    close = (*pointer == '{') ? '}' : ']';
+    pointer = skip_json_whitespace(pointer + 1, end);
+    if ((pointer < end) && (*pointer == close))
+    {
+        return pointer + 1;
+    }
+    while (pointer < end)
+    {
+        if (close == '}')
+        {
+            /* key and colon */
+            if (*pointer != '\"')
+            {
+                return NULL;
+            }
+            pointer = skip_json_string(pointer, end);
+            if (pointer == NULL)
+            {
+                return NULL;
+            }
+            pointer = skip_json_whitespace(pointer, end);
+            if ((pointer >= end) || (*pointer != ':'))
+            {
+                return NULL;
+            }
+            pointer = skip_json_whitespace(pointer + 1, end);
+        }
+        pointer = skip_json_value(pointer, end, depth + 1);
+        if (pointer == NULL)
+        {
+            return NULL;
+        }
+        pointer = skip_json_whitespace(pointer, end);
+        if (pointer >= end)
+        {
+            return NULL;
+        }
+        if (*pointer == close)
+        {
+            return pointer + 1;
+        }
+        if (*pointer != ',')
+        {
+            return NULL;
+        }
+        pointer = skip_json_whitespace(pointer + 1, end);
+    }
+
+    return NULL;
+}
+
+/* pointer is at an object or array; returns the start of the member called key (an index for arrays), NULL if there is none */
+static const unsigned char *find_json_member(const unsigned char *pointer, const unsigned char * const end, const char *key, size_t key_length)
+{
+    size_t index = 0;
+    size_t i = 0;
+
+    if (pointer >= end)
+    {
+        return NULL;
+    }
+    if (*pointer == '[')
+    {
+        if (key_length == 0)
+        {
+            return NULL;
+        }
+        for (i = 0; i < key_length; i++)
+        {
+            if ((key[i] < '0') || (key[i] > '9'))
+            {
+                return NULL;
+            }
+            index = (index * 10) + (size_t)(key[i] - '0');
+        }
+
+        pointer = skip_json_whitespace(pointer + 1, end);
+        for (i = 0; (pointer < end) && (*pointer != ']'); i++)
+        {
+            if (i == index)
+            {
+                return pointer;
+            }
+            pointer = skip_json_value(pointer, end, 1);
+            if (pointer == NULL)
+            {
+                return NULL;
+            }
+            pointer = skip_json_whitespace(pointer, end);
+            if ((pointer < end) && (*pointer == ','))
+            {
+                pointer = skip_json_whitespace(pointer + 1, end);
+            }
+            else if ((pointer >= end) || (*pointer != ']'))
+            {
+                return NULL;
+            }
+        }
+        return NULL;
+    }
+    if (*pointer != '{')
+    {
+        return NULL;
+    }
+
+    pointer = skip_json_whitespace(pointer + 1, end);
+    while ((pointer < end) && (*pointer == '\"'))
+    {
+        const unsigned char *name = pointer + 1;
+        cJSON_bool match = false;
+
+        pointer = skip_json_string(pointer, end);
+        if (pointer == NULL)
+        {
+            return NULL;
+        }
+        /* keys are compared as written, escapes included */
+        match = ((size_t)(pointer - 1 - name) == key_length) && (memcmp(name, key, key_length) == 0);
+        pointer = skip_json_whitespace(pointer, end);
+        if ((pointer >= end) || (*pointer != ':'))
+        {
+            return NULL;
+        }
+        pointer = skip_json_whitespace(pointer + 1, end);
+        if (match)
+        {
+            return pointer;
+        }
+
+        pointer = skip_json_value(pointer, end, 1);
+        if (pointer == NULL)
+        {
+            return NULL;
+        }
+        pointer = skip_json_whitespace(pointer, end);
+        if ((pointer < end) && (*pointer == ','))
+        {
+            pointer = skip_json_whitespace(pointer + 1, end);
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+CJSON_PUBLIC(const char *) cJSON_FindPath(const char *json, size_t length, const char *path, size_t *value_length)
+{
+    const unsigned char *end = NULL;
+    const unsigned char *pointer = NULL;
+    const unsigned char *value_end = NULL;
+    const char *segment = path;
+
+    if ((json == NULL) || (path == NULL))
+    {
+        return NULL;
+    }
+
+    end = (const unsigned char*)json + length;
+    pointer = skip_json_whitespace((const unsigned char*)json, end);
+    while (*segment != '\0')
+    {
+        size_t segment_length = strcspn(segment, ".");
+        pointer = find_json_member(pointer, end, segment, segment_length);
+        if (pointer == NULL)
+        {
+            return NULL;
+        }
+        segment += segment_length;
+        if (*segment == '.')
+        {
+            segment++;
+        }
+    }
+
+    value_end = skip_json_value(pointer, end, 0);
+    if (value_end == NULL)
+    {
+        return NULL;
+    }
+    if (value_length != NULL)
+    {
+        *value_length = (size_t)(value_end - pointer);
+    }
+
+    return (const char*)pointer;
+}
+
+CJSON_PUBLIC(char *) cJSON_UnescapeTo(char *output, const char *value, size_t value_length)
+{
+    const unsigned char *input = (const unsigned char*)value + 1;
+    unsigned char *output_end = NULL;
+
+    if ((output == NULL) || (value == NULL) || (value_length < 2) || (value[0] != '\"') || (value[value_length - 1] != '\"'))
+    {
+        return NULL;
+    }
+
+    output_end = unescape_string((unsigned char*)output, &input, (const unsigned char*)value + value_length - 1);
+    if (output_end == NULL)
+    {
+        return NULL;
+    }
+    *output_end = '\0';
+
+    return (char*)output_end;
+}
+
+/* Render the cstring provided to an escaped version that can be printed. */
+static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffer * const output_buffer)
+{
+    unsigned char *output = NULL;
+    size_t input_length = 0;
+    size_t output_length = 0;
+    /* numbers of additional characters needed for escaping */
+    size_t escape_characters = 0;
+
+    if (output_buffer == NULL)
+    {
+        return false;
+    }
+
+    /* empty string */
+    if (input == NULL)
+    {
+        output = ensure(output_buffer, sizeof("\"\""));
+        if (output == NULL)
+        {
+            return false;
+        }
+        strcpy((char*)output, "\"\"");
+
+        return true;
+    }
+
+    input_length = strlen((const char*)input);
+    escape_characters = escape_characters_needed(input, input_length);
+    output_length = input_length + escape_characters;
+
+    output = ensure(output_buffer, output_length + sizeof("\"\""));
+    if (output == NULL)
+    {
+        return false;
+    }
+
+    /* no characters have to be escaped */
+    if (escape_characters == 0)
+    {
+        output[0] = '\"';
+        memcpy(output + 1, input, output_length);
+        output[output_length + 1] = '\"';
+        output[output_length + 2] = '\0';
+
+        return true;
+    }
+
+    output[0] = '\"';
+    /* copy the string */
+    escape_string(output + 1, input, input_length);
     output[output_length + 1] = '\"';
     output[output_length + 2] = '\0';
 
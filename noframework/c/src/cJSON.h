@@ -295,6 +295,20 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
 /* Macro for iterating over an array or object */
 #define cJSON_ArrayForEach(element, array) for(element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
 
+/* String escaping without building a tree. cJSON_EscapedLength returns the size of the escaped form of length bytes of string (without quotes);
+ * cJSON_EscapeTo writes exactly that many bytes to output and returns a pointer just past them. Output matches cJSON_Print byte for byte. */
+CJSON_PUBLIC(size_t) cJSON_EscapedLength(const char *string, size_t length);
+CJSON_PUBLIC(char *) cJSON_EscapeTo(char *output, const char *string, size_t length);
+
+/* Pull-style access without building a tree. cJSON_FindPath scans length bytes of json for the value at path, object keys and
+ * array indexes separated by dots (e.g. "choices.0.message.content"), skipping everything else without allocating. It returns the
+ * first byte of the value and stores its length in value_length, or returns NULL if the path does not exist or the document is
+ * malformed on the way to it; the rest of the document is not validated. Keys match exactly, as in cJSON_GetObjectItemCaseSensitive.
+ * cJSON_UnescapeTo decodes a string value found that way (quotes included) into output, which needs value_length - 1 bytes, and
+ * zero-terminates it. It returns a pointer to the terminating zero, or NULL if the value is not a valid string. */
+CJSON_PUBLIC(const char *) cJSON_FindPath(const char *json, size_t length, const char *path, size_t *value_length);
+CJSON_PUBLIC(char *) cJSON_UnescapeTo(char *output, const char *value, size_t value_length);
+
 /* malloc/free objects using the malloc/free functions that have been set with cJSON_InitHooks */
 CJSON_PUBLIC(void *) cJSON_malloc(size_t size);
 CJSON_PUBLIC(void) cJSON_free(void *object);
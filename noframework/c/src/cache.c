@@ -0,0 +1,327 @@
+#include "cache.h"
+
+// Entry layout: header, dep_count signatures, key, value. Native byte
+// order; the cache is never shared between machines.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t dep_count;
+    uint32_t key_length;
+    uint64_t value_length;
+} CacheEntryHeader;
+
+static const char CACHE_MAGIC[4] = {'T', 'W', 'T', 'C'};
+
+static char* cache_directory = NULL;    // <cache-dir>/tool-cache
+static char* managed_root = NULL;       // normalized --cache-dir
+
+void tool_cache_init(const char* cache_dir) {
+    tool_cache_shutdown();
+    if (!cache_dir) return;
+    
+    managed_root = platform_normalize_path(cache_dir);
+    size_t length = strlen(managed_root) + sizeof("/tool-cache");
+    cache_directory = safe_malloc(length);
+    snprintf(cache_directory, length, "%s%ctool-cache", managed_root, PATH_SEPARATOR_CHAR);
+    
+    platform_make_directory(managed_root);
+    platform_make_directory(cache_directory);
+    if (!platform_is_directory(cache_directory)) {
+        log_message(LOG_WARNING, "Cannot create tool cache directory: %s", cache_directory);
+        tool_cache_shutdown();
+    }
+}
+
+void tool_cache_shutdown(void) {
+    free(cache_directory);
+    free(managed_root);
+    cache_directory = NULL;
+    managed_root = NULL;
+}
+
+bool tool_cache_enabled(void) {
+    return cache_directory != NULL;
+}
+
+bool tool_cache_is_managed(const char* path) {
+    if (!managed_root || !path) return false;
+    size_t root_length = strlen(managed_root);
+    return strncmp(path, managed_root, root_length) == 0 &&
+           (path[root_length] == '/' || path[root_length] == '\\');
+}
+
+static void entry_path(const char* key, char* path, size_t path_size) {
+    // FNV-1a; the full key is stored in the entry to rule out collisions
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    snprintf(path, path_size, "%s%c%016llx.twc", cache_directory, PATH_SEPARATOR_CHAR,
+             (unsigned long long)hash);
+}
+
+char* tool_cache_get(const char* key, const FileSignature* deps, size_t dep_count) {
+    if (!cache_directory) return NULL;
+    
+    char path[1024];
+    entry_path(key, path, sizeof(path));
+    
+    MappedFile mapped;
+    if (platform_map_file(path, &mapped) != 0) return NULL;
+    
+    char* value = NULL;
+    size_t key_length = strlen(key);
+    size_t deps_size = dep_count * sizeof(FileSignature);
+    const CacheEntryHeader* header = (const CacheEntryHeader*)mapped.data;
+    
+    if (mapped.size >= sizeof(CacheEntryHeader) &&
+        memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+        header->version == TOOL_CACHE_VERSION &&
+        header->dep_count == dep_count &&
+        header->key_length == key_length &&
+        mapped.size == sizeof(CacheEntryHeader) + deps_size + key_length + header->value_length) {
+        const char* stored_deps = mapped.data + sizeof(CacheEntryHeader);
+        const char* stored_key = stored_deps + deps_size;
+        const char* stored_value = stored_key + key_length;
+        
+        if (memcmp(stored_deps, deps, deps_size) == 0 && memcmp(stored_key, key, key_length) == 0) {
+            size_t value_length = (size_t)header->value_length;
+            value = safe_malloc(value_length + 1);
+            memcpy(value, stored_value, value_length);
+            value[value_length] = '\0';
+        }
+    }
+    
+    platform_unmap_file(&mapped);
+    return value;
+}
+
+void tool_cache_put(const char* key, const FileSignature* deps, size_t dep_count,
+                    const char* value, size_t length) {
+    if (!cache_directory) return;
+    
+    CacheEntryHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = TOOL_CACHE_VERSION;
+    header.dep_count = (uint32_t)dep_count;
+    header.key_length = (uint32_t)strlen(key);
+    header.value_length = length;
+    
+    size_t deps_size = dep_count * sizeof(FileSignature);
+    StringBuffer entry;
+    string_buffer_init(&entry, sizeof(header) + deps_size + header.key_length + length + 1);
+    string_buffer_append(&entry, (const char*)&header, sizeof(header));
+    string_buffer_append(&entry, (const char*)deps, deps_size);
+    string_buffer_append(&entry, key, header.key_length);
+    string_buffer_append(&entry, value, length);
+    
+    char path[1024];
+    entry_path(key, path, sizeof(path));
+    if (platform_write_file_atomic(path, entry.data, entry.size) != 0) {
+        log_message(LOG_WARNING, "Failed to write tool cache entry: %s", path);
+    }
+    
+    string_buffer_free(&entry);
+}
+
+void content_hash_init(ContentHash* hash) {
+    hash->a = 14695981039346656037ULL;
+    hash->b = 0x6a09e667f3bcc909ULL;
+}
+
+void content_hash_update(ContentHash* hash, const void* data, size_t length) {
+    const unsigned char* p = data;
+    uint64_t a = hash->a;
+    uint64_t b = hash->b;
+    for (size_t i = 0; i < length; i++) {
+        a = (a ^ p[i]) * 1099511628211ULL;
+        b = (b ^ p[i]) * 0x9e3779b97f4a7c15ULL;
+        b ^= b >> 29;
+    }
+    hash->a = a;
+    hash->b = b;
+}
+
+// Response entry layout: header, then the value
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t key_a;
+    uint64_t key_b;
+    uint64_t value_length;
+} ResponseEntryHeader;
+
+static const char RESPONSE_MAGIC[4] = {'T', 'W', 'R', 'C'};
+
+static char* response_directory = NULL;     // <cache-dir>/llm-cache
+static size_t response_max_bytes = 0;
+// Size of the directory at the last scan plus what this process stored
+// since; entries written by other processes are counted at the next scan
+static uint64_t response_total_bytes = 0;
+static PlatformMutex response_lock;
+
+static void response_cache_evict(void);
+
+void response_cache_init(const char* cache_dir, size_t max_bytes) {
+    response_cache_shutdown();
+    if (!cache_dir) return;
+    
+    char* root = platform_normalize_path(cache_dir);
+    size_t length = strlen(root) + sizeof("/llm-cache");
+    response_directory = safe_malloc(length);
+    snprintf(response_directory, length, "%s%cllm-cache", root, PATH_SEPARATOR_CHAR);
+    response_max_bytes = max_bytes;
+    
+    platform_make_directory(root);
+    platform_make_directory(response_directory);
+    free(root);
+    if (!platform_is_directory(response_directory)) {
+        log_message(LOG_WARNING, "Cannot create response cache directory: %s", response_directory);
+        free(response_directory);
+        response_directory = NULL;
+        return;
+    }
+    
+    platform_mutex_init(&response_lock);
+    response_cache_evict();
+}
+
+void response_cache_shutdown(void) {
+    if (!response_directory) return;
+    platform_mutex_destroy(&response_lock);
+    free(response_directory);
+    response_directory = NULL;
+}
+
+bool response_cache_enabled(void) {
+    return response_directory != NULL;
+}
+
+static void response_entry_path(const ContentHash* key, char* path, size_t path_size) {
+    snprintf(path, path_size, "%s%c%016llx%016llx.llm", response_directory, PATH_SEPARATOR_CHAR,
+             (unsigned long long)key->a, (unsigned long long)key->b);
+}
+
+char* response_cache_get(const ContentHash* key, size_t* length) {
+    if (!response_directory) return NULL;
+    
+    char path[1024];
+    response_entry_path(key, path, sizeof(path));
+    
+    MappedFile mapped;
+    if (platform_map_file(path, &mapped) != 0) return NULL;
+    
+    char* value = NULL;
+    const ResponseEntryHeader* header = (const ResponseEntryHeader*)mapped.data;
+    if (mapped.size >= sizeof(ResponseEntryHeader) &&
+        memcmp(header->magic, RESPONSE_MAGIC, sizeof(RESPONSE_MAGIC)) == 0 &&
+        header->version == RESPONSE_CACHE_VERSION &&
+        header->key_a == key->a && header->key_b == key->b &&
+        mapped.size == sizeof(ResponseEntryHeader) + header->value_length) {
+        *length = (size_t)header->value_length;
+        value = safe_malloc(*length + 1);
+        memcpy(value, mapped.data + sizeof(ResponseEntryHeader), *length);
+        value[*length] = '\0';
+    }
+    platform_unmap_file(&mapped);
+    
+    // The modification time doubles as the last-use time for eviction
+    if (value) platform_touch_file(path);
+    return value;
+}
+
+typedef struct {
+    char* path;
+    int64_t mtime_ns;
+    uint64_t size;
+} ResponseEntryInfo;
+
+typedef struct {
+    ResponseEntryInfo* entries;
+    size_t count;
+    size_t capacity;
+    uint64_t total;
+} ResponseEntryList;
+
+static void collect_response_entry(const char* name, void* userdata) {
+    ResponseEntryList* list = (ResponseEntryList*)userdata;
+    size_t name_length = strlen(name);
+    if (name_length < 4 || strcmp(name + name_length - 4, ".llm") != 0) return;
+    
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%c%s", response_directory, PATH_SEPARATOR_CHAR, name);
+    FileSignature signature;
+    if (platform_file_signature(path, &signature) != 0) return;
+    
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->entries = safe_realloc(list->entries, list->capacity * sizeof(ResponseEntryInfo));
+    }
+    ResponseEntryInfo* entry = &list->entries[list->count++];
+    entry->path = safe_strdup(path);
+    entry->mtime_ns = signature.mtime_ns;
+    entry->size = signature.size;
+    list->total += signature.size;
+}
+
+static int compare_entry_age(const void* a, const void* b) {
+    const ResponseEntryInfo* left = (const ResponseEntryInfo*)a;
+    const ResponseEntryInfo* right = (const ResponseEntryInfo*)b;
+    return (left->mtime_ns > right->mtime_ns) - (left->mtime_ns < right->mtime_ns);
+}
+
+// Measures the directory and, if it is over budget, drops least recently
+// used entries until it is back under 90%. Stores only call this when the
+// running total crosses the budget, and the slack keeps that infrequent.
+static void response_cache_evict(void) {
+    ResponseEntryList list = {0};
+    platform_list_directory(response_directory, collect_response_entry, &list);
+    
+    if (list.total > response_max_bytes) {
+        qsort(list.entries, list.count, sizeof(ResponseEntryInfo), compare_entry_age);
+        uint64_t target = response_max_bytes / 10 * 9;
+        size_t evicted = 0;
+        for (size_t i = 0; i < list.count && list.total > target; i++) {
+            if (remove(list.entries[i].path) == 0) {
+                list.total -= list.entries[i].size;
+                evicted++;
+            }
+        }
+        log_message(LOG_DEBUG, "Evicted %zu response cache entries", evicted);
+    }
+    response_total_bytes = list.total;
+    
+    for (size_t i = 0; i < list.count; i++) {
+        free(list.entries[i].path);
+    }
+    free(list.entries);
+}
+
+void response_cache_put(const ContentHash* key, const char* value, size_t length) {
+    if (!response_directory) return;
+    
+    ResponseEntryHeader header;
+    memcpy(header.magic, RESPONSE_MAGIC, sizeof(RESPONSE_MAGIC));
+    header.version = RESPONSE_CACHE_VERSION;
+    header.key_a = key->a;
+    header.key_b = key->b;
+    header.value_length = length;
+    
+    StringBuffer entry;
+    string_buffer_init(&entry, sizeof(header) + length + 1);
+    string_buffer_append(&entry, (const char*)&header, sizeof(header));
+    string_buffer_append(&entry, value, length);
+    
+    char path[1024];
+    response_entry_path(key, path, sizeof(path));
+    if (platform_write_file_atomic(path, entry.data, entry.size) != 0) {
+        log_message(LOG_WARNING, "Failed to write response cache entry: %s", path);
+    } else {
+        platform_mutex_lock(&response_lock);
+        response_total_bytes += entry.size;
+        if (response_total_bytes > response_max_bytes) response_cache_evict();
+        platform_mutex_unlock(&response_lock);
+    }
+    string_buffer_free(&entry);
+}
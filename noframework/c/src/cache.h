@@ -0,0 +1,55 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "platform.h"
+
+// On-disk cache of tool observations, kept under <cache-dir>/tool-cache so
+// repeated runs over the same clones skip re-reading, re-escaping and
+// re-walking. Each entry is one file: a fixed header, the signatures of
+// the files it was derived from, the key and the pre-escaped value. An
+// entry is valid while every signature still matches a fresh stat, so
+// staleness is checked without reading the sources.
+#define TOOL_CACHE_VERSION 1
+
+// Files smaller than this are cheaper to read than to look up
+#define TOOL_CACHE_MIN_FILE_SIZE (8 * 1024)
+
+// NULL disables the cache (the default)
+void tool_cache_init(const char* cache_dir);
+void tool_cache_shutdown(void);
+bool tool_cache_enabled(void);
+
+// True for paths below --cache-dir, i.e. clones made by clone_or_update_repo
+bool tool_cache_is_managed(const char* path);
+
+// Returns a heap copy of the cached value for key, or NULL when it is
+// missing or any dependency signature differs from the stored one
+char* tool_cache_get(const char* key, const FileSignature* deps, size_t dep_count);
+void tool_cache_put(const char* key, const FileSignature* deps, size_t dep_count,
+                    const char* value, size_t length);
+
+// 128-bit content hash (two independent 64-bit streams), used to address
+// LLM responses by the exact bytes of their request
+typedef struct {
+    uint64_t a;
+    uint64_t b;
+} ContentHash;
+
+void content_hash_init(ContentHash* hash);
+void content_hash_update(ContentHash* hash, const void* data, size_t length);
+
+// Content-addressed cache of LLM responses under <cache-dir>/llm-cache.
+// Identical requests at temperature 0 replay the stored completion; the
+// least recently used entries are evicted once the total exceeds max_bytes.
+#define RESPONSE_CACHE_VERSION 1
+#define RESPONSE_CACHE_DEFAULT_MAX_BYTES (256 * 1024 * 1024)
+
+void response_cache_init(const char* cache_dir, size_t max_bytes);
+void response_cache_shutdown(void);
+bool response_cache_enabled(void);
+
+// Returns a heap copy of the stored response (NUL-terminated) or NULL
+char* response_cache_get(const ContentHash* key, size_t* length);
+void response_cache_put(const ContentHash* key, const char* value, size_t length);
+
+#endif // CACHE_H
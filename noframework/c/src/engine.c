@@ -0,0 +1,205 @@
+#include "engine.h"
+
+typedef enum {
+    TASK_SETUP,
+    TASK_TOOLS,
+    TASK_FINISH
+} EngineTask;
+
+// One job; handed back and forth between the loop and the workers
+typedef struct EngineSlot {
+    void* job;
+    TechWriterAgent* agent;
+    EngineTask task;
+    struct EngineSlot* next;
+} EngineSlot;
+
+typedef struct {
+    EngineSlot* head;
+    EngineSlot* tail;
+} SlotQueue;
+
+typedef struct {
+    const EngineConfig* config;
+    HttpMulti* multi;
+    PlatformMutex lock;
+    PlatformCond work_ready;
+    SlotQueue work;         // tasks for the workers
+    SlotQueue completed;    // tasks done, back to the loop
+    bool stopping;
+} Engine;
+
+static void slot_queue_push(SlotQueue* queue, EngineSlot* slot) {
+    slot->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = slot;
+    } else {
+        queue->head = slot;
+    }
+    queue->tail = slot;
+}
+
+static EngineSlot* slot_queue_pop(SlotQueue* queue) {
+    EngineSlot* slot = queue->head;
+    if (slot) {
+        queue->head = slot->next;
+        if (!queue->head) queue->tail = NULL;
+    }
+    return slot;
+}
+
+static void engine_submit(Engine* engine, EngineSlot* slot, EngineTask task) {
+    slot->task = task;
+    platform_mutex_lock(&engine->lock);
+    slot_queue_push(&engine->work, slot);
+    platform_cond_broadcast(&engine->work_ready);
+    platform_mutex_unlock(&engine->lock);
+}
+
+static void* engine_worker(void* arg) {
+    Engine* engine = (Engine*)arg;
+    const EngineConfig* config = engine->config;
+    
+    platform_mutex_lock(&engine->lock);
+    while (true) {
+        while (!engine->work.head && !engine->stopping) {
+            platform_cond_wait(&engine->work_ready, &engine->lock);
+        }
+        EngineSlot* slot = slot_queue_pop(&engine->work);
+        if (!slot) break;
+        platform_mutex_unlock(&engine->lock);
+        
+        switch (slot->task) {
+            case TASK_SETUP:
+                slot->agent = config->setup(slot->job);
+                if (slot->agent) {
+                    // Parallelism comes from running many agents at once,
+                    // not from threads of each
+                    slot->agent->parallel_tools = false;
+                    slot->agent->prefetch_reads = false;
+                }
+                break;
+            case TASK_TOOLS:
+                agent_step_tools(slot->agent);
+                break;
+            case TASK_FINISH:
+                config->finish(slot->job, slot->agent ? agent_finish(slot->agent) : NULL);
+                slot->agent = NULL;
+                break;
+        }
+        
+        platform_mutex_lock(&engine->lock);
+        slot_queue_push(&engine->completed, slot);
+        http_multi_wakeup(engine->multi);
+    }
+    platform_mutex_unlock(&engine->lock);
+    
+    return NULL;
+}
+
+// Move an agent on from where the loop found it: send its next request,
+// or hand it to the workers for tools or finishing
+static void engine_advance(Engine* engine, EngineSlot* slot) {
+    TechWriterAgent* agent = slot->agent;
+    
+    while (agent->state == AGENT_READY) {
+        HttpTransfer* transfer = agent_step_begin(agent);
+        if (transfer) {
+            http_multi_add(engine->multi, transfer, slot);
+            return;
+        }
+    }
+    
+    engine_submit(engine, slot, agent->state == AGENT_RUNNING_TOOLS ? TASK_TOOLS : TASK_FINISH);
+}
+
+static void engine_transfer_done(void* owner, HttpResponse* response, void* userdata) {
+    EngineSlot* slot = (EngineSlot*)owner;
+    agent_step_response(slot->agent, response);
+    engine_advance((Engine*)userdata, slot);
+}
+
+void engine_run(const EngineConfig* config, void** jobs, size_t job_count) {
+    if (job_count == 0) return;
+    
+    Engine engine = {0};
+    engine.config = config;
+    engine.multi = http_multi_create();
+    if (!engine.multi) {
+        log_message(LOG_ERROR, "Cannot create the HTTP event loop");
+        for (size_t i = 0; i < job_count; i++) {
+            config->finish(jobs[i], NULL);
+        }
+        return;
+    }
+    platform_mutex_init(&engine.lock);
+    platform_cond_init(&engine.work_ready);
+    
+    EngineSlot* slots = safe_calloc(job_count, sizeof(EngineSlot));
+    size_t max_active = config->max_active > 0 ? config->max_active : 1;
+    
+    int thread_count = config->worker_threads > 0 ? config->worker_threads : 1;
+    PlatformThread* threads = safe_calloc((size_t)thread_count, sizeof(PlatformThread));
+    bool* started = safe_calloc((size_t)thread_count, sizeof(bool));
+    for (int i = 0; i < thread_count; i++) {
+        started[i] = platform_thread_create(&threads[i], engine_worker, &engine) == 0;
+    }
+    
+    log_message(LOG_INFO, "Running %zu analyses, up to %zu at once, on %d worker threads",
+                job_count, max_active, thread_count);
+    
+    size_t admitted = 0;
+    size_t finished = 0;
+    size_t active = 0;
+    size_t peak = 0;
+    
+    while (finished < job_count) {
+        while (active < max_active && admitted < job_count) {
+            EngineSlot* slot = &slots[admitted];
+            slot->job = jobs[admitted++];
+            active++;
+            engine_submit(&engine, slot, TASK_SETUP);
+        }
+        if (active > peak) peak = active;
+        
+        platform_mutex_lock(&engine.lock);
+        SlotQueue completed = engine.completed;
+        engine.completed.head = NULL;
+        engine.completed.tail = NULL;
+        platform_mutex_unlock(&engine.lock);
+        
+        EngineSlot* slot;
+        while ((slot = slot_queue_pop(&completed)) != NULL) {
+            if (slot->task == TASK_FINISH) {
+                finished++;
+                active--;
+            } else if (!slot->agent) {
+                engine_submit(&engine, slot, TASK_FINISH);
+            } else {
+                engine_advance(&engine, slot);
+            }
+        }
+        
+        if (finished < job_count) {
+            // Worker completions interrupt the wait through http_multi_wakeup
+            http_multi_poll(engine.multi, 1000, engine_transfer_done, &engine);
+        }
+    }
+    
+    platform_mutex_lock(&engine.lock);
+    engine.stopping = true;
+    platform_cond_broadcast(&engine.work_ready);
+    platform_mutex_unlock(&engine.lock);
+    for (int i = 0; i < thread_count; i++) {
+        if (started[i]) platform_thread_join(threads[i]);
+    }
+    
+    log_message(LOG_INFO, "All %zu analyses finished (at most %zu in flight)", job_count, peak);
+    
+    free(threads);
+    free(started);
+    free(slots);
+    platform_cond_destroy(&engine.work_ready);
+    platform_mutex_destroy(&engine.lock);
+    http_multi_destroy(engine.multi);
+}
@@ -0,0 +1,29 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "agent.h"
+
+// Event-driven runner for many concurrent analyses. The calling thread
+// drives the LLM requests of every agent through one curl_multi loop;
+// setup, tool calls and writing results run on a small pool of worker
+// threads. An agent waiting for the LLM costs a curl handle and its
+// memory rather than a blocked thread.
+
+// Runs on a worker: prepare a job (clone, create the agent, agent_start)
+// and return its agent, or NULL if the job cannot run
+typedef TechWriterAgent* (*EngineSetupFunc)(void* job);
+// Runs on a worker once a job is over and takes ownership of final_answer,
+// which is NULL when setup failed
+typedef void (*EngineFinishFunc)(void* job, char* final_answer);
+
+typedef struct {
+    size_t max_active;      // analyses in flight at once
+    int worker_threads;
+    EngineSetupFunc setup;
+    EngineFinishFunc finish;
+} EngineConfig;
+
+// Returns once every job has been finished
+void engine_run(const EngineConfig* config, void** jobs, size_t job_count);
+
+#endif // ENGINE_H
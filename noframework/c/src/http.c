@@ -1,30 +1,437 @@
 #include "http.h"
+#include "cJSON.h"
+#include <ctype.h>
 #include <string.h>
+#include <time.h>
+
+// Room for size more bytes and a terminator
+static void response_reserve(HttpResponse* response, size_t size) {
+    while (response->size + size >= response->capacity) {
+        response->capacity *= 2;
+        response->data = safe_realloc(response->data, response->capacity);
+    }
+}
+
+static void response_append(HttpResponse* response, const char* data, size_t size) {
+    response_reserve(response, size);
+    memcpy(&(response->data[response->size]), data, size);
+    response->size += size;
+    response->data[response->size] = 0;
+}
 
 static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
     size_t real_size = size * nmemb;
     HttpResponse* response = (HttpResponse*)userp;
     
-    // Resize buffer if needed
-    while (response->size + real_size >= response->capacity) {
-        response->capacity *= 2;
-        response->data = safe_realloc(response->data, response->capacity);
+    response_append(response, contents, real_size);
+    
+    return real_size;
+}
+
+// Server-sent events state for a streamed chat completion
+typedef struct {
+    CURL* curl;
+    HttpResponse* response;
+    StringBuffer line;
+    HttpStreamCallback callback;
+    void* userdata;
+    bool status_checked;
+    bool raw;       // error status: keep the body verbatim
+    bool done;      // saw "data: [DONE]"
+    bool stopped;   // callback asked to stop
+    bool delivered; // content reached the callback, so the request cannot be retried
+} SseStream;
+
+static void sse_handle_line(SseStream* stream, const char* line) {
+    // Only data fields carry payload; ignore comments, ids and event names
+    if (!string_starts_with(line, "data:")) return;
+    line += 5;
+    if (*line == ' ') line++;
+    
+    if (strcmp(line, "[DONE]") == 0) {
+        stream->done = true;
+        return;
     }
     
-    memcpy(&(response->data[response->size]), contents, real_size);
-    response->size += real_size;
-    response->data[response->size] = 0;
+    // Only choices[0].delta.content is needed; it is unescaped straight onto
+    // the end of the response instead of through a tree of the event
+    if (*line != '{') {
+        log_message(LOG_WARNING, "Ignoring malformed stream event: %s", line);
+        return;
+    }
+    size_t length = 0;
+    const char* content = cJSON_FindPath(line, strlen(line), "choices.0.delta.content", &length);
+    if (!content || *content != '"' || length <= 2) return;
     
-    return real_size;
+    HttpResponse* response = stream->response;
+    size_t delta_start = response->size;
+    response_reserve(response, length);
+    char* end = cJSON_UnescapeTo(response->data + delta_start, content, length);
+    if (!end) {
+        response->data[delta_start] = '\0';
+        log_message(LOG_WARNING, "Ignoring malformed stream event: %s", line);
+        return;
+    }
+    response->size = end - response->data;
+    stream->delivered = true;
+    
+    if (stream->callback &&
+        !stream->callback(response->data, response->size, delta_start, stream->userdata)) {
+        stream->stopped = true;
+    }
+}
+
+static size_t stream_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t real_size = size * nmemb;
+    SseStream* stream = (SseStream*)userp;
+    
+    if (!stream->status_checked) {
+        curl_easy_getinfo(stream->curl, CURLINFO_RESPONSE_CODE, &stream->response->status_code);
+        stream->raw = stream->response->status_code != 200;
+        stream->status_checked = true;
+    }
+    
+    if (stream->raw) {
+        response_append(stream->response, contents, real_size);
+        return real_size;
+    }
+    
+    const char* data = contents;
+    for (size_t i = 0; i < real_size && !stream->stopped && !stream->done; i++) {
+        // Whole segments up to the next line end; a line cut across chunks
+        // stays buffered until the rest arrives
+        const char* newline = memchr(data + i, '\n', real_size - i);
+        size_t end = newline ? (size_t)(newline - data) : real_size;
+        string_buffer_append(&stream->line, data + i, end - i);
+        i = end;
+        if (!newline) break;
+        
+        if (stream->line.size > 0 && stream->line.data[stream->line.size - 1] == '\r') {
+            stream->line.data[--stream->line.size] = '\0';
+        }
+        sse_handle_line(stream, stream->line.data);
+        string_buffer_clear(&stream->line);
+    }
+    
+    // Returning a short count makes curl abort the transfer
+    return stream->stopped ? 0 : real_size;
+}
+
+static HttpResponse* http_response_create(void) {
+    HttpResponse* response = safe_calloc(1, sizeof(HttpResponse));
+    response->capacity = 4096;
+    response->data = safe_malloc(response->capacity);
+    response->data[0] = '\0';
+    response->size = 0;
+    return response;
+}
+
+static size_t read_callback(char* buffer, size_t size, size_t nitems, void* userp);
+
+static void share_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userp) {
+    (void)handle;
+    (void)access;
+    HttpPool* pool = (HttpPool*)userp;
+    platform_mutex_lock(&pool->share_locks[data]);
+}
+
+static void share_unlock(CURL* handle, curl_lock_data data, void* userp) {
+    (void)handle;
+    HttpPool* pool = (HttpPool*)userp;
+    platform_mutex_unlock(&pool->share_locks[data]);
+}
+
+static HttpRateLimit* rate_limit_create(void) {
+    HttpRateLimit* limit = safe_calloc(1, sizeof(HttpRateLimit));
+    platform_mutex_init(&limit->lock);
+    for (int i = 0; i < HTTP_RATE_WINDOW; i++) {
+        limit->bucket_second[i] = -1;
+    }
+    limit->server_requests = -1;
+    limit->server_tokens = -1;
+    return limit;
+}
+
+static void rate_limit_destroy(HttpRateLimit* limit) {
+    platform_mutex_destroy(&limit->lock);
+    free(limit);
+}
+
+static bool http_initialized = false;
+
+void http_global_init(void) {
+    if (http_initialized) return;
+    http_initialized = true;
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+void http_global_cleanup(void) {
+    if (!http_initialized) return;
+    http_initialized = false;
+    curl_global_cleanup();
+}
+
+HttpPool* http_pool_create(void) {
+    HttpPool* pool = safe_calloc(1, sizeof(HttpPool));
+    
+    http_global_init();
+    pool->share = curl_share_init();
+    if (!pool->share) {
+        free(pool);
+        return NULL;
+    }
+    
+    // Resolved names, TLS sessions and open connections are shared by every
+    // handle attached to this pool
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        platform_mutex_init(&pool->share_locks[i]);
+    }
+    curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(pool->share, CURLSHOPT_USERDATA, pool);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    
+    pool->rate_limit = rate_limit_create();
+    pool->owns_rate_limit = true;
+    return pool;
+}
+
+HttpPool* http_pool_create_linked(HttpPool* parent) {
+    HttpPool* pool = http_pool_create();
+    if (pool && parent) {
+        rate_limit_destroy(pool->rate_limit);
+        pool->rate_limit = parent->rate_limit;
+        pool->owns_rate_limit = false;
+        pool->hedge_after_ms = parent->hedge_after_ms;
+    }
+    return pool;
+}
+
+void http_pool_destroy(HttpPool* pool) {
+    if (!pool) return;
+    
+    curl_share_cleanup(pool->share);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        platform_mutex_destroy(&pool->share_locks[i]);
+    }
+    
+    if (pool->owns_rate_limit) {
+        rate_limit_destroy(pool->rate_limit);
+    }
+    
+    free(pool);
+}
+
+void http_pool_set_rate_limit(HttpPool* pool, long requests_per_minute, long tokens_per_minute) {
+    if (!pool) return;
+    
+    HttpRateLimit* limit = pool->rate_limit;
+    platform_mutex_lock(&limit->lock);
+    limit->requests_per_minute = requests_per_minute > 0 ? requests_per_minute : 0;
+    limit->tokens_per_minute = tokens_per_minute > 0 ? tokens_per_minute : 0;
+    platform_mutex_unlock(&limit->lock);
+}
+
+void http_pool_set_hedging(HttpPool* pool, long hedge_after_ms) {
+    if (!pool) return;
+    pool->hedge_after_ms = hedge_after_ms > 0 ? hedge_after_ms : 0;
+}
+
+// Current-second bucket, recycling it if it last held an older second
+static int rate_bucket(HttpRateLimit* limit, int64_t now) {
+    int index = (int)(now % HTTP_RATE_WINDOW);
+    if (limit->bucket_second[index] != now) {
+        limit->bucket_second[index] = now;
+        limit->bucket_requests[index] = 0;
+        limit->bucket_tokens[index] = 0;
+    }
+    return index;
+}
+
+// Count one more request of about `tokens` tokens if it fits the window
+// and what the provider has left, and no Retry-After is running
+static bool rate_limit_try_acquire(HttpRateLimit* limit, long tokens) {
+    platform_mutex_lock(&limit->lock);
+    uint64_t now_ms = platform_monotonic_ms();
+    int64_t now = (int64_t)(now_ms / 1000);
+    long requests = 0;
+    long used = 0;
+    for (int i = 0; i < HTTP_RATE_WINDOW; i++) {
+        if (limit->bucket_second[i] > now - HTTP_RATE_WINDOW) {
+            requests += limit->bucket_requests[i];
+            used += limit->bucket_tokens[i];
+        }
+    }
+    
+    // The provider's buckets are full again after their reset times
+    if (limit->server_requests >= 0 && now_ms >= limit->server_requests_reset_ms) limit->server_requests = -1;
+    if (limit->server_tokens >= 0 && now_ms >= limit->server_tokens_reset_ms) limit->server_tokens = -1;
+    
+    // A request larger than the whole budget still goes out on an empty window
+    bool paused = now_ms < limit->paused_until_ms;
+    bool server_fits = limit->server_requests != 0 &&
+                       (limit->server_tokens < 0 || limit->server_tokens >= tokens);
+    bool fits = !paused && server_fits &&
+                (limit->requests_per_minute == 0 || requests < limit->requests_per_minute) &&
+                (limit->tokens_per_minute == 0 || used + tokens <= limit->tokens_per_minute || used == 0);
+    if (fits) {
+        int index = rate_bucket(limit, now);
+        limit->bucket_requests[index]++;
+        limit->bucket_tokens[index] += tokens;
+        if (limit->server_requests > 0) limit->server_requests--;
+        if (limit->server_tokens > 0) limit->server_tokens -= tokens < limit->server_tokens ? tokens : limit->server_tokens;
+    } else if (!limit->limited && paused) {
+        log_message(LOG_INFO, "Holding requests for %.1f s, as the provider asked",
+                    (double)(limit->paused_until_ms - now_ms) / 1000.0);
+    } else if (!limit->limited && !server_fits) {
+        log_message(LOG_INFO, "Provider rate limit reached (%ld requests, %ld tokens left), waiting for its reset",
+                    limit->server_requests, limit->server_tokens);
+    } else if (!limit->limited) {
+        log_message(LOG_INFO, "Rate limit reached (%ld requests, %ld tokens in the last minute), waiting",
+                    requests, used);
+    }
+    limit->limited = !fits;
+    platform_mutex_unlock(&limit->lock);
+    return fits;
+}
+
+static void rate_limit_record(HttpRateLimit* limit, long tokens) {
+    platform_mutex_lock(&limit->lock);
+    int index = rate_bucket(limit, (int64_t)(platform_monotonic_ms() / 1000));
+    limit->bucket_tokens[index] += tokens;
+    platform_mutex_unlock(&limit->lock);
+}
+
+// Rate limit headers of one response; negative when absent
+typedef struct {
+    long remaining_requests;
+    long remaining_tokens;
+    double reset_requests_ms;
+    double reset_tokens_ms;
+    double retry_after_ms;
+} RateHeaders;
+
+static void rate_headers_reset(RateHeaders* headers) {
+    headers->remaining_requests = -1;
+    headers->remaining_tokens = -1;
+    headers->reset_requests_ms = -1;
+    headers->reset_tokens_ms = -1;
+    headers->retry_after_ms = -1;
+}
+
+// The provider's word on what is left replaces the estimate, and a
+// Retry-After on 429 or 503 holds every request of the pool
+static void rate_limit_observe(HttpRateLimit* limit, const RateHeaders* headers, long status_code) {
+    platform_mutex_lock(&limit->lock);
+    uint64_t now_ms = platform_monotonic_ms();
+    if (headers->remaining_requests >= 0) {
+        limit->server_requests = headers->remaining_requests;
+        limit->server_requests_reset_ms = now_ms + (uint64_t)(headers->reset_requests_ms >= 0 ? headers->reset_requests_ms : 1000);
+    }
+    if (headers->remaining_tokens >= 0) {
+        limit->server_tokens = headers->remaining_tokens;
+        limit->server_tokens_reset_ms = now_ms + (uint64_t)(headers->reset_tokens_ms >= 0 ? headers->reset_tokens_ms : 1000);
+    }
+    if ((status_code == 429 || status_code == 503) && headers->retry_after_ms > 0 &&
+        headers->retry_after_ms <= HTTP_RETRY_AFTER_MAX_MS) {
+        uint64_t until = now_ms + (uint64_t)headers->retry_after_ms;
+        if (until > limit->paused_until_ms) limit->paused_until_ms = until;
+    }
+    platform_mutex_unlock(&limit->lock);
+}
+
+// Durations as OpenAI writes them ("20ms", "1.5s", "6m0s"); plain numbers are seconds
+static double parse_duration_ms(const char* text) {
+    double total = 0;
+    bool any = false;
+    while (*text) {
+        char* end = NULL;
+        double value = strtod(text, &end);
+        if (end == text) break;
+        any = true;
+        if (strncmp(end, "ms", 2) == 0) {
+            total += value;
+            end += 2;
+        } else if (*end == 'h') {
+            total += value * 3600000.0;
+            end++;
+        } else if (*end == 'm') {
+            total += value * 60000.0;
+            end++;
+        } else {
+            total += value * 1000.0;
+            if (*end == 's') end++;
+        }
+        text = end;
+    }
+    return any ? total : -1;
+}
+
+// Value of header line `name: value` (name case-insensitive), trimmed into value
+static bool header_value(const char* line, size_t length, const char* name, char* value, size_t size) {
+    size_t name_length = strlen(name);
+    if (length <= name_length || line[name_length] != ':') return false;
+    for (size_t i = 0; i < name_length; i++) {
+        if (tolower((unsigned char)line[i]) != name[i]) return false;
+    }
+    
+    const char* start = line + name_length + 1;
+    const char* end = line + length;
+    while (start < end && (*start == ' ' || *start == '\t')) start++;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+    size_t value_length = (size_t)(end - start) < size - 1 ? (size_t)(end - start) : size - 1;
+    memcpy(value, start, value_length);
+    value[value_length] = '\0';
+    return true;
+}
+
+static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userp) {
+    size_t length = size * nitems;
+    RateHeaders* headers = (RateHeaders*)userp;
+    char value[128];
+    
+    if (length > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        // A new response (after a 1xx) starts over
+        rate_headers_reset(headers);
+    } else if (header_value(buffer, length, "x-ratelimit-remaining-requests", value, sizeof(value))) {
+        headers->remaining_requests = strtol(value, NULL, 10);
+    } else if (header_value(buffer, length, "x-ratelimit-remaining-tokens", value, sizeof(value))) {
+        headers->remaining_tokens = strtol(value, NULL, 10);
+    } else if (header_value(buffer, length, "x-ratelimit-reset-requests", value, sizeof(value))) {
+        headers->reset_requests_ms = parse_duration_ms(value);
+    } else if (header_value(buffer, length, "x-ratelimit-reset-tokens", value, sizeof(value))) {
+        headers->reset_tokens_ms = parse_duration_ms(value);
+    } else if (header_value(buffer, length, "retry-after-ms", value, sizeof(value))) {
+        headers->retry_after_ms = strtod(value, NULL);
+    } else if (header_value(buffer, length, "retry-after", value, sizeof(value)) && headers->retry_after_ms < 0) {
+        // Seconds or an HTTP date
+        if (isdigit((unsigned char)value[0])) {
+            headers->retry_after_ms = strtod(value, NULL) * 1000.0;
+        } else {
+            time_t when = curl_getdate(value, NULL);
+            time_t now = time(NULL);
+            if (when > 0) headers->retry_after_ms = when > now ? (double)(when - now) * 1000.0 : 0;
+        }
+    }
+    
+    return length;
 }
 
 HttpClient* http_client_create(const char* base_url, const char* api_key) {
+    return http_client_create_pooled(base_url, api_key, NULL);
+}
+
+HttpClient* http_client_create_pooled(const char* base_url, const char* api_key, HttpPool* pool) {
     HttpClient* client = safe_calloc(1, sizeof(HttpClient));
     
     // Initialize CURL
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    client->curl = curl_easy_init();
+    client->pool = pool ? pool : http_pool_create();
+    client->owns_pool = pool == NULL;
+    client->curl = client->pool ? curl_easy_init() : NULL;
     if (!client->curl) {
+        if (client->owns_pool) http_pool_destroy(client->pool);
         free(client);
         return NULL;
     }
@@ -36,11 +443,34 @@ HttpClient* http_client_create(const char* base_url, const char* api_key) {
     client->headers = NULL;
     client->headers = curl_slist_append(client->headers, "Content-Type: application/json");
     client->headers = curl_slist_append(client->headers, "Accept: application/json");
+    // Bodies are uploaded through a read callback; skip the 100-continue round trip
+    client->headers = curl_slist_append(client->headers, "Expect:");
     
     char auth_header[256];
     snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", api_key);
     client->headers = curl_slist_append(client->headers, auth_header);
     
+    // Options that are the same for every request are set once here
+    CURL* curl = client->curl;
+    curl_easy_setopt(curl, CURLOPT_SHARE, client->pool->share);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client->headers);
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    // HTTP/2 over TLS when the server offers it, HTTP/1.1 otherwise
+    // CURLOPT_PIPEWAIT is only set for HttpMulti transfers: with the connection
+    // cache shared between threads, a blocking handle waiting to multiplex on
+    // another thread's connection is never woken
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    // Empty string: offer every encoding this libcurl can decode
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    // Keep idle connections alive between agent steps
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 30L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 15L);
+    
     return client;
 }
 
@@ -51,6 +481,10 @@ void http_client_destroy(HttpClient* client) {
         curl_easy_cleanup(client->curl);
     }
     
+    if (client->owns_pool) {
+        http_pool_destroy(client->pool);
+    }
+    
     if (client->headers) {
         curl_slist_free_all(client->headers);
     }
@@ -58,47 +492,342 @@ void http_client_destroy(HttpClient* client) {
     free(client->base_url);
     free(client->api_key);
     free(client);
+}
+
+static double timing_ms(CURL* curl, CURLINFO info) {
+    curl_off_t us = 0;
+    curl_easy_getinfo(curl, info, &us);
+    return (double)us / 1000.0;
+}
+
+static void record_timing(HttpClient* client, CURL* curl, HttpTiming* timing) {
+    // curl reports cumulative times since the start of the transfer
+    double dns = timing_ms(curl, CURLINFO_NAMELOOKUP_TIME_T);
+    double connect = timing_ms(curl, CURLINFO_CONNECT_TIME_T);
+    double tls = timing_ms(curl, CURLINFO_APPCONNECT_TIME_T);
     
-    curl_global_cleanup();
+    long new_connections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+    
+    timing->reused = new_connections == 0;
+    timing->ms[HTTP_PHASE_DNS] = dns;
+    timing->ms[HTTP_PHASE_CONNECT] = connect > dns ? connect - dns : 0;
+    timing->ms[HTTP_PHASE_TLS] = tls > connect ? tls - connect : 0;
+    timing->ms[HTTP_PHASE_TTFB] = timing_ms(curl, CURLINFO_STARTTRANSFER_TIME_T);
+    timing->ms[HTTP_PHASE_TOTAL] = timing_ms(curl, CURLINFO_TOTAL_TIME_T);
+    
+    HttpTimingHistogram* histogram = &client->timing;
+    histogram->requests++;
+    if (timing->reused) histogram->reused++;
+    
+    for (int phase = 0; phase < HTTP_PHASE_COUNT; phase++) {
+        double ms = timing->ms[phase];
+        int bucket = 0;
+        while (bucket < HTTP_TIMING_BUCKETS - 1 && ms >= (double)(1UL << bucket)) bucket++;
+        histogram->counts[phase][bucket]++;
+        histogram->sum_ms[phase] += ms;
+        if (ms > histogram->max_ms[phase]) histogram->max_ms[phase] = ms;
+    }
+    
+    log_message(LOG_DEBUG, "HTTP timing: dns %.1f ms, connect %.1f ms, tls %.1f ms, "
+                "ttfb %.1f ms, total %.1f ms%s",
+                timing->ms[HTTP_PHASE_DNS], timing->ms[HTTP_PHASE_CONNECT], timing->ms[HTTP_PHASE_TLS],
+                timing->ms[HTTP_PHASE_TTFB], timing->ms[HTTP_PHASE_TOTAL],
+                timing->reused ? " (reused connection)" : "");
 }
 
-HttpResponse* http_post_json(HttpClient* client, const char* endpoint, const char* json_payload) {
-    if (!client || !client->curl || !endpoint || !json_payload) return NULL;
+void http_client_log_timing(const HttpClient* client) {
+    if (!client || client->timing.requests == 0) return;
     
-    HttpResponse* response = safe_calloc(1, sizeof(HttpResponse));
-    response->capacity = 4096;
-    response->data = safe_malloc(response->capacity);
-    response->size = 0;
+    static const char* phase_names[HTTP_PHASE_COUNT] = {"dns", "connect", "tls", "ttfb", "total"};
+    const HttpTimingHistogram* histogram = &client->timing;
     
-    // Build full URL
+    log_message(LOG_INFO, "HTTP requests: %zu (%zu on reused connections)",
+                histogram->requests, histogram->reused);
+    
+    for (int phase = 0; phase < HTTP_PHASE_COUNT; phase++) {
+        char buckets[512];
+        size_t used = 0;
+        buckets[0] = '\0';
+        
+        for (int i = 0; i < HTTP_TIMING_BUCKETS && used < sizeof(buckets); i++) {
+            size_t count = histogram->counts[phase][i];
+            if (count == 0) continue;
+            if (i == HTTP_TIMING_BUCKETS - 1) {
+                used += snprintf(buckets + used, sizeof(buckets) - used, " >=%lu:%zu",
+                                 1UL << (i - 1), count);
+            } else {
+                used += snprintf(buckets + used, sizeof(buckets) - used, " <%lu:%zu", 1UL << i, count);
+            }
+        }
+        
+        log_message(LOG_INFO, "  %-7s mean %8.1f ms, max %8.1f ms |%s", phase_names[phase],
+                    histogram->sum_ms[phase] / histogram->requests, histogram->max_ms[phase], buckets);
+    }
+}
+
+// Feeds a list of body parts to curl as one contiguous upload
+typedef struct {
+    const HttpBodyPart* parts;
+    size_t count;
+    size_t index;
+    size_t offset;
+} BodyReader;
+
+static size_t read_callback(char* buffer, size_t size, size_t nitems, void* userp) {
+    BodyReader* reader = (BodyReader*)userp;
+    size_t room = size * nitems;
+    size_t written = 0;
+    
+    while (written < room && reader->index < reader->count) {
+        const HttpBodyPart* part = &reader->parts[reader->index];
+        size_t available = part->size - reader->offset;
+        size_t chunk = available < room - written ? available : room - written;
+        
+        memcpy(buffer + written, part->data + reader->offset, chunk);
+        written += chunk;
+        reader->offset += chunk;
+        
+        if (reader->offset == part->size) {
+            reader->index++;
+            reader->offset = 0;
+        }
+    }
+    
+    return written;
+}
+
+// curl rewinds the body when it has to send the request again on its own,
+// e.g. after a reused connection turns out to be dead or a stream is refused
+static int seek_callback(void* userp, curl_off_t offset, int origin) {
+    BodyReader* reader = (BodyReader*)userp;
+    if (origin != SEEK_SET || offset != 0) return CURL_SEEKFUNC_CANTSEEK;
+    
+    reader->index = 0;
+    reader->offset = 0;
+    return CURL_SEEKFUNC_OK;
+}
+
+// Everything curl's callbacks need while one request is in flight
+struct HttpTransfer {
+    HttpClient* client;
+    CURL* curl;                     // the client's handle, or a copy for a hedge
+    HttpResponse* response;
+    BodyReader reader;
+    SseStream sse;
+    RateHeaders rate_headers;
+    bool stream;
+    curl_off_t body_size;
     char url[1024];
-    snprintf(url, sizeof(url), "%s%s", client->base_url, endpoint);
+    int attempt;                    // 1-based
+    uint64_t random;                // backoff jitter
+    void* owner;                    // HttpMulti: handed back on completion
+    struct HttpTransfer* next;      // HttpMulti: held back, failed or retrying
+    uint64_t started_ms;            // HttpMulti: the attempt in flight
+    uint64_t retry_at_ms;
+    struct HttpTransfer* prev_in_flight;
+    struct HttpTransfer* next_in_flight;
+    struct HttpTransfer* hedge;     // second copy of this request in flight
+    struct HttpTransfer* primary;   // set on the hedge itself
+    bool hedge_sent;                // once per attempt
+    bool awaiting_hedge;            // failed while its hedge still runs
+    CURLcode result;
+};
+
+HttpTransfer* http_transfer_create(HttpClient* client, const char* endpoint,
+                                   const HttpBodyPart* parts, size_t part_count,
+                                   bool stream, HttpStreamCallback callback, void* userdata) {
+    if (!client || !client->curl || !endpoint || !parts) return NULL;
     
-    // Set CURL options
-    curl_easy_setopt(client->curl, CURLOPT_URL, url);
-    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->headers);
-    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDS, json_payload);
-    curl_easy_setopt(client->curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(client->curl, CURLOPT_WRITEDATA, response);
-    curl_easy_setopt(client->curl, CURLOPT_TIMEOUT, 120L);
-    curl_easy_setopt(client->curl, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(client->curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    HttpTransfer* transfer = safe_calloc(1, sizeof(HttpTransfer));
+    transfer->client = client;
+    transfer->curl = client->curl;
+    transfer->response = http_response_create();
+    transfer->stream = stream;
+    transfer->attempt = 1;
+    transfer->random = platform_monotonic_ns() ^ (uint64_t)(uintptr_t)transfer;
+    rate_headers_reset(&transfer->rate_headers);
     
-    // Perform request
-    CURLcode res = curl_easy_perform(client->curl);
+    // Build full URL
+    snprintf(transfer->url, sizeof(transfer->url), "%s%s", client->base_url, endpoint);
     
+    transfer->reader.parts = parts;
+    transfer->reader.count = part_count;
+    for (size_t i = 0; i < part_count; i++) {
+        transfer->body_size += (curl_off_t)parts[i].size;
+    }
+    
+    transfer->sse.curl = client->curl;
+    transfer->sse.response = transfer->response;
+    transfer->sse.callback = callback;
+    transfer->sse.userdata = userdata;
+    if (stream) {
+        string_buffer_init(&transfer->sse.line, 1024);
+    }
+    
+    return transfer;
+}
+
+// Prompt tokens are estimated at four bytes each
+static long transfer_tokens(const HttpTransfer* transfer) {
+    return (long)(transfer->body_size / 4);
+}
+
+static void transfer_prepare(HttpTransfer* transfer) {
+    CURL* curl = transfer->curl;
+    
+    // Set per-request CURL options; the rest are set in http_client_create
+    curl_easy_setopt(curl, CURLOPT_URL, transfer->url);
+    curl_easy_setopt(curl, CURLOPT_READDATA, &transfer->reader);
+    curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, seek_callback);
+    curl_easy_setopt(curl, CURLOPT_SEEKDATA, &transfer->reader);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, transfer->body_size);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer->rate_headers);
+    
+    if (transfer->stream) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, stream_write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->sse);
+        // Long generations are fine as long as tokens keep arriving, so
+        // replace the overall timeout with an idle timeout
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 120L);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer->response);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 120L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 0L);
+    }
+}
+
+// Bookkeeping after every attempt: timing, the rate limit's estimate and
+// whatever the provider said about its own limits
+static void transfer_attempt_done(HttpTransfer* transfer) {
+    HttpClient* client = transfer->client;
+    HttpResponse* response = transfer->response;
+    
+    record_timing(client, transfer->curl, &response->timing);
+    curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &response->status_code);
+    
+    HttpRateLimit* rate_limit = client->pool->rate_limit;
+    rate_limit_record(rate_limit, (long)(response->size / 4));
+    rate_limit_observe(rate_limit, &transfer->rate_headers, response->status_code);
+}
+
+static bool transient_error(CURLcode res) {
+    switch (res) {
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_SEND_FAIL_REWIND:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// xorshift64; good enough to spread retries apart
+static uint64_t transfer_random(HttpTransfer* transfer) {
+    uint64_t x = transfer->random ? transfer->random : 0x9e3779b97f4a7c15ULL;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    transfer->random = x;
+    return x;
+}
+
+// Milliseconds to wait before the next attempt, or -1 if the outcome of
+// this one is final
+static long transfer_retry_delay(HttpTransfer* transfer, CURLcode res) {
+    const SseStream* sse = &transfer->sse;
+    if (transfer->attempt >= HTTP_MAX_ATTEMPTS || sse->delivered || sse->stopped) return -1;
+    
+    char reason[128];
     if (res != CURLE_OK) {
+        if (!transient_error(res)) return -1;
+        snprintf(reason, sizeof(reason), "CURL error: %s", curl_easy_strerror(res));
+    } else {
+        long status = transfer->response->status_code;
+        if (status != 408 && status != 429 && status < 500) return -1;
+        snprintf(reason, sizeof(reason), "HTTP error: %ld", status);
+    }
+    
+    long delay;
+    double retry_after = transfer->rate_headers.retry_after_ms;
+    if (retry_after >= 0) {
+        if (retry_after > HTTP_RETRY_AFTER_MAX_MS) {
+            log_message(LOG_WARNING, "%s with Retry-After of %.0f s; not retrying", reason, retry_after / 1000.0);
+            return -1;
+        }
+        delay = (long)retry_after;
+    } else {
+        // Equal jitter: half the backoff, plus up to as much again at random
+        long backoff = HTTP_BACKOFF_BASE_MS;
+        for (int i = 1; i < transfer->attempt && backoff < HTTP_BACKOFF_MAX_MS; i++) backoff *= 2;
+        if (backoff > HTTP_BACKOFF_MAX_MS) backoff = HTTP_BACKOFF_MAX_MS;
+        delay = backoff / 2 + (long)(transfer_random(transfer) % (uint64_t)(backoff / 2 + 1));
+    }
+    
+    log_message(LOG_WARNING, "%s; retrying in %.1f s (attempt %d of %d)",
+                reason, delay / 1000.0, transfer->attempt + 1, HTTP_MAX_ATTEMPTS);
+    return delay;
+}
+
+// Ready the transfer for another attempt from the start of its body
+static void transfer_reset(HttpTransfer* transfer) {
+    HttpResponse* response = transfer->response;
+    response->size = 0;
+    response->data[0] = '\0';
+    response->status_code = 0;
+    
+    transfer->reader.index = 0;
+    transfer->reader.offset = 0;
+    transfer->sse.status_checked = false;
+    transfer->sse.raw = false;
+    transfer->sse.done = false;
+    if (transfer->stream) string_buffer_clear(&transfer->sse.line);
+    rate_headers_reset(&transfer->rate_headers);
+    transfer->hedge_sent = false;
+    transfer->attempt++;
+}
+
+// Collects the outcome of a completed transfer and frees it
+static HttpResponse* transfer_finish(HttpTransfer* transfer, CURLcode res) {
+    HttpResponse* response = transfer->response;
+    SseStream* sse = &transfer->sse;
+    
+    if (transfer->stream) {
+        // Flush a final event that was not newline-terminated
+        if (!sse->raw && !sse->stopped && sse->line.size > 0) {
+            sse_handle_line(sse, sse->line.data);
+        }
+        string_buffer_free(&sse->line);
+    }
+    
+    bool stopped = sse->stopped;
+    response->attempts = transfer->attempt;
+    free(transfer);
+    
+    if (res != CURLE_OK && !(res == CURLE_WRITE_ERROR && stopped)) {
         log_message(LOG_ERROR, "CURL error: %s", curl_easy_strerror(res));
         http_response_destroy(response);
         return NULL;
     }
     
-    // Check HTTP response code
-    long http_code = 0;
-    curl_easy_getinfo(client->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (stopped) {
+        log_message(LOG_DEBUG, "Stream stopped early after %zu chars", response->size);
+    }
     
-    if (http_code != 200) {
-        log_message(LOG_ERROR, "HTTP error: %ld", http_code);
+    if (response->status_code != 200) {
+        log_message(LOG_ERROR, "HTTP error: %ld", response->status_code);
         log_message(LOG_ERROR, "Response: %s", response->data);
         // Don't destroy response here - let caller handle it
     }
@@ -106,6 +835,317 @@ HttpResponse* http_post_json(HttpClient* client, const char* endpoint, const cha
     return response;
 }
 
+// Second copy of a request in flight, on a handle of its own
+static HttpTransfer* transfer_hedge_create(HttpTransfer* primary) {
+    CURL* curl = curl_easy_duphandle(primary->curl);
+    if (!curl) return NULL;
+    
+    HttpTransfer* hedge = safe_calloc(1, sizeof(HttpTransfer));
+    hedge->client = primary->client;
+    hedge->curl = curl;
+    hedge->response = http_response_create();
+    hedge->reader.parts = primary->reader.parts;
+    hedge->reader.count = primary->reader.count;
+    hedge->body_size = primary->body_size;
+    memcpy(hedge->url, primary->url, sizeof(hedge->url));
+    hedge->attempt = 1;
+    hedge->primary = primary;
+    rate_headers_reset(&hedge->rate_headers);
+    
+    primary->hedge = hedge;
+    primary->hedge_sent = true;
+    return hedge;
+}
+
+static void transfer_hedge_destroy(HttpTransfer* hedge) {
+    curl_easy_cleanup(hedge->curl);
+    http_response_destroy(hedge->response);
+    free(hedge);
+}
+
+HttpResponse* http_post_json_gather(HttpClient* client, const char* endpoint,
+                                    const HttpBodyPart* parts, size_t part_count,
+                                    bool stream, HttpStreamCallback callback, void* userdata) {
+    HttpTransfer* transfer = http_transfer_create(client, endpoint, parts, part_count, stream, callback, userdata);
+    return http_transfer_perform(transfer);
+}
+
+HttpMulti* http_multi_create(void) {
+    HttpMulti* multi = safe_calloc(1, sizeof(HttpMulti));
+    multi->multi = curl_multi_init();
+    if (!multi->multi) {
+        free(multi);
+        return NULL;
+    }
+    multi->pipewait = true;
+    return multi;
+}
+
+void http_multi_destroy(HttpMulti* multi) {
+    if (!multi) return;
+    curl_multi_cleanup(multi->multi);
+    free(multi);
+}
+
+static void multi_start(HttpMulti* multi, HttpTransfer* transfer) {
+    transfer_prepare(transfer);
+    // Everything in the loop runs on one thread, and it is the only loop on
+    // its pool (see http_pool_create_linked), so a new request can wait for
+    // an HTTP/2 connection being set up instead of opening another
+    curl_easy_setopt(transfer->curl, CURLOPT_PIPEWAIT, multi->pipewait ? 1L : 0L);
+    CURLMcode res = curl_multi_add_handle(multi->multi, transfer->curl);
+    if (res != CURLM_OK) {
+        log_message(LOG_ERROR, "Cannot start request: %s", curl_multi_strerror(res));
+        if (transfer->primary) {
+            transfer->primary->hedge = NULL;
+            transfer_hedge_destroy(transfer);
+            return;
+        }
+        // Reported through the completion callback like any failed transfer
+        transfer->next = multi->failed;
+        multi->failed = transfer;
+        return;
+    }
+    
+    transfer->started_ms = platform_monotonic_ms();
+    transfer->prev_in_flight = NULL;
+    transfer->next_in_flight = multi->in_flight;
+    if (multi->in_flight) multi->in_flight->prev_in_flight = transfer;
+    multi->in_flight = transfer;
+    if (!transfer->primary) multi->active++;
+}
+
+// Take a started transfer out of curl and the in-flight list
+static void multi_detach(HttpMulti* multi, HttpTransfer* transfer) {
+    curl_multi_remove_handle(multi->multi, transfer->curl);
+    if (transfer->prev_in_flight) {
+        transfer->prev_in_flight->next_in_flight = transfer->next_in_flight;
+    } else {
+        multi->in_flight = transfer->next_in_flight;
+    }
+    if (transfer->next_in_flight) transfer->next_in_flight->prev_in_flight = transfer->prev_in_flight;
+    transfer->prev_in_flight = NULL;
+    transfer->next_in_flight = NULL;
+}
+
+void http_multi_add(HttpMulti* multi, HttpTransfer* transfer, void* owner) {
+    transfer->owner = owner;
+    transfer->next = NULL;
+    
+    // First come, first served: nothing overtakes a held-back transfer
+    HttpRateLimit* rate_limit = transfer->client->pool->rate_limit;
+    if (multi->held_head || !rate_limit_try_acquire(rate_limit, transfer_tokens(transfer))) {
+        if (multi->held_tail) {
+            multi->held_tail->next = transfer;
+        } else {
+            multi->held_head = transfer;
+        }
+        multi->held_tail = transfer;
+        multi->held++;
+        return;
+    }
+    
+    multi_start(multi, transfer);
+}
+
+size_t http_multi_pending(const HttpMulti* multi) {
+    return multi->active + multi->held + multi->retrying_count;
+}
+
+// A primary transfer's attempt is over: back off for another, or report it
+static void multi_settle(HttpMulti* multi, HttpTransfer* transfer, CURLcode result,
+                         HttpTransferDone done, void* userdata) {
+    multi->active--;
+    
+    long delay = transfer_retry_delay(transfer, result);
+    if (delay >= 0) {
+        transfer_reset(transfer);
+        transfer->retry_at_ms = platform_monotonic_ms() + (uint64_t)delay;
+        transfer->next = multi->retrying;
+        multi->retrying = transfer;
+        multi->retrying_count++;
+        return;
+    }
+    
+    void* owner = transfer->owner;
+    done(owner, transfer_finish(transfer, result), userdata);
+}
+
+static void multi_complete(HttpMulti* multi, HttpTransfer* transfer, CURLcode result,
+                           HttpTransferDone done, void* userdata) {
+    multi_detach(multi, transfer);
+    transfer_attempt_done(transfer);
+    bool succeeded = result == CURLE_OK && transfer->response->status_code == 200;
+    
+    HttpTransfer* primary = transfer->primary;
+    if (primary) {
+        primary->hedge = NULL;
+        if (succeeded) {
+            // The hedge won: its response stands in for the primary's
+            if (!primary->awaiting_hedge) multi_detach(multi, primary);
+            HttpResponse* response = primary->response;
+            primary->response = transfer->response;
+            primary->response->hedged = true;
+            transfer->response = response;
+            transfer_hedge_destroy(transfer);
+            multi->active--;
+            void* owner = primary->owner;
+            done(owner, transfer_finish(primary, CURLE_OK), userdata);
+        } else {
+            transfer_hedge_destroy(transfer);
+            if (primary->awaiting_hedge) {
+                primary->awaiting_hedge = false;
+                multi_settle(multi, primary, primary->result, done, userdata);
+            }
+        }
+        return;
+    }
+    
+    if (transfer->hedge) {
+        if (!succeeded) {
+            // The hedge may still succeed
+            transfer->awaiting_hedge = true;
+            transfer->result = result;
+            return;
+        }
+        multi_detach(multi, transfer->hedge);
+        transfer_hedge_destroy(transfer->hedge);
+        transfer->hedge = NULL;
+    }
+    multi_settle(multi, transfer, result, done, userdata);
+}
+
+static void cap_timeout(int* timeout_ms, uint64_t wait_ms) {
+    if ((uint64_t)*timeout_ms > wait_ms) *timeout_ms = (int)wait_ms;
+}
+
+// Send a second copy of every non-streamed request that has been in flight
+// longer than the pool's hedge delay, as far as the rate limit allows
+static void multi_start_hedges(HttpMulti* multi, uint64_t now, int* timeout_ms) {
+    for (HttpTransfer* transfer = multi->in_flight; transfer; transfer = transfer->next_in_flight) {
+        long hedge_after_ms = transfer->client->pool->hedge_after_ms;
+        if (hedge_after_ms <= 0 || transfer->primary || transfer->stream || transfer->hedge_sent) continue;
+        
+        uint64_t due = transfer->started_ms + (uint64_t)hedge_after_ms;
+        if (due > now) {
+            cap_timeout(timeout_ms, due - now);
+            continue;
+        }
+        if (!rate_limit_try_acquire(transfer->client->pool->rate_limit, transfer_tokens(transfer))) {
+            cap_timeout(timeout_ms, 250);
+            continue;
+        }
+        
+        HttpTransfer* hedge = transfer_hedge_create(transfer);
+        if (!hedge) {
+            transfer->hedge_sent = true;
+            continue;
+        }
+        log_message(LOG_INFO, "No response after %ld ms; sending a hedged request", hedge_after_ms);
+        // Started at the head of the list, so the loop does not visit it
+        multi_start(multi, hedge);
+    }
+}
+
+void http_multi_poll(HttpMulti* multi, int timeout_ms, HttpTransferDone done, void* userdata) {
+    uint64_t now = platform_monotonic_ms();
+    
+    // Transfers done backing off queue up for the rate limit again
+    HttpTransfer** link = &multi->retrying;
+    while (*link) {
+        HttpTransfer* transfer = *link;
+        if (transfer->retry_at_ms > now) {
+            cap_timeout(&timeout_ms, transfer->retry_at_ms - now);
+            link = &transfer->next;
+            continue;
+        }
+        *link = transfer->next;
+        multi->retrying_count--;
+        http_multi_add(multi, transfer, transfer->owner);
+    }
+    
+    // Release transfers the rate limit now admits
+    while (multi->held_head &&
+           rate_limit_try_acquire(multi->held_head->client->pool->rate_limit, transfer_tokens(multi->held_head))) {
+        HttpTransfer* transfer = multi->held_head;
+        multi->held_head = transfer->next;
+        if (!multi->held_head) multi->held_tail = NULL;
+        multi->held--;
+        multi_start(multi, transfer);
+    }
+    if (multi->held_head) {
+        cap_timeout(&timeout_ms, 250);
+    }
+    
+    multi_start_hedges(multi, now, &timeout_ms);
+    
+    while (multi->failed) {
+        HttpTransfer* transfer = multi->failed;
+        multi->failed = transfer->next;
+        void* owner = transfer->owner;
+        done(owner, transfer_finish(transfer, CURLE_FAILED_INIT), userdata);
+    }
+    
+    curl_multi_poll(multi->multi, NULL, 0, timeout_ms, NULL);
+    
+    int running = 0;
+    curl_multi_perform(multi->multi, &running);
+    
+    CURLMsg* message;
+    int queued = 0;
+    while ((message = curl_multi_info_read(multi->multi, &queued)) != NULL) {
+        if (message->msg != CURLMSG_DONE) continue;
+        
+        CURL* curl = message->easy_handle;
+        CURLcode result = message->data.result;
+        char* private_data = NULL;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, &private_data);
+        multi_complete(multi, (HttpTransfer*)private_data, result, done, userdata);
+    }
+}
+
+static void perform_done(void* owner, HttpResponse* response, void* userdata) {
+    (void)owner;
+    *(HttpResponse**)userdata = response;
+}
+
+HttpResponse* http_transfer_perform(HttpTransfer* transfer) {
+    if (!transfer) return NULL;
+    
+    // A loop of its own, so retries and hedges work as in the event loop.
+    // Other threads may be setting up connections of the same pool, so
+    // this one must not wait for them.
+    HttpMulti* multi = http_multi_create();
+    if (!multi) return transfer_finish(transfer, CURLE_OUT_OF_MEMORY);
+    multi->pipewait = false;
+    
+    HttpResponse* response = NULL;
+    http_multi_add(multi, transfer, NULL);
+    while (http_multi_pending(multi) > 0 || multi->failed) {
+        http_multi_poll(multi, 1000, perform_done, &response);
+    }
+    
+    http_multi_destroy(multi);
+    return response;
+}
+
+void http_multi_wakeup(HttpMulti* multi) {
+    curl_multi_wakeup(multi->multi);
+}
+
+HttpResponse* http_post_json(HttpClient* client, const char* endpoint, const char* json_payload) {
+    if (!json_payload) return NULL;
+    HttpBodyPart part = {json_payload, strlen(json_payload)};
+    return http_post_json_gather(client, endpoint, &part, 1, false, NULL, NULL);
+}
+
+HttpResponse* http_post_json_stream(HttpClient* client, const char* endpoint, const char* json_payload,
+                                    HttpStreamCallback callback, void* userdata) {
+    if (!json_payload) return NULL;
+    HttpBodyPart part = {json_payload, strlen(json_payload)};
+    return http_post_json_gather(client, endpoint, &part, 1, true, callback, userdata);
+}
+
 void http_response_destroy(HttpResponse* response) {
     if (!response) return;
     free(response->data);
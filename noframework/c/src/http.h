@@ -4,27 +4,197 @@
 #include "platform.h"
 #include <curl/curl.h>
 
+// Where the time of one request went, in milliseconds. Phases that did
+// not happen (DNS and connect on a reused connection, TLS over plain
+// HTTP) are zero.
+typedef enum {
+    HTTP_PHASE_DNS,
+    HTTP_PHASE_CONNECT,
+    HTTP_PHASE_TLS,
+    HTTP_PHASE_TTFB,        // request start to first response byte
+    HTTP_PHASE_TOTAL,
+    HTTP_PHASE_COUNT
+} HttpPhase;
+
+typedef struct {
+    double ms[HTTP_PHASE_COUNT];
+    bool reused;            // no new connection was opened
+} HttpTiming;
+
+// Power-of-two millisecond buckets: bucket 0 is < 1 ms, bucket i covers
+// [2^(i-1), 2^i) ms and the last bucket takes everything slower
+#define HTTP_TIMING_BUCKETS 18
+
+typedef struct {
+    size_t requests;
+    size_t reused;
+    size_t counts[HTTP_PHASE_COUNT][HTTP_TIMING_BUCKETS];
+    double sum_ms[HTTP_PHASE_COUNT];
+    double max_ms[HTTP_PHASE_COUNT];
+} HttpTimingHistogram;
+
 typedef struct {
     char* data;
     size_t size;
     size_t capacity;
+    long status_code;
+    HttpTiming timing;
+    int attempts;           // 1 unless it was retried
+    bool hedged;            // answered by a hedged copy of the request
 } HttpResponse;
 
+// One buffer of a scatter/gather request body
+typedef struct {
+    const char* data;
+    size_t size;
+} HttpBodyPart;
+
+// Streaming callback, invoked for every content delta of a streamed chat
+// completion. text holds all content received so far (NUL-terminated) and
+// the new delta starts at delta_start. Return false to stop the generation.
+typedef bool (*HttpStreamCallback)(const char* text, size_t length, size_t delta_start, void* userdata);
+
+// Requests and estimated tokens over a sliding one-minute window, in
+// one-second buckets. A zero limit is unlimited.
+#define HTTP_RATE_WINDOW 60
+
+// Every pool schedules its requests through one of these, so all agents of
+// a batch run at the provider's rate together. Besides the --rpm/--tpm
+// window it keeps two buckets of what the provider says is left, refilled
+// from the x-ratelimit-remaining-* and x-ratelimit-reset-* headers of each
+// response and drained by every request sent, and holds all requests while
+// a 429 or 503 response's Retry-After runs.
+typedef struct {
+    long requests_per_minute;
+    long tokens_per_minute;
+    PlatformMutex lock;
+    int64_t bucket_second[HTTP_RATE_WINDOW];
+    long bucket_requests[HTTP_RATE_WINDOW];
+    long bucket_tokens[HTTP_RATE_WINDOW];
+    long server_requests;           // left until server_requests_reset_ms; -1: unknown
+    long server_tokens;
+    uint64_t server_requests_reset_ms;  // platform_monotonic_ms
+    uint64_t server_tokens_reset_ms;
+    uint64_t paused_until_ms;       // Retry-After
+    bool limited;           // the last attempt was turned away (logged once)
+} HttpRateLimit;
+
+// Failed requests are retried when the failure is likely transient: a
+// transport error, 408, 429 or 5xx. The delay is the response's Retry-After
+// if it sent one (a longer one is not waited for), else exponential backoff
+// with jitter. Streamed requests are only retried before any content has
+// reached the callback.
+#define HTTP_MAX_ATTEMPTS 5
+#define HTTP_BACKOFF_BASE_MS 1000
+#define HTTP_BACKOFF_MAX_MS 30000
+#define HTTP_RETRY_AFTER_MAX_MS 120000
+
+// State shared by every client of a pool, e.g. all agents of a batch: the
+// DNS cache, TLS sessions and open connections, and the rate limit
+typedef struct {
+    CURLSH* share;
+    PlatformMutex share_locks[CURL_LOCK_DATA_LAST];
+    HttpRateLimit* rate_limit;
+    bool owns_rate_limit;
+    long hedge_after_ms;    // 0: no hedged requests
+} HttpPool;
+
+// A client is used by one thread at a time; concurrent users each create
+// their own client on a shared pool
 typedef struct {
     CURL* curl;
+    HttpPool* pool;
+    bool owns_pool;
     struct curl_slist* headers;
     char* base_url;
     char* api_key;
+    HttpTimingHistogram timing;
 } HttpClient;
 
+// libcurl's process-wide setup, done once, by main before any threads start
+// or else by the first pool; cleanup at exit, after the last client
+void http_global_init(void);
+void http_global_cleanup(void);
+
+// Connection pool functions
+HttpPool* http_pool_create(void);
+// Pool with connections of its own that counts against parent's rate limit
+// and hedges like it.
+// An HttpMulti waits for connections of its pool that other transfers are
+// setting up, so a loop running beside another one (on another thread)
+// needs a pool of its own.
+HttpPool* http_pool_create_linked(HttpPool* parent);
+void http_pool_destroy(HttpPool* pool);
+// Limit requests and tokens per minute for all clients of the pool
+void http_pool_set_rate_limit(HttpPool* pool, long requests_per_minute, long tokens_per_minute);
+// Send a second copy of a non-streamed request that has not completed after
+// hedge_after_ms and take whichever answers first (0 disables). Useful
+// against slow tails; every hedge is billed as a request of its own.
+void http_pool_set_hedging(HttpPool* pool, long hedge_after_ms);
+
 // HTTP client functions
 HttpClient* http_client_create(const char* base_url, const char* api_key);
+// Client on a shared pool; NULL pool creates a private one
+HttpClient* http_client_create_pooled(const char* base_url, const char* api_key, HttpPool* pool);
 void http_client_destroy(HttpClient* client);
+// Log the request timing histogram collected so far
+void http_client_log_timing(const HttpClient* client);
 
 // HTTP request functions
 HttpResponse* http_post_json(HttpClient* client, const char* endpoint, const char* json_payload);
+// Streamed (SSE) chat completion: on success the response data holds the
+// concatenated content deltas rather than the raw event stream
+HttpResponse* http_post_json_stream(HttpClient* client, const char* endpoint, const char* json_payload,
+                                    HttpStreamCallback callback, void* userdata);
+// POST a body assembled from several buffers without concatenating them
+// first. Passing stream = true behaves like http_post_json_stream.
+HttpResponse* http_post_json_gather(HttpClient* client, const char* endpoint,
+                                    const HttpBodyPart* parts, size_t part_count,
+                                    bool stream, HttpStreamCallback callback, void* userdata);
 void http_response_destroy(HttpResponse* response);
 
+// A request that has been set up but not sent. The body parts must stay
+// valid until the transfer completes.
+typedef struct HttpTransfer HttpTransfer;
+
+HttpTransfer* http_transfer_create(HttpClient* client, const char* endpoint,
+                                   const HttpBodyPart* parts, size_t part_count,
+                                   bool stream, HttpStreamCallback callback, void* userdata);
+// Blocking send, retries included; frees the transfer. Same result as
+// http_post_json_gather.
+HttpResponse* http_transfer_perform(HttpTransfer* transfer);
+
+// Event loop driving many transfers from one thread with curl_multi. A
+// client has at most one transfer in flight, so give each concurrent
+// request its own client (on one pool to share connections).
+typedef void (*HttpTransferDone)(void* owner, HttpResponse* response, void* userdata);
+
+typedef struct {
+    CURLM* multi;
+    bool pipewait;              // new requests may wait for a connection being set up
+    size_t active;
+    HttpTransfer* in_flight;    // started, hedges included
+    HttpTransfer* held_head;    // waiting for the rate limit, in arrival order
+    HttpTransfer* held_tail;
+    size_t held;
+    HttpTransfer* retrying;     // backing off before another attempt
+    size_t retrying_count;
+    HttpTransfer* failed;       // could not be started; reported on the next poll
+} HttpMulti;
+
+HttpMulti* http_multi_create(void);
+void http_multi_destroy(HttpMulti* multi);
+// Queue a transfer; owner is passed to the completion callback
+void http_multi_add(HttpMulti* multi, HttpTransfer* transfer, void* owner);
+// Transfers added and not yet completed
+size_t http_multi_pending(const HttpMulti* multi);
+// Wait up to timeout_ms for network activity, then call done for every
+// completed transfer (response is NULL on transport errors). Retries and
+// hedges are sent from here; done only sees each transfer's final outcome.
+void http_multi_poll(HttpMulti* multi, int timeout_ms, HttpTransferDone done, void* userdata);
+// Interrupt a poll in progress; safe from any thread
+void http_multi_wakeup(HttpMulti* multi);
+
 // Utility functions
 char* http_url_encode(HttpClient* client, const char* str);
 
@@ -0,0 +1,669 @@
+#include "index.h"
+#include <string.h>
+
+// Build-time hash table over strings in the name arena: each slot holds an
+// arena offset + 1 (0 is empty) and a value
+typedef struct {
+    uint32_t* keys;
+    uint32_t* values;
+    size_t capacity;    // power of two
+    size_t count;
+} NameTable;
+
+// Build-time table from (parent directory, component) to directory id + 1
+typedef struct {
+    uint32_t* slots;
+    size_t capacity;
+    size_t count;
+} DirTable;
+
+static bool is_separator(char c) {
+    return c == '/' || c == '\\';
+}
+
+static size_t name_hash(const char* str, size_t length) {
+    size_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void name_table_init(NameTable* table, size_t capacity) {
+    table->capacity = capacity;
+    table->count = 0;
+    table->keys = safe_calloc(capacity, sizeof(uint32_t));
+    table->values = safe_calloc(capacity, sizeof(uint32_t));
+}
+
+static void name_table_free(NameTable* table) {
+    free(table->keys);
+    free(table->values);
+}
+
+// The slot holding str, or the empty slot it would go to
+static size_t name_table_slot(const NameTable* table, const char* names, const char* str, size_t length) {
+    size_t mask = table->capacity - 1;
+    size_t slot = name_hash(str, length) & mask;
+    while (table->keys[slot]) {
+        const char* key = names + table->keys[slot] - 1;
+        if (strncmp(key, str, length) == 0 && key[length] == '\0') break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void name_table_grow(NameTable* table, const char* names) {
+    NameTable grown;
+    name_table_init(&grown, table->capacity * 2);
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (!table->keys[i]) continue;
+        const char* key = names + table->keys[i] - 1;
+        size_t slot = name_table_slot(&grown, names, key, strlen(key));
+        grown.keys[slot] = table->keys[i];
+        grown.values[slot] = table->values[i];
+    }
+    grown.count = table->count;
+    name_table_free(table);
+    *table = grown;
+}
+
+// Offset of the interned copy of str in the arena
+static uint32_t intern_name(StringBuffer* names, NameTable* table, const char* str, size_t length) {
+    size_t slot = name_table_slot(table, names->data, str, length);
+    if (table->keys[slot]) return table->keys[slot] - 1;
+    
+    uint32_t offset = (uint32_t)names->size;
+    string_buffer_append(names, str, length);
+    names->size++;      // keep the terminator
+    
+    table->keys[slot] = offset + 1;
+    table->values[slot] = offset;
+    if (++table->count * 2 > table->capacity) name_table_grow(table, names->data);
+    return offset;
+}
+
+static size_t dir_hash(uint32_t parent, uint32_t name) {
+    return ((size_t)parent * 0x9E3779B97F4A7C15ULL) ^ ((size_t)name * 0xC2B2AE3D27D4EB4FULL);
+}
+
+static size_t dir_table_slot(const DirTable* table, const RepoIndexDir* dirs, uint32_t parent, uint32_t name) {
+    size_t mask = table->capacity - 1;
+    size_t slot = dir_hash(parent, name) & mask;
+    while (table->slots[slot]) {
+        const RepoIndexDir* dir = &dirs[table->slots[slot] - 1];
+        if (dir->parent == parent && dir->name == name) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void dir_table_grow(DirTable* table, const RepoIndexDir* dirs) {
+    DirTable grown = {0};
+    grown.capacity = table->capacity * 2;
+    grown.slots = safe_calloc(grown.capacity, sizeof(uint32_t));
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (!table->slots[i]) continue;
+        const RepoIndexDir* dir = &dirs[table->slots[i] - 1];
+        grown.slots[dir_table_slot(&grown, dirs, dir->parent, dir->name)] = table->slots[i];
+    }
+    grown.count = table->count;
+    free(table->slots);
+    *table = grown;
+}
+
+// Id of the subdirectory name of parent, added if new
+static uint32_t index_child_dir(RepoIndex* index, size_t* dir_capacity, DirTable* table,
+                                uint32_t parent, uint32_t name) {
+    size_t slot = dir_table_slot(table, index->dirs, parent, name);
+    if (table->slots[slot]) return table->slots[slot] - 1;
+    
+    if (index->dir_count == *dir_capacity) {
+        *dir_capacity *= 2;
+        index->dirs = safe_realloc(index->dirs, *dir_capacity * sizeof(RepoIndexDir));
+    }
+    uint32_t id = (uint32_t)index->dir_count++;
+    index->dirs[id].parent = parent;
+    index->dirs[id].name = name;
+    
+    table->slots[slot] = id + 1;
+    if (++table->count * 2 > table->capacity) dir_table_grow(table, index->dirs);
+    return id;
+}
+
+typedef struct {
+    const char* name;
+    RepoIndexExtension extension;
+} ExtensionSortKey;
+
+static int compare_extensions(const void* a, const void* b) {
+    return strcmp(((const ExtensionSortKey*)a)->name, ((const ExtensionSortKey*)b)->name);
+}
+
+// Groups the files by extension into one posting array
+static void index_build_extensions(RepoIndex* index, NameTable* table) {
+    uint32_t* file_extension = safe_malloc((index->file_count + 1) * sizeof(uint32_t));
+    size_t capacity = 16;
+    index->extensions = safe_malloc(capacity * sizeof(RepoIndexExtension));
+    
+    // Index of each file's extension, or UINT32_MAX for none
+    for (size_t i = 0; i < index->file_count; i++) {
+        const char* name = index->names + index->files[i].name;
+        const char* dot = strrchr(name, '.');
+        file_extension[i] = UINT32_MAX;
+        if (!dot) continue;
+        
+        size_t length = strlen(dot + 1);
+        size_t slot = name_table_slot(table, index->names, dot + 1, length);
+        if (!table->keys[slot]) {
+            if (index->extension_count == capacity) {
+                capacity *= 2;
+                index->extensions = safe_realloc(index->extensions, capacity * sizeof(RepoIndexExtension));
+            }
+            RepoIndexExtension* extension = &index->extensions[index->extension_count];
+            extension->name = (uint32_t)(dot + 1 - index->names);
+            extension->first = 0;
+            extension->count = 0;
+            table->keys[slot] = extension->name + 1;
+            table->values[slot] = (uint32_t)index->extension_count++;
+            if (++table->count * 2 > table->capacity) {
+                name_table_grow(table, index->names);
+                slot = name_table_slot(table, index->names, dot + 1, length);
+            }
+        }
+        file_extension[i] = table->values[slot];
+        index->extensions[file_extension[i]].count++;
+    }
+    
+    uint32_t first = 0;
+    for (size_t e = 0; e < index->extension_count; e++) {
+        index->extensions[e].first = first;
+        first += index->extensions[e].count;
+        index->extensions[e].count = 0;
+    }
+    
+    // Files go in ascending order, so every posting list is sorted
+    index->postings = safe_malloc((first + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < index->file_count; i++) {
+        if (file_extension[i] == UINT32_MAX) continue;
+        RepoIndexExtension* extension = &index->extensions[file_extension[i]];
+        index->postings[extension->first + extension->count++] = (uint32_t)i;
+    }
+    free(file_extension);
+    
+    ExtensionSortKey* keys = safe_malloc((index->extension_count + 1) * sizeof(ExtensionSortKey));
+    for (size_t e = 0; e < index->extension_count; e++) {
+        keys[e].name = index->names + index->extensions[e].name;
+        keys[e].extension = index->extensions[e];
+    }
+    qsort(keys, index->extension_count, sizeof(ExtensionSortKey), compare_extensions);
+    for (size_t e = 0; e < index->extension_count; e++) {
+        index->extensions[e] = keys[e].extension;
+    }
+    free(keys);
+}
+
+RepoIndex* repo_index_build(const char* root) {
+    if (!platform_is_directory(root)) return NULL;
+    
+    uint64_t started = platform_monotonic_ms();
+    FileList* listing = file_list_create();
+    GitIgnore* gitignore = gitignore_load(root);
+    traverse_directory_parallel(root, "*", listing, gitignore);
+    gitignore_destroy(gitignore);
+    
+    RepoIndex* index = safe_calloc(1, sizeof(RepoIndex));
+    index->root = safe_strdup(root);
+    index->root_length = strlen(root);
+    while (index->root_length > 1 && is_separator(index->root[index->root_length - 1])) {
+        index->root_length--;
+    }
+    index->root[index->root_length] = '\0';
+    
+    StringBuffer names;
+    string_buffer_init(&names, 4096);
+    NameTable name_table;
+    name_table_init(&name_table, 1024);
+    DirTable dir_table = {0};
+    dir_table.capacity = 256;
+    dir_table.slots = safe_calloc(dir_table.capacity, sizeof(uint32_t));
+    
+    size_t dir_capacity = 64;
+    index->dirs = safe_malloc(dir_capacity * sizeof(RepoIndexDir));
+    index->dir_count = 1;
+    index->dirs[REPO_INDEX_ROOT].parent = REPO_INDEX_ROOT;
+    index->dirs[REPO_INDEX_ROOT].name = intern_name(&names, &name_table, "", 0);
+    index->files = safe_malloc((listing->count + 1) * sizeof(RepoIndexFile));
+    
+    // The listing is sorted, so file ids follow the order of full paths
+    size_t prefix_length = strlen(root);
+    for (size_t i = 0; i < listing->count; i++) {
+        const char* path = listing->files[i];
+        if (strncmp(path, root, prefix_length) != 0) continue;
+        const char* component = path + prefix_length;
+        while (is_separator(*component)) component++;
+        
+        uint32_t dir = REPO_INDEX_ROOT;
+        const char* separator;
+        while ((separator = strpbrk(component, "/\\")) != NULL) {
+            if (separator > component) {
+                uint32_t name = intern_name(&names, &name_table, component, (size_t)(separator - component));
+                dir = index_child_dir(index, &dir_capacity, &dir_table, dir, name);
+            }
+            component = separator + 1;
+        }
+        
+        RepoIndexFile* file = &index->files[index->file_count++];
+        file->dir = dir;
+        file->name = intern_name(&names, &name_table, component, strlen(component));
+    }
+    file_list_destroy(listing);
+    free(dir_table.slots);
+    
+    index->names = names.data;
+    index->names_size = names.size;
+    
+    // Extension keys are tails of file names already in the arena
+    name_table_free(&name_table);
+    name_table_init(&name_table, 64);
+    index_build_extensions(index, &name_table);
+    name_table_free(&name_table);
+    
+    log_message(LOG_INFO, "Indexed %zu files in %zu directories (%zu extensions, %zu KiB of names) in %llu ms",
+                index->file_count, index->dir_count, index->extension_count, index->names_size / 1024,
+                (unsigned long long)(platform_monotonic_ms() - started));
+    return index;
+}
+
+void repo_index_destroy(RepoIndex* index) {
+    if (!index) return;
+    free(index->root);
+    free(index->names);
+    free(index->dirs);
+    free(index->files);
+    free(index->extensions);
+    free(index->postings);
+    repo_trigrams_destroy(index->trigrams);
+    free(index);
+}
+
+bool repo_index_lookup_dir(const RepoIndex* index, const char* directory, uint32_t* dir) {
+    size_t length = strlen(directory);
+    while (length > 1 && is_separator(directory[length - 1])) length--;
+    if (length < index->root_length || strncmp(directory, index->root, index->root_length) != 0) {
+        return false;
+    }
+    
+    const char* rest = directory + index->root_length;
+    const char* end = directory + length;
+    if (rest < end && !is_separator(*rest)) return false;     // a sibling such as /repo2
+    
+    *dir = REPO_INDEX_ROOT;
+    while (rest < end) {
+        while (rest < end && is_separator(*rest)) rest++;
+        const char* component = rest;
+        while (rest < end && !is_separator(*rest)) rest++;
+        size_t component_length = (size_t)(rest - component);
+        if (component_length == 0) break;
+        if (component[0] == '.' && (component_length == 1 || (component_length == 2 && component[1] == '.'))) {
+            return false;
+        }
+        
+        bool found = false;
+        for (size_t i = 1; i < index->dir_count && !found; i++) {
+            const char* name = index->names + index->dirs[i].name;
+            if (index->dirs[i].parent == *dir && strncmp(name, component, component_length) == 0 &&
+                name[component_length] == '\0') {
+                *dir = (uint32_t)i;
+                found = true;
+            }
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+#define REPO_INDEX_MAX_DEPTH 256
+
+bool repo_index_file_path(const RepoIndex* index, uint32_t file_id, uint32_t base,
+                          const char* prefix, char* path, size_t size) {
+    const RepoIndexFile* file = &index->files[file_id];
+    uint32_t chain[REPO_INDEX_MAX_DEPTH];
+    size_t depth = 0;
+    uint32_t dir = file->dir;
+    while (dir != base) {
+        if (dir == REPO_INDEX_ROOT || depth == REPO_INDEX_MAX_DEPTH) return false;
+        chain[depth++] = dir;
+        dir = index->dirs[dir].parent;
+    }
+    
+    size_t length = (size_t)snprintf(path, size, "%s", prefix);
+    while (depth > 0 && length < size) {
+        length += (size_t)snprintf(path + length, size - length, "%c%s",
+                                   PATH_SEPARATOR_CHAR, index->names + index->dirs[chain[--depth]].name);
+    }
+    if (length < size) {
+        snprintf(path + length, size - length, "%c%s", PATH_SEPARATOR_CHAR, index->names + file->name);
+    }
+    return true;
+}
+
+static void index_add_file(const RepoIndex* index, uint32_t file_id, uint32_t base,
+                           const char* prefix, FileList* results) {
+    char path[2048];
+    if (repo_index_file_path(index, file_id, base, prefix, path, sizeof(path))) {
+        file_list_add(results, path);
+    }
+}
+
+bool repo_index_find(const RepoIndex* index, const char* directory, const char* pattern, FileList* results) {
+    uint32_t base;
+    if (!index || !repo_index_lookup_dir(index, directory, &base)) return false;
+    
+    // "*.ext" matches by name suffix, which is exactly the extension
+    // posting list unless ext itself contains a dot
+    if (string_starts_with(pattern, "*.") && !strchr(pattern + 2, '.') &&
+        strcmp(pattern, "*.*") != 0) {
+        RepoIndexExtension key = {0};
+        size_t low = 0;
+        size_t high = index->extension_count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            int order = strcmp(index->names + index->extensions[middle].name, pattern + 2);
+            if (order == 0) {
+                key = index->extensions[middle];
+                break;
+            }
+            if (order < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (uint32_t i = 0; i < key.count; i++) {
+            index_add_file(index, index->postings[key.first + i], base, directory, results);
+        }
+        return true;
+    }
+    
+    for (size_t i = 0; i < index->file_count; i++) {
+        if (match_pattern(index->names + index->files[i].name, pattern)) {
+            index_add_file(index, (uint32_t)i, base, directory, results);
+        }
+    }
+    return true;
+}
+
+// Trigram index
+static uint8_t trigram_fold(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? (uint8_t)(c - 'A' + 'a') : c;
+}
+
+static uint32_t trigram_at(const char* text) {
+    return ((uint32_t)trigram_fold((uint8_t)text[0]) << 16) |
+           ((uint32_t)trigram_fold((uint8_t)text[1]) << 8) |
+           (uint32_t)trigram_fold((uint8_t)text[2]);
+}
+
+static size_t trigram_hash(uint32_t trigram) {
+    return (size_t)trigram * 0x9E3779B97F4A7C15ULL >> 16;
+}
+
+static size_t trigram_slot(const RepoTrigramIndex* trigrams, uint32_t trigram) {
+    size_t mask = trigrams->capacity - 1;
+    size_t slot = trigram_hash(trigram) & mask;
+    while (trigrams->keys[slot] && trigrams->keys[slot] != trigram + 1) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void trigram_table_grow(RepoTrigramIndex* trigrams) {
+    uint32_t* keys = trigrams->keys;
+    uint32_t* counts = trigrams->count;
+    size_t capacity = trigrams->capacity;
+    
+    trigrams->capacity *= 2;
+    trigrams->keys = safe_calloc(trigrams->capacity, sizeof(uint32_t));
+    trigrams->count = safe_calloc(trigrams->capacity, sizeof(uint32_t));
+    for (size_t i = 0; i < capacity; i++) {
+        if (!keys[i]) continue;
+        size_t slot = trigram_slot(trigrams, keys[i] - 1);
+        trigrams->keys[slot] = keys[i];
+        trigrams->count[slot] = counts[i];
+    }
+    free(keys);
+    free(counts);
+}
+
+// Distinct trigrams of one file, gathered by a worker
+typedef struct {
+    uint32_t* trigrams;
+    size_t count;
+} FileTrigrams;
+
+typedef struct {
+    const RepoIndex* index;
+    FileTrigrams* files;
+    bool* searchable;
+    volatile unsigned long next;    // files claimed so far
+    size_t bytes;                   // summed under lock
+    PlatformMutex lock;
+} TrigramBuild;
+
+#define TRIGRAM_SPACE (1u << 24)
+
+static void* trigram_build_worker(void* arg) {
+    TrigramBuild* build = (TrigramBuild*)arg;
+    const RepoIndex* index = build->index;
+    
+    // Bit per possible trigram, cleared again from the file's list
+    uint64_t* seen = safe_calloc(TRIGRAM_SPACE / 64, sizeof(uint64_t));
+    size_t capacity = 4096;
+    uint32_t* found = safe_malloc(capacity * sizeof(uint32_t));
+    size_t bytes = 0;
+    char path[2048];
+    
+    while (true) {
+        size_t file = (size_t)platform_atomic_increment(&build->next) - 1;
+        if (file >= index->file_count) break;
+        
+        repo_index_file_path(index, (uint32_t)file, REPO_INDEX_ROOT, index->root, path, sizeof(path));
+        MappedFile mapped;
+        if (platform_map_file(path, &mapped) != 0) continue;
+        if (mapped.size > TRIGRAM_MAX_FILE_SIZE || memchr(mapped.data, '\0', mapped.size) != NULL) {
+            platform_unmap_file(&mapped);
+            continue;
+        }
+        
+        size_t count = 0;
+        for (size_t i = 0; i + 2 < mapped.size; i++) {
+            if (mapped.data[i + 2] == '\n') {
+                i += 2;
+                continue;
+            }
+            if (mapped.data[i] == '\n' || mapped.data[i + 1] == '\n') continue;
+            
+            uint32_t trigram = trigram_at(mapped.data + i);
+            uint64_t bit = 1ULL << (trigram & 63);
+            if (seen[trigram >> 6] & bit) continue;
+            seen[trigram >> 6] |= bit;
+            
+            if (count == capacity) {
+                capacity *= 2;
+                found = safe_realloc(found, capacity * sizeof(uint32_t));
+            }
+            found[count++] = trigram;
+        }
+        bytes += mapped.size;
+        platform_unmap_file(&mapped);
+        
+        for (size_t i = 0; i < count; i++) {
+            seen[found[i] >> 6] = 0;
+        }
+        build->files[file].trigrams = safe_malloc((count + 1) * sizeof(uint32_t));
+        memcpy(build->files[file].trigrams, found, count * sizeof(uint32_t));
+        build->files[file].count = count;
+        build->searchable[file] = true;
+    }
+    
+    platform_mutex_lock(&build->lock);
+    build->bytes += bytes;
+    platform_mutex_unlock(&build->lock);
+    
+    free(found);
+    free(seen);
+    return NULL;
+}
+
+void repo_index_build_trigrams(RepoIndex* index) {
+    if (index->trigrams) return;
+    
+    uint64_t started = platform_monotonic_ms();
+    TrigramBuild build = {0};
+    build.index = index;
+    build.files = safe_calloc(index->file_count + 1, sizeof(FileTrigrams));
+    build.searchable = safe_calloc(index->file_count + 1, sizeof(bool));
+    platform_mutex_init(&build.lock);
+    
+    // Reading the files dominates, so spread it over the cores
+    int thread_count = platform_cpu_count();
+    if (thread_count > 8) thread_count = 8;
+    if ((size_t)thread_count > index->file_count / 64 + 1) thread_count = (int)(index->file_count / 64 + 1);
+    PlatformThread threads[8];
+    bool started_threads[8] = {false};
+    for (int i = 1; i < thread_count; i++) {
+        started_threads[i] = platform_thread_create(&threads[i], trigram_build_worker, &build) == 0;
+    }
+    trigram_build_worker(&build);
+    for (int i = 1; i < thread_count; i++) {
+        if (started_threads[i]) platform_thread_join(threads[i]);
+    }
+    platform_mutex_destroy(&build.lock);
+    
+    RepoTrigramIndex* trigrams = safe_calloc(1, sizeof(RepoTrigramIndex));
+    trigrams->capacity = 4096;
+    trigrams->keys = safe_calloc(trigrams->capacity, sizeof(uint32_t));
+    trigrams->count = safe_calloc(trigrams->capacity, sizeof(uint32_t));
+    trigrams->searchable = build.searchable;
+    trigrams->indexed_bytes = build.bytes;
+    
+    // Count, lay the posting lists out, then fill them in file order
+    for (size_t file = 0; file < index->file_count; file++) {
+        if (build.searchable[file]) trigrams->searchable_count++;
+        for (size_t i = 0; i < build.files[file].count; i++) {
+            size_t slot = trigram_slot(trigrams, build.files[file].trigrams[i]);
+            if (!trigrams->keys[slot]) {
+                trigrams->keys[slot] = build.files[file].trigrams[i] + 1;
+                if (++trigrams->trigram_count * 2 > trigrams->capacity) {
+                    trigram_table_grow(trigrams);
+                    slot = trigram_slot(trigrams, build.files[file].trigrams[i]);
+                }
+            }
+            trigrams->count[slot]++;
+            trigrams->posting_count++;
+        }
+    }
+    
+    trigrams->first = safe_calloc(trigrams->capacity, sizeof(uint32_t));
+    uint32_t first = 0;
+    for (size_t slot = 0; slot < trigrams->capacity; slot++) {
+        trigrams->first[slot] = first;
+        first += trigrams->count[slot];
+        trigrams->count[slot] = 0;
+    }
+    
+    trigrams->postings = safe_malloc((trigrams->posting_count + 1) * sizeof(uint32_t));
+    for (size_t file = 0; file < index->file_count; file++) {
+        for (size_t i = 0; i < build.files[file].count; i++) {
+            size_t slot = trigram_slot(trigrams, build.files[file].trigrams[i]);
+            trigrams->postings[trigrams->first[slot] + trigrams->count[slot]++] = (uint32_t)file;
+        }
+        free(build.files[file].trigrams);
+    }
+    free(build.files);
+    
+    index->trigrams = trigrams;
+    log_message(LOG_INFO, "Indexed %zu trigrams over %zu text files (%zu MiB) in %llu ms",
+                trigrams->trigram_count, trigrams->searchable_count, trigrams->indexed_bytes / (1024 * 1024),
+                (unsigned long long)(platform_monotonic_ms() - started));
+}
+
+void repo_trigrams_destroy(RepoTrigramIndex* trigrams) {
+    if (!trigrams) return;
+    free(trigrams->keys);
+    free(trigrams->first);
+    free(trigrams->count);
+    free(trigrams->postings);
+    free(trigrams->searchable);
+    free(trigrams);
+}
+
+typedef struct {
+    const uint32_t* ids;
+    size_t count;
+} PostingList;
+
+static int compare_posting_lengths(const void* a, const void* b) {
+    size_t left = ((const PostingList*)a)->count;
+    size_t right = ((const PostingList*)b)->count;
+    return left < right ? -1 : left > right;
+}
+
+uint32_t* repo_trigrams_candidates(const RepoIndex* index, const char* const* literals, size_t literal_count,
+                                   size_t* count) {
+    const RepoTrigramIndex* trigrams = index->trigrams;
+    *count = 0;
+    
+    size_t list_count = 0;
+    size_t list_capacity = 16;
+    PostingList* lists = safe_malloc(list_capacity * sizeof(PostingList));
+    bool empty = false;
+    for (size_t l = 0; l < literal_count && !empty; l++) {
+        size_t length = strlen(literals[l]);
+        for (size_t i = 0; i + 2 < length && !empty; i++) {
+            size_t slot = trigram_slot(trigrams, trigram_at(literals[l] + i));
+            if (!trigrams->keys[slot]) {
+                empty = true;
+                break;
+            }
+            if (list_count == list_capacity) {
+                list_capacity *= 2;
+                lists = safe_realloc(lists, list_capacity * sizeof(PostingList));
+            }
+            lists[list_count].ids = trigrams->postings + trigrams->first[slot];
+            lists[list_count].count = trigrams->count[slot];
+            list_count++;
+        }
+    }
+    
+    uint32_t* result = NULL;
+    if (empty) {
+        result = safe_malloc(sizeof(uint32_t));
+    } else if (list_count == 0) {
+        result = safe_malloc((trigrams->searchable_count + 1) * sizeof(uint32_t));
+        for (size_t file = 0; file < index->file_count; file++) {
+            if (trigrams->searchable[file]) result[(*count)++] = (uint32_t)file;
+        }
+    } else {
+        // Intersect starting from the rarest trigram
+        qsort(lists, list_count, sizeof(PostingList), compare_posting_lengths);
+        result = safe_malloc((lists[0].count + 1) * sizeof(uint32_t));
+        memcpy(result, lists[0].ids, lists[0].count * sizeof(uint32_t));
+        *count = lists[0].count;
+        for (size_t l = 1; l < list_count && *count > 0; l++) {
+            size_t kept = 0;
+            size_t j = 0;
+            for (size_t i = 0; i < *count; i++) {
+                while (j < lists[l].count && lists[l].ids[j] < result[i]) j++;
+                if (j == lists[l].count) break;
+                if (lists[l].ids[j] == result[i]) result[kept++] = result[i];
+            }
+            *count = kept;
+        }
+    }
+    
+    free(lists);
+    return result;
+}
@@ -0,0 +1,92 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "platform.h"
+#include "tools.h"
+
+// In-memory listing of a repository, built once per analysis from the
+// same traversal find_all_matching_files uses (.gitignore rules, symlink
+// handling), so later listings are answered without touching the disk.
+// Path components are interned once in a string arena; directories and
+// files refer to them by offset and to their directory by index.
+#define REPO_INDEX_ROOT 0       // directory id of the root; its own parent
+
+typedef struct {
+    uint32_t parent;    // directory id
+    uint32_t name;      // offset of the component in names
+} RepoIndexDir;
+
+typedef struct {
+    uint32_t dir;
+    uint32_t name;
+} RepoIndexFile;
+
+// Files whose name ends in ".<extension>" (the text after the last dot)
+typedef struct {
+    uint32_t name;      // into names: the tail of an interned file name
+    uint32_t first;     // into postings
+    uint32_t count;
+} RepoIndexExtension;
+
+typedef struct RepoIndex {
+    char* root;                 // directory the index was built for
+    size_t root_length;
+    char* names;                // NUL-terminated components
+    size_t names_size;
+    RepoIndexDir* dirs;
+    size_t dir_count;
+    RepoIndexFile* files;       // in the sorted order of their full paths
+    size_t file_count;
+    RepoIndexExtension* extensions;     // sorted by name
+    size_t extension_count;
+    uint32_t* postings;         // file ids of each extension, ascending
+    struct RepoTrigramIndex* trigrams;  // for search_code; see repo_index_build_trigrams
+} RepoIndex;
+
+// NULL if root cannot be listed
+RepoIndex* repo_index_build(const char* root);
+void repo_index_destroy(RepoIndex* index);
+
+// Adds the files below directory whose name matches pattern (as in
+// match_pattern) to results, in sorted order and spelled as a traversal
+// of directory would. Returns false, adding nothing, when directory is
+// not the root or a directory of the index.
+bool repo_index_find(const RepoIndex* index, const char* directory, const char* pattern, FileList* results);
+// Directory id of directory (the root or a path below it); false if it is
+// not in the index
+bool repo_index_lookup_dir(const RepoIndex* index, const char* directory, uint32_t* dir);
+// Writes prefix followed by the path of file relative to directory base;
+// false if the file is not below base
+bool repo_index_file_path(const RepoIndex* index, uint32_t file, uint32_t base,
+                          const char* prefix, char* path, size_t size);
+
+// Trigram index over the text files of a RepoIndex, so a search only reads
+// the files that can match. Trigrams are taken over ASCII-lowercased bytes
+// within a line, so one index serves case-sensitive and case-insensitive
+// queries; every candidate is still checked against its contents.
+#define TRIGRAM_MAX_FILE_SIZE (16 * 1024 * 1024)
+
+typedef struct RepoTrigramIndex {
+    uint32_t* keys;             // hash table: trigram + 1, 0 is empty
+    uint32_t* first;            // per slot: start of its posting list
+    uint32_t* count;
+    size_t capacity;            // power of two
+    size_t trigram_count;
+    uint32_t* postings;         // file ids, ascending for every trigram
+    size_t posting_count;
+    bool* searchable;           // per file: text below TRIGRAM_MAX_FILE_SIZE
+    size_t searchable_count;
+    size_t indexed_bytes;
+} RepoTrigramIndex;
+
+// Reads every file of the index once (on several threads) and attaches the
+// result as index->trigrams; does nothing if it is already built
+void repo_index_build_trigrams(RepoIndex* index);
+void repo_trigrams_destroy(RepoTrigramIndex* trigrams);
+// Ids of the searchable files that contain every trigram of each of the
+// literals, ascending; with no literal of three bytes or more, every
+// searchable file. Returns a heap array and its length in *count.
+uint32_t* repo_trigrams_candidates(const RepoIndex* index, const char* const* literals, size_t literal_count,
+                                   size_t* count);
+
+#endif // INDEX_H
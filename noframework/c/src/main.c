@@ -1,5 +1,9 @@
 #include "platform.h"
 #include "agent.h"
+#include "cache.h"
+#include "engine.h"
+#include "mapreduce.h"
+#include "manifest.h"
 #include <getopt.h>
 #include <ctype.h>
 
@@ -11,12 +15,37 @@ void print_usage(const char* program_name) {
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  --repo REPO           GitHub repository URL to clone (e.g. https://github.com/owner/repo)\n");
     fprintf(stderr, "  --prompt FILE         Path to a file containing the analysis prompt (required)\n");
-    fprintf(stderr, "  --cache-dir DIR       Directory to cache cloned repositories (default: ~/.cache/github)\n");
+    fprintf(stderr, "  --cache-dir DIR       Directory to cache cloned repositories and tool results (default: ~/.cache/github)\n");
+    fprintf(stderr, "  --clone-depth N       Clone and fetch only the last N commits (default: full history)\n");
+    fprintf(stderr, "  --partial-clone       Download file contents only when they are checked out\n");
+    fprintf(stderr, "  --sparse-checkout     Check out only the file types the prompt mentions, plus top-level files\n");
+    fprintf(stderr, "  --incremental         Update the last document of the same repository, prompt and model for the\n");
+    fprintf(stderr, "                        files changed since its commit (kept in OUTPUT_DIR/*.manifest.json)\n");
+    fprintf(stderr, "  --no-tool-cache       Do not cache file contents and listings under --cache-dir\n");
+    fprintf(stderr, "  --response-cache      Replay identical LLM requests from a cache under --cache-dir\n");
+    fprintf(stderr, "  --response-cache-size MB  Size limit of the response cache (default: 256)\n");
     fprintf(stderr, "  --output-dir DIR      Directory to save results to (default: output)\n");
     fprintf(stderr, "  --extension EXT       File extension for output files (default: .md)\n");
     fprintf(stderr, "  --file-name FILE      Specific file name for output (overrides --extension)\n");
     fprintf(stderr, "  --model MODEL         Model to use (format: vendor/model, default: openai/gpt-4o-mini)\n");
     fprintf(stderr, "  --base-url URL        Base URL for the API (automatically set based on model if not provided)\n");
+    fprintf(stderr, "  --stream              Stream completions and write the final answer as it is generated\n");
+    fprintf(stderr, "  --function-calling    Use the API's native tool calling instead of the ReAct text format\n");
+    fprintf(stderr, "  --stable-prefix       Keep request prefixes byte-stable for the provider's prompt cache\n");
+    fprintf(stderr, "  --token-budget N      Compact old observations once the history exceeds N tokens (default: 64000, 0: never)\n");
+    fprintf(stderr, "  --map-reduce          Summarize the whole repository in parallel LLM calls before the first step\n");
+    fprintf(stderr, "  --map-jobs N          Summarization calls in flight at once with --map-reduce (default: 4)\n");
+    fprintf(stderr, "  --batch FILE          Run every job in FILE, one 'SOURCE [PROMPT_FILE [MODEL]]' per line\n");
+    fprintf(stderr, "  --jobs N              Number of batch jobs in flight at once (default: 4)\n");
+    fprintf(stderr, "  --threads N           Worker threads for batch setup and tool calls (default: 4)\n");
+    fprintf(stderr, "  --clone-jobs N        Repositories a batch clones at once, ahead of the jobs (default: 4)\n");
+    fprintf(stderr, "  --rpm N               Limit LLM requests per minute across all jobs (default: unlimited)\n");
+    fprintf(stderr, "  --tpm N               Limit estimated LLM tokens per minute across all jobs (default: unlimited)\n");
+    fprintf(stderr, "  --hedge-ms N          Send a second copy of an LLM request unanswered after N ms (default: 0, off)\n");
+    fprintf(stderr, "  --log-level LVL       Messages on stderr: debug, info (default), warning, error or off\n");
+    fprintf(stderr, "  --log-file-level LVL  Lines of logs/tech-writer-*.log: debug, info (default), warning, error or off\n");
+    fprintf(stderr, "  --trace FILE          Write a trace record of every agent step to FILE\n");
+    fprintf(stderr, "  --trace-format FMT    jsonl (one JSON object per step, default) or chrome (chrome://tracing, Perfetto)\n");
     fprintf(stderr, "  -h, --help            Show this help message and exit\n\n");
     fprintf(stderr, "Dependencies:\n");
     fprintf(stderr, "  This program requires environment variables:\n");
@@ -24,6 +53,617 @@ void print_usage(const char* program_name) {
     fprintf(stderr, "  - GEMINI_API_KEY for Google models\n");
 }
 
+// Settings shared by every analysis in this process
+typedef struct {
+    const char* cache_dir;
+    const char* output_dir;
+    const char* extension;
+    const char* file_name;
+    const char* base_url;
+    bool stream;
+    bool function_calling;
+    bool stable_prefix;
+    long token_budget;
+    size_t map_reduce_jobs;         // 0: no map-reduce summary
+    bool incremental;               // update from and write analysis manifests
+    LogLevel log_file_level;
+    HttpPool* pool;
+    int clone_depth;                // 0: full history
+    bool partial_clone;
+    bool sparse_checkout;           // patterns come from the prompt
+    PlatformMutex* output_lock;     // batch mode: output paths are reserved under it
+} RunOptions;
+
+// One analysis: a repository URL or a local directory, a prompt and a model
+typedef struct {
+    char* source;
+    bool is_repo;
+    char* prompt_file;
+    char* model;
+    struct RepoClone* clone;    // batch mode: cloned ahead of the job
+} AnalysisJob;
+
+struct ClonePrefetch;
+
+// A repository of a batch, cloned once for all the jobs that name it
+typedef struct RepoClone {
+    char* key;                  // owner/repo, as laid out under --cache-dir
+    const char* url;
+    char* sparse_patterns;      // union over its jobs
+    bool full_checkout;         // a job's prompt names no file types
+    char* path;                 // NULL when the clone failed
+    bool done;
+    struct ClonePrefetch* prefetch;
+} RepoClone;
+
+// Clone threads working through the repositories in job order
+typedef struct ClonePrefetch {
+    const RunOptions* options;
+    RepoClone* repos;
+    size_t count;
+    size_t next;                // next repository to claim
+    PlatformMutex lock;
+    PlatformCond cloned;
+} ClonePrefetch;
+
+static CloneOptions clone_options(const RunOptions* options, const char* sparse_patterns) {
+    CloneOptions clone = {0};
+    clone.depth = options->clone_depth;
+    clone.partial = options->partial_clone;
+    clone.sparse_patterns = sparse_patterns;
+    return clone;
+}
+
+// Blocks until the prefetch threads have cloned the repository; returns
+// a copy of its path or NULL
+static char* repo_clone_wait(RepoClone* repo) {
+    ClonePrefetch* prefetch = repo->prefetch;
+    platform_mutex_lock(&prefetch->lock);
+    while (!repo->done) {
+        platform_cond_wait(&prefetch->cloned, &prefetch->lock);
+    }
+    char* path = repo->path ? safe_strdup(repo->path) : NULL;
+    platform_mutex_unlock(&prefetch->lock);
+    return path;
+}
+
+static char* read_prompt_file(const char* path) {
+    FILE* prompt_fp = fopen(path, "r");
+    if (!prompt_fp) {
+        fprintf(stderr, "Error: Cannot open prompt file: %s\n", path);
+        return NULL;
+    }
+    
+    fseek(prompt_fp, 0, SEEK_END);
+    long prompt_size = ftell(prompt_fp);
+    fseek(prompt_fp, 0, SEEK_SET);
+    
+    char* prompt = safe_malloc(prompt_size + 1);
+    size_t read = fread(prompt, 1, prompt_size, prompt_fp);
+    prompt[read] = '\0';
+    fclose(prompt_fp);
+    return prompt;
+}
+
+// Output path for a batch job. Jobs finishing in the same second (or all
+// sharing --file-name) get a numeric suffix; the empty file marks the
+// name as taken until the job writes it.
+static char* reserve_output_path(const RunOptions* options, const char* repo_name, const char* model) {
+    platform_mutex_lock(options->output_lock);
+    char* base = build_output_path(repo_name, model, options->output_dir, options->extension, options->file_name);
+    char* dot = strrchr(base, '.');
+    char* separator = strrchr(base, PATH_SEPARATOR_CHAR);
+    if (dot && separator && dot < separator) dot = NULL;
+    int stem_length = (int)(dot ? (size_t)(dot - base) : strlen(base));
+    
+    char* path = safe_strdup(base);
+    for (int suffix = 2; platform_file_exists(path); suffix++) {
+        size_t length = strlen(base) + 16;
+        free(path);
+        path = safe_malloc(length);
+        snprintf(path, length, "%.*s-%d%s", stem_length, base, suffix, dot ? dot : "");
+    }
+    free(base);
+    
+    FILE* file = fopen(path, "w");
+    if (file) fclose(file);
+    platform_mutex_unlock(options->output_lock);
+    return path;
+}
+
+// One analysis from setup to written results. It runs either through a
+// blocking agent_run or, in batch mode, on the engine.
+typedef struct {
+    const RunOptions* options;
+    const AnalysisJob* job;
+    char* prompt;
+    char* repo_name;
+    char* analysis_dir;
+    char* output_path;
+    FILE* answer_stream;
+    TechWriterAgent* agent;
+    char* manifest_path;    // --incremental, for git work trees
+    char* head_commit;
+    AnalysisManifest* previous;
+    char* changes;
+    int status;             // 0 on success
+} Analysis;
+
+static void analysis_cleanup(Analysis* analysis) {
+    if (analysis->answer_stream) {
+        analysis->agent->answer_stream = NULL;
+        fclose(analysis->answer_stream);
+        analysis->answer_stream = NULL;
+    }
+    agent_destroy(analysis->agent);
+    manifest_destroy(analysis->previous);
+    free(analysis->changes);
+    free(analysis->head_commit);
+    free(analysis->manifest_path);
+    analysis->previous = NULL;
+    analysis->changes = NULL;
+    analysis->head_commit = NULL;
+    analysis->manifest_path = NULL;
+    free(analysis->output_path);
+    free(analysis->prompt);
+    free(analysis->analysis_dir);
+    free(analysis->repo_name);
+    analysis->agent = NULL;
+    analysis->output_path = NULL;
+    analysis->prompt = NULL;
+    analysis->analysis_dir = NULL;
+    analysis->repo_name = NULL;
+}
+
+// --incremental: the last run's manifest for this repository, prompt and
+// model, and the files changed since its commit. Anything that does not
+// fit leaves the agent to a full analysis.
+static void analysis_load_previous(Analysis* analysis) {
+    const RunOptions* options = analysis->options;
+    analysis->head_commit = git_head_commit(analysis->analysis_dir);
+    if (!analysis->head_commit) {
+        log_message(LOG_WARNING, "--incremental needs the root of a git work tree; analysing %s in full",
+                    analysis->analysis_dir);
+        return;
+    }
+    char* prompt_hash = manifest_prompt_hash(analysis->prompt);
+    analysis->manifest_path = manifest_path(options->output_dir, analysis->repo_name, analysis->job->model,
+                                            prompt_hash);
+    
+    AnalysisManifest* previous = manifest_load(analysis->manifest_path);
+    if (!previous) {
+        free(prompt_hash);
+        return;
+    }
+    bool same_prompt = strcmp(prompt_hash, previous->prompt_hash) == 0;
+    free(prompt_hash);
+    if (!same_prompt) {
+        log_message(LOG_INFO, "The prompt changed since the last analysis; analysing in full");
+        manifest_destroy(previous);
+        return;
+    }
+    
+    char* changes = strcmp(previous->commit, analysis->head_commit) == 0
+        ? safe_strdup("")
+        : git_changed_files(analysis->analysis_dir, previous->commit);
+    if (!changes) {
+        log_message(LOG_WARNING, "Cannot diff against commit %.12s; analysing in full", previous->commit);
+        manifest_destroy(previous);
+        return;
+    }
+    
+    analysis->previous = previous;
+    analysis->changes = changes;
+    analysis->agent->previous = previous;
+    analysis->agent->changes = changes;
+}
+
+// Manifest of a finished analysis: the files this run read, plus those the
+// previous one read that still exist
+static void analysis_save_manifest(Analysis* analysis, const char* document) {
+    AnalysisManifest manifest = {0};
+    manifest.commit = analysis->head_commit;
+    manifest.prompt_hash = manifest_prompt_hash(analysis->prompt);
+    manifest.model = (char*)analysis->job->model;
+    manifest.document = (char*)document;
+    
+    AnalysisManifest files = {0};
+    for (const char* line = analysis->agent->files_read.data; line && *line; ) {
+        const char* end = strchr(line, '\n');
+        char path[1024];
+        snprintf(path, sizeof(path), "%.*s", (int)(end - line), line);
+        manifest_add_file_read(&files, path);
+        line = end + 1;
+    }
+    for (size_t i = 0; analysis->previous && i < analysis->previous->files_read_count; i++) {
+        char path[2048];
+        snprintf(path, sizeof(path), "%s%c%s", analysis->analysis_dir, PATH_SEPARATOR_CHAR,
+                 analysis->previous->files_read[i]);
+        if (platform_file_exists(path)) manifest_add_file_read(&files, analysis->previous->files_read[i]);
+    }
+    manifest.files_read = files.files_read;
+    manifest.files_read_count = files.files_read_count;
+    
+    manifest_save(analysis->manifest_path, &manifest);
+    
+    for (size_t i = 0; i < files.files_read_count; i++) {
+        free(files.files_read[i]);
+    }
+    free(files.files_read);
+    free(manifest.prompt_hash);
+}
+
+// Reads the prompt, clones or resolves the source and creates the agent
+static bool analysis_setup(Analysis* analysis) {
+    const RunOptions* options = analysis->options;
+    const AnalysisJob* job = analysis->job;
+    analysis->status = 1;
+    
+    analysis->prompt = read_prompt_file(job->prompt_file);
+    if (!analysis->prompt) return false;
+    
+    // Handle repository or directory
+    if (job->is_repo) {
+        if (job->clone) {
+            analysis->analysis_dir = repo_clone_wait(job->clone);
+        } else {
+            char* patterns = options->sparse_checkout ? sparse_patterns_for_prompt(analysis->prompt) : NULL;
+            if (options->sparse_checkout && !patterns) {
+                log_message(LOG_WARNING, "The prompt names no file types; checking out all files");
+            }
+            CloneOptions clone = clone_options(options, patterns);
+            analysis->analysis_dir = clone_or_update_repo_with(job->source, options->cache_dir, &clone);
+            free(patterns);
+        }
+        if (!analysis->analysis_dir) {
+            fprintf(stderr, "Error: Failed to clone/update repository: %s\n", job->source);
+            analysis_cleanup(analysis);
+            return false;
+        }
+        
+        // Extract repo name
+        char* owner = NULL;
+        extract_repo_info(job->source, &owner, &analysis->repo_name);
+        free(owner);
+    } else {
+        analysis->analysis_dir = platform_normalize_path(job->source);
+        
+        // Get base name for repo_name
+        char* last_sep = strrchr(analysis->analysis_dir, PATH_SEPARATOR_CHAR);
+        analysis->repo_name = safe_strdup(last_sep ? last_sep + 1 : analysis->analysis_dir);
+    }
+    
+    // Create agent
+    TechWriterAgent* agent = agent_create_pooled(job->model, options->base_url, options->pool);
+    if (!agent) {
+        fprintf(stderr, "Error: Failed to create agent\n");
+        analysis_cleanup(analysis);
+        return false;
+    }
+    analysis->agent = agent;
+    
+    // Compute the output path once so streamed output, results and metadata agree
+    platform_make_directory(options->output_dir);
+    analysis->output_path = options->output_lock
+        ? reserve_output_path(options, analysis->repo_name, job->model)
+        : build_output_path(analysis->repo_name, job->model, options->output_dir,
+                            options->extension, options->file_name);
+    
+    agent->token_budget = options->token_budget > 0 ? (size_t)options->token_budget : 0;
+    agent->function_calling = options->function_calling;
+    agent->stable_prefix = options->stable_prefix;
+    agent->map_reduce_jobs = options->map_reduce_jobs;
+    agent->log_level = options->log_file_level;
+    if (options->incremental) {
+        analysis_load_previous(analysis);
+    }
+    
+    if (options->stream) {
+        agent->stream = true;
+        analysis->answer_stream = fopen(analysis->output_path, "w");
+        agent->answer_stream = analysis->answer_stream;
+    }
+    
+    return true;
+}
+
+// Writes results and metadata and releases the analysis. Takes ownership
+// of result; NULL means setup failed.
+static void analysis_finish(Analysis* analysis, char* result) {
+    if (!result) {
+        analysis->status = 1;
+        analysis_cleanup(analysis);
+        return;
+    }
+    
+    if (analysis->answer_stream) {
+        analysis->agent->answer_stream = NULL;
+        fclose(analysis->answer_stream);
+        analysis->answer_stream = NULL;
+    }
+    
+    // Save results
+    save_results(result, analysis->output_path);
+    
+    // Create metadata
+    const AnalysisJob* job = analysis->job;
+    create_metadata(analysis->output_path, job->model, job->is_repo ? job->source : "", analysis->repo_name,
+                    &analysis->agent->stats);
+    
+    analysis->status = strcmp(result, "Failed to complete analysis") == 0 ? 1 : 0;
+    if (analysis->status == 0 && analysis->manifest_path) {
+        analysis_save_manifest(analysis, result);
+    }
+    free(result);
+    analysis_cleanup(analysis);
+}
+
+// Runs one analysis and writes its results and metadata. Returns 0 on success.
+static int run_analysis(const RunOptions* options, const AnalysisJob* job) {
+    Analysis analysis = {0};
+    analysis.options = options;
+    analysis.job = job;
+    if (!analysis_setup(&analysis)) return 1;
+    
+    char* result = agent_run(analysis.agent, analysis.prompt, analysis.analysis_dir);
+    analysis_finish(&analysis, result);
+    return analysis.status;
+}
+
+static bool is_repository_url(const char* source) {
+    return strstr(source, "://") != NULL || string_starts_with(source, "git@");
+}
+
+// Parses a batch file: one job per line as SOURCE [PROMPT_FILE [MODEL]],
+// where SOURCE is a repository URL or a directory. Missing fields default
+// to --prompt and --model; blank lines and lines starting with # are skipped.
+static AnalysisJob* load_batch_file(const char* path, const char* default_prompt,
+                                    const char* default_model, size_t* count) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open batch file: %s\n", path);
+        return NULL;
+    }
+    
+    AnalysisJob* jobs = NULL;
+    size_t capacity = 0;
+    *count = 0;
+    
+    char line[4096];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char* fields[3] = {NULL, NULL, NULL};
+        int field_count = 0;
+        char* cursor = line;
+        
+        while (*cursor && field_count < 3) {
+            while (*cursor && isspace((unsigned char)*cursor)) cursor++;
+            if (!*cursor || *cursor == '#') break;
+            fields[field_count++] = cursor;
+            while (*cursor && !isspace((unsigned char)*cursor)) cursor++;
+            if (*cursor) *cursor++ = '\0';
+        }
+        if (field_count == 0) continue;
+        
+        const char* prompt_file = fields[1] ? fields[1] : default_prompt;
+        if (!prompt_file) {
+            fprintf(stderr, "Error: %s:%d: no prompt file and no --prompt default\n", path, line_number);
+            continue;
+        }
+        
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            jobs = safe_realloc(jobs, capacity * sizeof(AnalysisJob));
+        }
+        AnalysisJob* job = &jobs[(*count)++];
+        job->source = safe_strdup(fields[0]);
+        job->is_repo = is_repository_url(fields[0]);
+        job->prompt_file = safe_strdup(prompt_file);
+        job->model = safe_strdup(fields[2] ? fields[2] : default_model);
+        job->clone = NULL;
+    }
+    
+    fclose(file);
+    return jobs;
+}
+
+// Adds the lines of patterns not yet in *merged
+static void merge_patterns(char** merged, const char* patterns) {
+    size_t length = *merged ? strlen(*merged) : 0;
+    const char* line = patterns;
+    while (*line) {
+        const char* end = strchr(line, '\n');
+        size_t line_length = end ? (size_t)(end - line) : strlen(line);
+        
+        bool present = false;
+        const char* existing = *merged;
+        while (existing && *existing && !present) {
+            const char* existing_end = strchr(existing, '\n');
+            size_t existing_length = existing_end ? (size_t)(existing_end - existing) : strlen(existing);
+            present = existing_length == line_length && strncmp(existing, line, line_length) == 0;
+            existing = existing_end ? existing_end + 1 : existing + existing_length;
+        }
+        
+        if (!present && line_length > 0) {
+            *merged = safe_realloc(*merged, length + line_length + 2);
+            if (length > 0) (*merged)[length++] = '\n';
+            memcpy(*merged + length, line, line_length);
+            length += line_length;
+            (*merged)[length] = '\0';
+        }
+        line = end ? end + 1 : line + line_length;
+    }
+}
+
+// Groups the repository jobs by the clone they share, in job order
+static void clone_prefetch_plan(ClonePrefetch* prefetch, AnalysisJob* jobs, size_t count) {
+    const RunOptions* options = prefetch->options;
+    prefetch->repos = safe_calloc(count, sizeof(RepoClone));
+    
+    for (size_t i = 0; i < count; i++) {
+        AnalysisJob* job = &jobs[i];
+        if (!job->is_repo) continue;
+        
+        char* owner = NULL;
+        char* name = NULL;
+        if (!extract_repo_info(job->source, &owner, &name) || !owner) {
+            free(name);
+            continue;       // clone_or_update_repo_with rejects it in setup
+        }
+        size_t key_size = strlen(owner) + strlen(name) + 2;
+        char* key = safe_malloc(key_size);
+        snprintf(key, key_size, "%s/%s", owner, name);
+        free(owner);
+        free(name);
+        
+        RepoClone* repo = NULL;
+        for (size_t r = 0; r < prefetch->count && !repo; r++) {
+            if (strcmp(prefetch->repos[r].key, key) == 0) repo = &prefetch->repos[r];
+        }
+        if (repo) {
+            free(key);
+        } else {
+            repo = &prefetch->repos[prefetch->count++];
+            repo->key = key;
+            repo->url = job->source;
+            repo->prefetch = prefetch;
+        }
+        job->clone = repo;
+        
+        if (!options->sparse_checkout || repo->full_checkout) continue;
+        char* prompt = read_prompt_file(job->prompt_file);
+        if (!prompt) continue;      // the job fails in setup
+        char* patterns = sparse_patterns_for_prompt(prompt);
+        free(prompt);
+        if (patterns) {
+            merge_patterns(&repo->sparse_patterns, patterns);
+            free(patterns);
+        } else {
+            log_message(LOG_WARNING, "A prompt for %s names no file types; checking out all files", repo->url);
+            repo->full_checkout = true;
+            free(repo->sparse_patterns);
+            repo->sparse_patterns = NULL;
+        }
+    }
+}
+
+static void* clone_prefetch_worker(void* arg) {
+    ClonePrefetch* prefetch = (ClonePrefetch*)arg;
+    
+    platform_mutex_lock(&prefetch->lock);
+    while (prefetch->next < prefetch->count) {
+        RepoClone* repo = &prefetch->repos[prefetch->next++];
+        platform_mutex_unlock(&prefetch->lock);
+        
+        CloneOptions clone = clone_options(prefetch->options, repo->sparse_patterns);
+        char* path = clone_or_update_repo_with(repo->url, prefetch->options->cache_dir, &clone);
+        
+        platform_mutex_lock(&prefetch->lock);
+        repo->path = path;
+        repo->done = true;
+        platform_cond_broadcast(&prefetch->cloned);
+    }
+    platform_mutex_unlock(&prefetch->lock);
+    
+    return NULL;
+}
+
+static TechWriterAgent* batch_setup(void* job) {
+    Analysis* analysis = (Analysis*)job;
+    log_message(LOG_INFO, "Batch job: %s with %s", analysis->job->source, analysis->job->model);
+    if (!analysis_setup(analysis)) return NULL;
+    
+    agent_start(analysis->agent, analysis->prompt, analysis->analysis_dir);
+    return analysis->agent;
+}
+
+static void batch_finish(void* job, char* final_answer) {
+    Analysis* analysis = (Analysis*)job;
+    analysis_finish(analysis, final_answer);
+    if (analysis->status != 0) {
+        log_message(LOG_ERROR, "Batch job failed: %s", analysis->job->source);
+    }
+}
+
+// Runs the jobs on the event-driven engine, up to max_active at once; each
+// job's output is written as soon as it finishes. Returns the number of
+// failed jobs.
+static size_t run_batch(const RunOptions* options, AnalysisJob* jobs, size_t count,
+                        size_t max_active, int worker_threads, int clone_threads) {
+    PlatformMutex output_lock;
+    platform_mutex_init(&output_lock);
+    
+    RunOptions batch_options = *options;
+    batch_options.output_lock = &output_lock;
+    
+    // Clone every repository up front, so later jobs find theirs ready
+    // while earlier ones are still running
+    ClonePrefetch prefetch = {0};
+    prefetch.options = &batch_options;
+    platform_mutex_init(&prefetch.lock);
+    platform_cond_init(&prefetch.cloned);
+    clone_prefetch_plan(&prefetch, jobs, count);
+    
+    size_t clone_count = clone_threads > 0 ? (size_t)clone_threads : 1;
+    if (clone_count > prefetch.count) clone_count = prefetch.count;
+    PlatformThread* cloners = safe_calloc(clone_count ? clone_count : 1, sizeof(PlatformThread));
+    bool* cloner_started = safe_calloc(clone_count ? clone_count : 1, sizeof(bool));
+    if (prefetch.count > 0) {
+        log_message(LOG_INFO, "Cloning %zu repositories, %zu at once", prefetch.count, clone_count);
+    }
+    for (size_t i = 0; i < clone_count; i++) {
+        cloner_started[i] = platform_thread_create(&cloners[i], clone_prefetch_worker, &prefetch) == 0;
+    }
+    if (clone_count > 0 && !cloner_started[0]) {
+        // No clone thread: clone in the calling thread before the jobs start
+        clone_prefetch_worker(&prefetch);
+    }
+    
+    Analysis* analyses = safe_calloc(count, sizeof(Analysis));
+    void** handles = safe_calloc(count, sizeof(void*));
+    for (size_t i = 0; i < count; i++) {
+        analyses[i].options = &batch_options;
+        analyses[i].job = &jobs[i];
+        handles[i] = &analyses[i];
+    }
+    
+    EngineConfig config = {0};
+    config.max_active = max_active;
+    config.worker_threads = worker_threads;
+    config.setup = batch_setup;
+    config.finish = batch_finish;
+    engine_run(&config, handles, count);
+    
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (analyses[i].status != 0) failed++;
+    }
+    log_message(LOG_INFO, "Batch finished: %zu of %zu jobs succeeded", count - failed, count);
+    
+    for (size_t i = 0; i < clone_count; i++) {
+        if (cloner_started[i]) platform_thread_join(cloners[i]);
+    }
+    for (size_t i = 0; i < prefetch.count; i++) {
+        free(prefetch.repos[i].key);
+        free(prefetch.repos[i].sparse_patterns);
+        free(prefetch.repos[i].path);
+    }
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].clone = NULL;
+    }
+    free(prefetch.repos);
+    free(cloners);
+    free(cloner_started);
+    platform_cond_destroy(&prefetch.cloned);
+    platform_mutex_destroy(&prefetch.lock);
+    
+    free(handles);
+    free(analyses);
+    platform_mutex_destroy(&output_lock);
+    return failed;
+}
+
 int main(int argc, char* argv[]) {
     // Default values
     char* directory = NULL;
@@ -35,6 +675,30 @@ int main(int argc, char* argv[]) {
     char* file_name = NULL;
     char* model = "openai/gpt-4o-mini";
     char* base_url = NULL;
+    bool stream = false;
+    bool function_calling = false;
+    bool stable_prefix = false;
+    long token_budget = DEFAULT_TOKEN_BUDGET;
+    bool map_reduce = false;
+    bool incremental = false;
+    int map_jobs = MAP_REDUCE_DEFAULT_JOBS;
+    bool tool_cache = true;
+    bool response_cache = false;
+    size_t response_cache_size = RESPONSE_CACHE_DEFAULT_MAX_BYTES;
+    char* batch_file = NULL;
+    int jobs = 4;
+    int threads = 4;
+    long requests_per_minute = 0;
+    int clone_depth = 0;
+    bool partial_clone = false;
+    bool sparse_checkout = false;
+    int clone_jobs = 4;
+    long tokens_per_minute = 0;
+    long hedge_ms = 0;
+    LogLevel log_level = LOG_INFO;
+    LogLevel log_file_level = AGENT_DEFAULT_LOG_LEVEL;
+    char* trace_path = NULL;
+    TraceFormat trace_format = TRACE_FORMAT_JSONL;
     
     // Parse command line arguments
     static struct option long_options[] = {
@@ -46,6 +710,30 @@ int main(int argc, char* argv[]) {
         {"file-name", required_argument, 0, 0},
         {"model", required_argument, 0, 0},
         {"base-url", required_argument, 0, 0},
+        {"stream", no_argument, 0, 0},
+        {"function-calling", no_argument, 0, 0},
+        {"stable-prefix", no_argument, 0, 0},
+        {"token-budget", required_argument, 0, 0},
+        {"map-reduce", no_argument, 0, 0},
+        {"map-jobs", required_argument, 0, 0},
+        {"incremental", no_argument, 0, 0},
+        {"no-tool-cache", no_argument, 0, 0},
+        {"response-cache", no_argument, 0, 0},
+        {"response-cache-size", required_argument, 0, 0},
+        {"batch", required_argument, 0, 0},
+        {"jobs", required_argument, 0, 0},
+        {"threads", required_argument, 0, 0},
+        {"rpm", required_argument, 0, 0},
+        {"clone-depth", required_argument, 0, 0},
+        {"partial-clone", no_argument, 0, 0},
+        {"sparse-checkout", no_argument, 0, 0},
+        {"clone-jobs", required_argument, 0, 0},
+        {"tpm", required_argument, 0, 0},
+        {"hedge-ms", required_argument, 0, 0},
+        {"log-level", required_argument, 0, 0},
+        {"log-file-level", required_argument, 0, 0},
+        {"trace", required_argument, 0, 0},
+        {"trace-format", required_argument, 0, 0},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
@@ -73,6 +761,67 @@ int main(int argc, char* argv[]) {
                     model = optarg;
                 } else if (strcmp(long_options[option_index].name, "base-url") == 0) {
                     base_url = optarg;
+                } else if (strcmp(long_options[option_index].name, "stream") == 0) {
+                    stream = true;
+                } else if (strcmp(long_options[option_index].name, "function-calling") == 0) {
+                    function_calling = true;
+                } else if (strcmp(long_options[option_index].name, "stable-prefix") == 0) {
+                    stable_prefix = true;
+                } else if (strcmp(long_options[option_index].name, "token-budget") == 0) {
+                    token_budget = strtol(optarg, NULL, 10);
+                } else if (strcmp(long_options[option_index].name, "map-reduce") == 0) {
+                    map_reduce = true;
+                } else if (strcmp(long_options[option_index].name, "map-jobs") == 0) {
+                    map_jobs = atoi(optarg);
+                } else if (strcmp(long_options[option_index].name, "incremental") == 0) {
+                    incremental = true;
+                } else if (strcmp(long_options[option_index].name, "no-tool-cache") == 0) {
+                    tool_cache = false;
+                } else if (strcmp(long_options[option_index].name, "response-cache") == 0) {
+                    response_cache = true;
+                } else if (strcmp(long_options[option_index].name, "response-cache-size") == 0) {
+                    response_cache_size = (size_t)strtoul(optarg, NULL, 10) * 1024 * 1024;
+                } else if (strcmp(long_options[option_index].name, "batch") == 0) {
+                    batch_file = optarg;
+                } else if (strcmp(long_options[option_index].name, "jobs") == 0) {
+                    jobs = atoi(optarg);
+                } else if (strcmp(long_options[option_index].name, "threads") == 0) {
+                    threads = atoi(optarg);
+                } else if (strcmp(long_options[option_index].name, "rpm") == 0) {
+                    requests_per_minute = strtol(optarg, NULL, 10);
+                } else if (strcmp(long_options[option_index].name, "tpm") == 0) {
+                    tokens_per_minute = strtol(optarg, NULL, 10);
+                } else if (strcmp(long_options[option_index].name, "hedge-ms") == 0) {
+                    hedge_ms = strtol(optarg, NULL, 10);
+                } else if (strcmp(long_options[option_index].name, "log-level") == 0) {
+                    if (!log_level_parse(optarg, &log_level)) {
+                        fprintf(stderr, "Error: --log-level must be debug, info, warning, error or off\n");
+                        return 1;
+                    }
+                } else if (strcmp(long_options[option_index].name, "log-file-level") == 0) {
+                    if (!log_level_parse(optarg, &log_file_level)) {
+                        fprintf(stderr, "Error: --log-file-level must be debug, info, warning, error or off\n");
+                        return 1;
+                    }
+                } else if (strcmp(long_options[option_index].name, "clone-depth") == 0) {
+                    clone_depth = atoi(optarg);
+                } else if (strcmp(long_options[option_index].name, "partial-clone") == 0) {
+                    partial_clone = true;
+                } else if (strcmp(long_options[option_index].name, "sparse-checkout") == 0) {
+                    sparse_checkout = true;
+                } else if (strcmp(long_options[option_index].name, "clone-jobs") == 0) {
+                    clone_jobs = atoi(optarg);
+                } else if (strcmp(long_options[option_index].name, "trace") == 0) {
+                    trace_path = optarg;
+                } else if (strcmp(long_options[option_index].name, "trace-format") == 0) {
+                    if (strcmp(optarg, "chrome") == 0) {
+                        trace_format = TRACE_FORMAT_CHROME;
+                    } else if (strcmp(optarg, "jsonl") == 0) {
+                        trace_format = TRACE_FORMAT_JSONL;
+                    } else {
+                        fprintf(stderr, "Error: --trace-format must be jsonl or chrome\n");
+                        return 1;
+                    }
                 }
                 break;
             case 'h':
@@ -83,118 +832,96 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    log_set_level(log_level);
+    log_start();
+    
     // Get positional directory argument
     if (optind < argc) {
         directory = argv[optind];
     }
     
     // Validate arguments
-    if (!prompt_file) {
+    if (!prompt_file && !batch_file) {
         fprintf(stderr, "Error: --prompt is required\n");
         return 1;
     }
     
-    // Read prompt file
-    FILE* prompt_fp = fopen(prompt_file, "r");
-    if (!prompt_fp) {
-        fprintf(stderr, "Error: Cannot open prompt file: %s\n", prompt_file);
+    if (function_calling && stream) {
+        // Streamed tool calls arrive as argument fragments; not supported
+        log_message(LOG_WARNING, "--stream is ignored with --function-calling");
+        stream = false;
+    }
+    
+    http_global_init();
+    HttpPool* pool = http_pool_create();
+    if (!pool) {
+        fprintf(stderr, "Error: Failed to initialize HTTP\n");
         return 1;
     }
+    http_pool_set_rate_limit(pool, requests_per_minute, tokens_per_minute);
+    http_pool_set_hedging(pool, hedge_ms);
     
-    fseek(prompt_fp, 0, SEEK_END);
-    long prompt_size = ftell(prompt_fp);
-    fseek(prompt_fp, 0, SEEK_SET);
+    if (tool_cache) {
+        tool_cache_init(cache_dir);
+    }
+    if (response_cache) {
+        response_cache_init(cache_dir, response_cache_size);
+    }
+    trace_init(trace_path, trace_format);
     
-    char* prompt = safe_malloc(prompt_size + 1);
-    fread(prompt, 1, prompt_size, prompt_fp);
-    prompt[prompt_size] = '\0';
-    fclose(prompt_fp);
+    RunOptions options = {0};
+    options.cache_dir = cache_dir;
+    options.output_dir = output_dir;
+    options.extension = extension;
+    options.file_name = file_name;
+    options.base_url = base_url;
+    options.stream = stream;
+    options.function_calling = function_calling;
+    options.stable_prefix = stable_prefix;
+    options.token_budget = token_budget;
+    options.map_reduce_jobs = map_reduce ? (map_jobs > 0 ? (size_t)map_jobs : 1) : 0;
+    options.pool = pool;
+    options.clone_depth = clone_depth > 0 ? clone_depth : 0;
+    options.partial_clone = partial_clone;
+    options.sparse_checkout = sparse_checkout;
+    options.log_file_level = log_file_level;
+    options.incremental = incremental;
     
-    // Handle repository or directory
-    char* repo_name = NULL;
-    char* analysis_dir = NULL;
-    char* cloned_dir = NULL;
-    
-    if (repo_url) {
-        cloned_dir = clone_or_update_repo(repo_url, cache_dir);
-        if (!cloned_dir) {
-            fprintf(stderr, "Error: Failed to clone/update repository\n");
-            free(prompt);
-            return 1;
+    int status = 0;
+    if (batch_file) {
+        size_t job_count = 0;
+        AnalysisJob* batch_jobs = load_batch_file(batch_file, prompt_file, model, &job_count);
+        if (!batch_jobs && job_count == 0) {
+            status = 1;
+        } else {
+            // Agents are created from several threads from here on
+            agent_global_init();
+            status = run_batch(&options, batch_jobs, job_count, jobs > 0 ? (size_t)jobs : 1, threads, clone_jobs) > 0 ? 1 : 0;
         }
-        analysis_dir = cloned_dir;
         
-        // Extract repo name
-        char* owner = NULL;
-        extract_repo_info(repo_url, &owner, &repo_name);
-        free(owner);
-    } else {
-        if (!directory) {
-            directory = ".";
+        for (size_t i = 0; i < job_count; i++) {
+            free(batch_jobs[i].source);
+            free(batch_jobs[i].prompt_file);
+            free(batch_jobs[i].model);
         }
-        analysis_dir = platform_normalize_path(directory);
-        
-        // Get base name for repo_name
-        char* last_sep = strrchr(analysis_dir, PATH_SEPARATOR_CHAR);
-        repo_name = safe_strdup(last_sep ? last_sep + 1 : analysis_dir);
-    }
-    
-    // Create agent and run analysis
-    TechWriterAgent* agent = agent_create(model, base_url);
-    if (!agent) {
-        fprintf(stderr, "Error: Failed to create agent\n");
-        free(prompt);
-        free(cloned_dir);
-        free(repo_name);
-        if (!repo_url) free(analysis_dir);
-        return 1;
-    }
-    
-    char* analysis_result = agent_run(agent, prompt, analysis_dir);
-    
-    // Save results
-    save_results(analysis_result, repo_name, model, output_dir, extension, file_name);
-    
-    // Create metadata
-    char output_path[1024];
-    if (file_name) {
-        snprintf(output_path, sizeof(output_path), "%s%c%s", output_dir, PATH_SEPARATOR_CHAR, file_name);
+        free(batch_jobs);
     } else {
-        // Same logic as save_results for consistency
-        char* model_copy = safe_strdup(model);
-        char* slash = strchr(model_copy, '/');
-        if (slash) {
-            *slash = '\0';
-            const char* vendor = model_copy;
-            const char* model_id = slash + 1;
-            
-            char sanitized_model[256];
-            size_t j = 0;
-            for (size_t i = 0; model_id[i] && j < sizeof(sanitized_model) - 1; i++) {
-                if (isalnum(model_id[i]) || model_id[i] == '-' || model_id[i] == '_') {
-                    sanitized_model[j++] = model_id[i];
-                } else {
-                    sanitized_model[j++] = '-';
-                }
-            }
-            sanitized_model[j] = '\0';
-            
-            time_t now = time(NULL);
-            snprintf(output_path, sizeof(output_path), "%s%c%ld-%s-%s-%s%s",
-                     output_dir, PATH_SEPARATOR_CHAR, (long)now, repo_name, vendor, sanitized_model, extension);
-        }
-        free(model_copy);
+        AnalysisJob job;
+        job.source = repo_url ? repo_url : (directory ? directory : ".");
+        job.is_repo = repo_url != NULL;
+        job.prompt_file = prompt_file;
+        job.model = model;
+        job.clone = NULL;
+        status = run_analysis(&options, &job);
     }
     
-    create_metadata(output_path, model, repo_url ? repo_url : "", repo_name);
-    
     // Cleanup
-    agent_destroy(agent);
-    free(analysis_result);
-    free(prompt);
-    free(cloned_dir);
-    free(repo_name);
-    if (!repo_url && analysis_dir != directory) free(analysis_dir);
-    
-    return 0;
-}
\ No newline at end of file
+    tool_cache_shutdown();
+    response_cache_shutdown();
+    trace_shutdown();
+    http_pool_destroy(pool);
+    http_global_cleanup();
+    log_shutdown();
+    
+    return status;
+}
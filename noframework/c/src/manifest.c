@@ -0,0 +1,167 @@
+#include "manifest.h"
+#include "cache.h"
+#include "cJSON.h"
+#include <string.h>
+#include <ctype.h>
+
+// Longer diffs are not worth an incremental update
+#define MANIFEST_MAX_CHANGES (256 * 1024)
+
+char* manifest_path(const char* output_dir, const char* repo_name, const char* model, const char* prompt_hash) {
+    // vendor/model as in build_output_path, without the timestamp
+    char model_name[256];
+    snprintf(model_name, sizeof(model_name), "%s", model);
+    for (char* c = model_name; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '-' && *c != '_') *c = '-';
+    }
+    
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%c%s-%s-%s.manifest.json", output_dir, PATH_SEPARATOR_CHAR,
+             repo_name, model_name, prompt_hash);
+    return safe_strdup(path);
+}
+
+static char* read_text_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(file);
+        return NULL;
+    }
+    
+    char* text = safe_malloc((size_t)size + 1);
+    size_t read = fread(text, 1, (size_t)size, file);
+    text[read] = '\0';
+    fclose(file);
+    return text;
+}
+
+static char* json_string(const cJSON* object, const char* name) {
+    const cJSON* item = cJSON_GetObjectItem(object, name);
+    return cJSON_IsString(item) ? safe_strdup(item->valuestring) : NULL;
+}
+
+AnalysisManifest* manifest_load(const char* path) {
+    char* text = read_text_file(path);
+    if (!text) return NULL;
+    cJSON* json = cJSON_Parse(text);
+    free(text);
+    if (!json) {
+        log_message(LOG_WARNING, "Ignoring unreadable manifest: %s", path);
+        return NULL;
+    }
+    
+    AnalysisManifest* manifest = safe_calloc(1, sizeof(AnalysisManifest));
+    manifest->commit = json_string(json, "commit");
+    manifest->prompt_hash = json_string(json, "prompt_hash");
+    manifest->model = json_string(json, "model");
+    manifest->document = json_string(json, "document");
+    
+    const cJSON* files = cJSON_GetObjectItem(json, "files_read");
+    const cJSON* file;
+    cJSON_ArrayForEach(file, files) {
+        if (cJSON_IsString(file)) manifest_add_file_read(manifest, file->valuestring);
+    }
+    cJSON_Delete(json);
+    
+    if (!manifest->commit || !manifest->prompt_hash || !manifest->document) {
+        log_message(LOG_WARNING, "Ignoring incomplete manifest: %s", path);
+        manifest_destroy(manifest);
+        return NULL;
+    }
+    return manifest;
+}
+
+bool manifest_save(const char* path, const AnalysisManifest* manifest) {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "commit", manifest->commit);
+    cJSON_AddStringToObject(json, "prompt_hash", manifest->prompt_hash);
+    cJSON_AddStringToObject(json, "model", manifest->model ? manifest->model : "");
+    cJSON* files = cJSON_AddArrayToObject(json, "files_read");
+    for (size_t i = 0; i < manifest->files_read_count; i++) {
+        cJSON_AddItemToArray(files, cJSON_CreateString(manifest->files_read[i]));
+    }
+    cJSON_AddStringToObject(json, "document", manifest->document);
+    
+    char* text = cJSON_Print(json);
+    cJSON_Delete(json);
+    
+    // Concurrent batch jobs on the same repository never see a torn file
+    bool saved = platform_write_file_atomic(path, text, strlen(text)) == 0;
+    free(text);
+    
+    if (!saved) {
+        log_message(LOG_ERROR, "Cannot write manifest: %s", path);
+        return false;
+    }
+    log_message(LOG_INFO, "Manifest saved to: %s", path);
+    return true;
+}
+
+void manifest_destroy(AnalysisManifest* manifest) {
+    if (!manifest) return;
+    free(manifest->commit);
+    free(manifest->prompt_hash);
+    free(manifest->model);
+    free(manifest->document);
+    for (size_t i = 0; i < manifest->files_read_count; i++) {
+        free(manifest->files_read[i]);
+    }
+    free(manifest->files_read);
+    free(manifest);
+}
+
+void manifest_add_file_read(AnalysisManifest* manifest, const char* path) {
+    for (size_t i = 0; i < manifest->files_read_count; i++) {
+        if (strcmp(manifest->files_read[i], path) == 0) return;
+    }
+    manifest->files_read = safe_realloc(manifest->files_read, (manifest->files_read_count + 1) * sizeof(char*));
+    manifest->files_read[manifest->files_read_count++] = safe_strdup(path);
+}
+
+char* manifest_prompt_hash(const char* prompt) {
+    ContentHash hash;
+    content_hash_init(&hash);
+    content_hash_update(&hash, prompt, strlen(prompt));
+    
+    char hex[33];
+    snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)hash.a, (unsigned long long)hash.b);
+    return safe_strdup(hex);
+}
+
+char* git_head_commit(const char* directory) {
+    // Only work tree roots, i.e. clones; a directory inside some other
+    // repository would pick up that repository's history
+    char git_path[1024];
+    snprintf(git_path, sizeof(git_path), "%s%c.git", directory, PATH_SEPARATOR_CHAR);
+    if (!platform_is_directory(git_path)) return NULL;
+    
+    char command[1200];
+    char output[128];
+    snprintf(command, sizeof(command), "cd \"%s\" && git rev-parse --verify --quiet HEAD", directory);
+    if (platform_execute_command(command, output, sizeof(output)) != 0) return NULL;
+    
+    size_t length = strspn(output, "0123456789abcdef");
+    if (length < 40) return NULL;
+    output[length] = '\0';
+    return safe_strdup(output);
+}
+
+char* git_changed_files(const char* directory, const char* commit) {
+    if (strspn(commit, "0123456789abcdef") != strlen(commit)) return NULL;
+    
+    char command[1200];
+    snprintf(command, sizeof(command), "cd \"%s\" && git diff --name-status --no-renames %s HEAD --",
+             directory, commit);
+    char* output = safe_malloc(MANIFEST_MAX_CHANGES);
+    int status = platform_execute_command(command, output, MANIFEST_MAX_CHANGES);
+    if (status != 0 || strlen(output) >= MANIFEST_MAX_CHANGES - 512) {
+        free(output);
+        return NULL;
+    }
+    return output;
+}
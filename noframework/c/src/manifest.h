@@ -0,0 +1,38 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "platform.h"
+
+// What an analysis of a git work tree leaves behind for --incremental: the
+// commit it saw, its prompt, the files it read and the document it wrote.
+// Stored as JSON beside the results, under a name that does not change
+// from run to run, so the next run of the same repository, prompt and
+// model can diff against that commit and only have the model look at what
+// changed.
+typedef struct AnalysisManifest {
+    char* commit;               // HEAD of the work tree, hex
+    char* prompt_hash;          // manifest_prompt_hash of the prompt
+    char* model;
+    char* document;
+    char** files_read;          // read_file paths, relative to the work tree
+    size_t files_read_count;
+} AnalysisManifest;
+
+// <output_dir>/<repo_name>-<vendor>-<model>-<prompt_hash>.manifest.json, so
+// analyses with different prompts keep manifests of their own
+char* manifest_path(const char* output_dir, const char* repo_name, const char* model, const char* prompt_hash);
+// NULL if the file is missing or not a manifest
+AnalysisManifest* manifest_load(const char* path);
+bool manifest_save(const char* path, const AnalysisManifest* manifest);
+void manifest_destroy(AnalysisManifest* manifest);
+void manifest_add_file_read(AnalysisManifest* manifest, const char* path);
+char* manifest_prompt_hash(const char* prompt);
+
+// HEAD of the work tree rooted at directory, or NULL if it is none
+char* git_head_commit(const char* directory);
+// `git diff --name-status` lines from commit to HEAD ("" if nothing
+// changed), or NULL if they cannot be had, e.g. because a shallow clone
+// no longer has the commit
+char* git_changed_files(const char* directory, const char* commit);
+
+#endif // MANIFEST_H
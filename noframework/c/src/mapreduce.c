@@ -0,0 +1,422 @@
+#include "mapreduce.h"
+#include "tools.h"
+#include "index.h"
+#include "cJSON.h"
+
+#define MAP_SYSTEM_PROMPT \
+"You summarise part of a codebase for a technical writer who will not read its files.\n" \
+"You are given the documentation task and the contents of some files of the repository. Write a concise\n" \
+"summary of these files with respect to the task: what each file or group of files is for, the main types,\n" \
+"functions, configuration and entry points it defines, and how it relates to the rest of the codebase.\n" \
+"Name files by their paths. Leave out anything the task does not need. Answer with the summary only."
+
+#define REDUCE_SYSTEM_PROMPT \
+"You combine summaries of parts of a codebase for a technical writer who will not read its files.\n" \
+"You are given the documentation task and summaries of consecutive groups of the repository's files.\n" \
+"Merge them into one concise summary with respect to the task: keep file paths, the main types, functions,\n" \
+"configuration and entry points, and how the parts relate; drop repetition. Answer with the summary only."
+
+// One summarization call: its request body and, once answered, the summary
+typedef struct {
+    StringBuffer body;
+    HttpBodyPart part;
+    HttpClient* client;         // while in flight
+    char* summary;              // NULL until answered, or if the call failed
+    size_t first;               // reduce calls: the summaries it combines
+    size_t count;
+} MapReduceCall;
+
+// The calls of one map or reduce round, at most max_active of them in flight
+typedef struct {
+    TechWriterAgent* agent;
+    HttpMulti* multi;
+    HttpClient** idle;          // clients without a transfer
+    size_t idle_count;
+} MapReduceRun;
+
+static void append_escaped(StringBuffer* buffer, const char* str, size_t length) {
+    size_t escaped_length = cJSON_EscapedLength(str, length);
+    string_buffer_reserve(buffer, escaped_length);
+    cJSON_EscapeTo(buffer->data + buffer->size, str, length);
+    buffer->size += escaped_length;
+    buffer->data[buffer->size] = '\0';
+}
+
+// {"model":...,"messages":[{"role":"system",...},{"role":"user","content":"<task>
+// The caller appends the rest of the user message and then call_end.
+static void call_begin(MapReduceCall* call, const TechWriterAgent* agent, const char* system_prompt,
+                       const char* prompt, size_t capacity) {
+    memset(call, 0, sizeof(MapReduceCall));
+    string_buffer_init(&call->body, capacity + strlen(prompt) + 2048);
+    string_buffer_append(&call->body, "{\"model\":", 9);
+    json_append_string(&call->body, agent->model_id, strlen(agent->model_id));
+    const char* system_message = ",\"messages\":[{\"role\":\"system\",\"content\":";
+    string_buffer_append(&call->body, system_message, strlen(system_message));
+    json_append_string(&call->body, system_prompt, strlen(system_prompt));
+    const char* user_message = "},{\"role\":\"user\",\"content\":\"";
+    string_buffer_append(&call->body, user_message, strlen(user_message));
+    append_escaped(&call->body, "Documentation task:\n", 20);
+    append_escaped(&call->body, prompt, strlen(prompt));
+    append_escaped(&call->body, "\n\n", 2);
+}
+
+static void call_end(MapReduceCall* call) {
+    const char* suffix = "\"}],\"temperature\":0}";
+    string_buffer_append(&call->body, suffix, strlen(suffix));
+}
+
+static void calls_destroy(MapReduceCall* calls, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        string_buffer_free(&calls[i].body);
+        free(calls[i].summary);
+    }
+    free(calls);
+}
+
+// Appends one file to a map call, cut at a line boundary to at most
+// max_bytes; returns the bytes of content added, 0 for skipped files
+static size_t append_file(MapReduceCall* call, const char* path, const char* name, size_t max_bytes) {
+    MappedFile mapped;
+    if (platform_map_file(path, &mapped) != 0) return 0;
+    
+    size_t size = mapped.size;
+    bool truncated = false;
+    if (size > max_bytes) {
+        size = max_bytes;
+        while (size > 0 && mapped.data[size - 1] != '\n') size--;
+        if (size == 0) size = max_bytes;
+        truncated = true;
+    }
+    if (size == 0 || memchr(mapped.data, '\0', size) != NULL) {
+        platform_unmap_file(&mapped);
+        return 0;
+    }
+    
+    append_escaped(&call->body, "File ", 5);
+    append_escaped(&call->body, name, strlen(name));
+    append_escaped(&call->body, ":\n", 2);
+    append_escaped(&call->body, mapped.data, size);
+    if (size > 0 && mapped.data[size - 1] != '\n') append_escaped(&call->body, "\n", 1);
+    if (truncated) append_escaped(&call->body, "[rest of the file left out]\n", 28);
+    append_escaped(&call->body, "\n", 1);
+    
+    platform_unmap_file(&mapped);
+    return size;
+}
+
+// One map call per chunk of about chunk_bytes of file contents, in listing
+// order; a file larger than a chunk gets one of its own and is truncated
+static MapReduceCall* map_calls_create(TechWriterAgent* agent, const char* prompt, const char* directory,
+                                       size_t chunk_bytes, size_t* count) {
+    *count = 0;
+    char* listing = find_all_matching_files_indexed(agent->index, directory, "*");
+    cJSON* files = cJSON_Parse(listing);
+    free(listing);
+    if (!cJSON_IsArray(files)) {
+        cJSON_Delete(files);
+        return NULL;
+    }
+    
+    size_t directory_length = strlen(directory);
+    while (directory_length > 1 && directory[directory_length - 1] == PATH_SEPARATOR_CHAR) directory_length--;
+    
+    MapReduceCall* calls = NULL;
+    size_t capacity = 0;
+    size_t used = 0;            // content bytes in the last call
+    size_t file_count = 0;
+    size_t left_out = 0;
+    cJSON* item = NULL;
+    cJSON_ArrayForEach(item, files) {
+        if (!cJSON_IsString(item)) continue;
+        const char* path = item->valuestring;
+        const char* name = path;
+        if (strncmp(path, directory, directory_length) == 0 && path[directory_length] == PATH_SEPARATOR_CHAR) {
+            name = path + directory_length + 1;
+        }
+        
+        FileSignature signature;
+        if (platform_file_signature(path, &signature) != 0 || signature.size == 0) continue;
+        size_t size = signature.size < chunk_bytes ? (size_t)signature.size : chunk_bytes;
+        if (*count == 0 || used + size > chunk_bytes) {
+            if (*count == MAP_REDUCE_MAX_CHUNKS) {
+                left_out++;
+                continue;
+            }
+            if (*count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                calls = safe_realloc(calls, capacity * sizeof(MapReduceCall));
+            }
+            call_begin(&calls[(*count)++], agent, MAP_SYSTEM_PROMPT, prompt, chunk_bytes + chunk_bytes / 8);
+            used = 0;
+        }
+        
+        size_t added = append_file(&calls[*count - 1], path, name, chunk_bytes);
+        if (added > 0) file_count++;
+        used += added;
+    }
+    cJSON_Delete(files);
+    
+    if (*count > 0 && used == 0) {
+        string_buffer_free(&calls[*count - 1].body);
+        (*count)--;
+    }
+    for (size_t i = 0; i < *count; i++) {
+        call_end(&calls[i]);
+    }
+    
+    log_message(LOG_INFO, "Map-reduce: %zu files in %zu chunks of up to %zu tokens", file_count, *count,
+                chunk_bytes / 4);
+    if (left_out > 0) {
+        log_message(LOG_WARNING, "Map-reduce: %zu files beyond %d chunks left out", left_out, MAP_REDUCE_MAX_CHUNKS);
+    }
+    return calls;
+}
+
+// Content of a completion as a heap string, or NULL
+static char* completion_content(const HttpResponse* response) {
+    if (response->status_code != 200) return NULL;
+    
+    size_t length = 0;
+    const char* content = cJSON_FindPath(response->data, response->size, "choices.0.message.content", &length);
+    if (!content || *content != '"') return NULL;
+    char* text = safe_malloc(length);
+    if (!cJSON_UnescapeTo(text, content, length)) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+static size_t usage_count(const HttpResponse* response, const char* path) {
+    const char* value = cJSON_FindPath(response->data, response->size, path, NULL);
+    if (!value || *value < '0' || *value > '9') return 0;
+    return (size_t)strtod(value, NULL);
+}
+
+static void record_response(TechWriterAgent* agent, const MapReduceCall* call, const HttpResponse* response,
+                            bool cached) {
+    if (cached) {
+        agent->stats.cached_responses++;
+        return;
+    }
+    agent->stats.llm_requests++;
+    agent->stats.request_bytes += call->body.size;
+    agent->stats.response_bytes += response->size;
+    agent->stats.http_ms += response->timing.ms[HTTP_PHASE_TOTAL];
+    if (response->attempts > 1) agent->stats.http_retries += (size_t)(response->attempts - 1);
+    if (response->hedged) agent->stats.hedged_responses++;
+    agent->stats.prompt_tokens += usage_count(response, "usage.prompt_tokens");
+    agent->stats.cached_tokens += usage_count(response, "usage.prompt_tokens_details.cached_tokens");
+    agent->stats.completion_tokens += usage_count(response, "usage.completion_tokens");
+}
+
+// Response cache key: the endpoint and the exact request bytes
+static void call_cache_key(const TechWriterAgent* agent, const MapReduceCall* call, ContentHash* key) {
+    content_hash_init(key);
+    content_hash_update(key, agent->client->base_url, strlen(agent->client->base_url) + 1);
+    content_hash_update(key, "m", 1);
+    content_hash_update(key, call->body.data, call->body.size);
+}
+
+static bool call_replay(MapReduceRun* run, MapReduceCall* call) {
+    if (!response_cache_enabled()) return false;
+    
+    ContentHash key;
+    call_cache_key(run->agent, call, &key);
+    HttpResponse response = {0};
+    response.data = response_cache_get(&key, &response.size);
+    if (!response.data) return false;
+    
+    response.status_code = 200;
+    call->summary = completion_content(&response);
+    record_response(run->agent, call, &response, true);
+    free(response.data);
+    return call->summary != NULL;
+}
+
+static void call_done(void* owner, HttpResponse* response, void* userdata) {
+    MapReduceCall* call = (MapReduceCall*)owner;
+    MapReduceRun* run = (MapReduceRun*)userdata;
+    run->idle[run->idle_count++] = call->client;
+    call->client = NULL;
+    if (!response) return;
+    
+    record_response(run->agent, call, response, false);
+    call->summary = completion_content(response);
+    if (call->summary && response_cache_enabled()) {
+        ContentHash key;
+        call_cache_key(run->agent, call, &key);
+        response_cache_put(&key, response->data, response->size);
+    }
+    http_response_destroy(response);
+}
+
+// Sends every call, keeping as many in flight as there are clients
+static void calls_run(MapReduceRun* run, MapReduceCall* calls, size_t count) {
+    size_t next = 0;
+    while (next < count || http_multi_pending(run->multi) > 0) {
+        while (next < count && run->idle_count > 0) {
+            MapReduceCall* call = &calls[next++];
+            if (call_replay(run, call)) continue;
+            
+            call->client = run->idle[--run->idle_count];
+            call->part.data = call->body.data;
+            call->part.size = call->body.size;
+            HttpTransfer* transfer = http_transfer_create(call->client, "chat/completions", &call->part, 1,
+                                                          false, NULL, NULL);
+            if (!transfer) {
+                run->idle[run->idle_count++] = call->client;
+                call->client = NULL;
+                continue;
+            }
+            http_multi_add(run->multi, transfer, call);
+        }
+        if (http_multi_pending(run->multi) > 0) {
+            http_multi_poll(run->multi, 1000, call_done, run);
+        }
+    }
+}
+
+// Folds the summaries in place, consecutive groups of up to chunk_bytes
+// (at least two each) per reduce call, until one is left. A failed call
+// keeps its group's summaries, concatenated, so every round shrinks.
+static char* reduce_summaries(MapReduceRun* run, const char* prompt, char** summaries, size_t count,
+                              size_t chunk_bytes) {
+    while (count > 1) {
+        log_message(LOG_INFO, "Map-reduce: combining %zu summaries", count);
+        MapReduceCall* calls = safe_calloc(count, sizeof(MapReduceCall));
+        size_t call_count = 0;
+        for (size_t i = 0; i < count; ) {
+            MapReduceCall* call = &calls[call_count++];
+            if (i == count - 1) {
+                // The last one carries over as it is
+                memset(call, 0, sizeof(MapReduceCall));
+                call->first = i++;
+                call->count = 1;
+                continue;
+            }
+            call_begin(call, run->agent, REDUCE_SYSTEM_PROMPT, prompt, chunk_bytes);
+            call->first = i;
+            size_t used = 0;
+            while (i < count && (i - call->first < 2 || used + strlen(summaries[i]) <= chunk_bytes)) {
+                char heading[64];
+                int length = snprintf(heading, sizeof(heading), "Summary %zu:\n", i - call->first + 1);
+                append_escaped(&call->body, heading, (size_t)length);
+                append_escaped(&call->body, summaries[i], strlen(summaries[i]));
+                append_escaped(&call->body, "\n\n", 2);
+                used += strlen(summaries[i]);
+                i++;
+            }
+            call->count = i - call->first;
+            call_end(call);
+        }
+        
+        size_t sent = 0;
+        for (size_t i = 0; i < call_count; i++) {
+            if (calls[i].count > 1) calls[sent++] = calls[i];
+        }
+        calls_run(run, calls, sent);
+        
+        // Replace each group by its combined summary
+        size_t folded = 0;
+        size_t call = 0;
+        for (size_t i = 0; i < count; ) {
+            if (call < sent && calls[call].first == i) {
+                char* summary = calls[call].summary;
+                calls[call].summary = NULL;
+                if (!summary) {
+                    StringBuffer joined;
+                    string_buffer_init(&joined, 1024);
+                    for (size_t j = i; j < i + calls[call].count; j++) {
+                        string_buffer_append(&joined, summaries[j], strlen(summaries[j]));
+                        string_buffer_append(&joined, "\n\n", 2);
+                    }
+                    summary = joined.data;
+                }
+                for (size_t j = i; j < i + calls[call].count; j++) {
+                    free(summaries[j]);
+                }
+                i += calls[call].count;
+                call++;
+                summaries[folded++] = summary;
+            } else {
+                summaries[folded++] = summaries[i++];
+            }
+        }
+        count = folded;
+        calls_destroy(calls, sent);
+    }
+    return count == 1 ? summaries[0] : NULL;
+}
+
+char* map_reduce_summarize(TechWriterAgent* agent, const char* prompt, const char* directory,
+                           const MapReduceOptions* options) {
+    uint64_t started_ns = platform_monotonic_ns();
+    size_t chunk_bytes = (options->chunk_tokens > 0 ? options->chunk_tokens : 1) * 4;
+    size_t max_active = options->max_active > 0 ? options->max_active : 1;
+    
+    // The index stays for the tools of the ReAct steps that follow
+    Arena* step_arena = arena_set_current(NULL);
+    if (!agent->index) agent->index = repo_index_build(directory);
+    
+    size_t count = 0;
+    MapReduceCall* calls = map_calls_create(agent, prompt, directory, chunk_bytes, &count);
+    if (count == 0) {
+        free(calls);
+        arena_set_current(step_arena);
+        return NULL;
+    }
+    
+    // One client per call in flight. They get connections of their own, as
+    // other loops may be running on the agent's pool (batch mode), but
+    // share its rate limit.
+    MapReduceRun run = {0};
+    run.agent = agent;
+    run.multi = http_multi_create();
+    HttpPool* pool = http_pool_create_linked(agent->client->pool);
+    run.idle = safe_calloc(max_active, sizeof(HttpClient*));
+    for (size_t i = 0; i < max_active && i < count && run.multi && pool; i++) {
+        HttpClient* client = http_client_create_pooled(agent->client->base_url, agent->client->api_key, pool);
+        if (!client) break;
+        run.idle[run.idle_count++] = client;
+    }
+    size_t client_count = run.idle_count;
+    
+    char* summary = NULL;
+    if (client_count > 0) {
+        log_message(LOG_INFO, "Map-reduce: summarizing %zu chunks, %zu at once", count, client_count);
+        calls_run(&run, calls, count);
+        
+        char** summaries = safe_calloc(count, sizeof(char*));
+        size_t summarized = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (calls[i].summary) {
+                summaries[summarized++] = calls[i].summary;
+                calls[i].summary = NULL;
+            }
+        }
+        if (summarized < count) {
+            log_message(LOG_WARNING, "Map-reduce: %zu of %zu chunks could not be summarized",
+                        count - summarized, count);
+        }
+        summary = reduce_summaries(&run, prompt, summaries, summarized, chunk_bytes);
+        free(summaries);
+    } else {
+        log_message(LOG_ERROR, "Map-reduce: cannot create HTTP clients");
+    }
+    
+    for (size_t i = 0; i < run.idle_count; i++) {
+        http_client_destroy(run.idle[i]);
+    }
+    free(run.idle);
+    http_multi_destroy(run.multi);
+    http_pool_destroy(pool);
+    calls_destroy(calls, count);
+    arena_set_current(step_arena);
+    
+    if (summary) {
+        log_message(LOG_INFO, "Map-reduce: summary of %zu bytes in %.1f s", strlen(summary),
+                    (double)(platform_monotonic_ns() - started_ns) / 1e9);
+    }
+    return summary;
+}
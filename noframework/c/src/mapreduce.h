@@ -0,0 +1,27 @@
+#ifndef MAPREDUCE_H
+#define MAPREDUCE_H
+
+#include "agent.h"
+
+// Map-reduce summary of a repository too large to explore step by step.
+// The files find_all_matching_files lists are packed, in listing order,
+// into chunks of about chunk_tokens each. Every chunk is summarized by an
+// LLM call of its own, up to max_active calls at once on the agent's
+// connection pool, and the summaries are folded together by further calls
+// until one remains. Wall time then grows with chunks / max_active instead
+// of with the number of ReAct steps it would take to read the same files.
+#define MAP_REDUCE_DEFAULT_JOBS 4
+#define MAP_REDUCE_MAX_CHUNKS 256       // files beyond this many chunks are left out
+
+typedef struct {
+    size_t chunk_tokens;        // file contents per map call
+    size_t max_active;          // calls in flight at once
+} MapReduceOptions;
+
+// Summary of the files below directory with respect to prompt, as a heap
+// string, or NULL if no chunk could be summarized. Builds agent->index if
+// it has none; calls are counted in agent->stats.
+char* map_reduce_summarize(TechWriterAgent* agent, const char* prompt, const char* directory,
+                           const MapReduceOptions* options);
+
+#endif // MAPREDUCE_H
@@ -98,6 +98,344 @@ int platform_execute_command(const char* command, char* output, size_t output_si
 #endif
 }
 
+// Read-only file mapping
+int platform_map_file(const char* path, MappedFile* mapped) {
+    memset(mapped, 0, sizeof(MappedFile));
+    mapped->data = "";
+    
+#ifdef PLATFORM_WINDOWS
+    mapped->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mapped->file == INVALID_HANDLE_VALUE) return -1;
+    
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapped->file, &size)) {
+        CloseHandle(mapped->file);
+        return -1;
+    }
+    mapped->size = (size_t)size.QuadPart;
+    
+    // Empty files cannot be mapped
+    if (mapped->size == 0) return 0;
+    
+    mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapped->mapping) {
+        CloseHandle(mapped->file);
+        return -1;
+    }
+    
+    mapped->data = MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mapped->data) {
+        CloseHandle(mapped->mapping);
+        CloseHandle(mapped->file);
+        return -1;
+    }
+    return 0;
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    mapped->size = (size_t)st.st_size;
+    
+    // Empty files cannot be mapped
+    if (mapped->size == 0) {
+        close(fd);
+        return 0;
+    }
+    
+    void* data = mmap(NULL, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+    
+    madvise(data, mapped->size, MADV_SEQUENTIAL);
+    mapped->data = data;
+    return 0;
+#endif
+}
+
+void platform_unmap_file(MappedFile* mapped) {
+    if (mapped->size == 0) {
+#ifdef PLATFORM_WINDOWS
+        if (mapped->file && mapped->file != INVALID_HANDLE_VALUE) CloseHandle(mapped->file);
+#endif
+        return;
+    }
+#ifdef PLATFORM_WINDOWS
+    UnmapViewOfFile(mapped->data);
+    CloseHandle(mapped->mapping);
+    CloseHandle(mapped->file);
+#else
+    munmap((void*)mapped->data, mapped->size);
+#endif
+    mapped->data = "";
+    mapped->size = 0;
+}
+
+int platform_file_signature(const char* path, FileSignature* signature) {
+    memset(signature, 0, sizeof(FileSignature));
+    
+#ifdef PLATFORM_WINDOWS
+    struct __stat64 st;
+    if (_stat64(path, &st) != 0) return -1;
+    signature->device = (uint64_t)st.st_dev;
+    signature->mtime_ns = (int64_t)st.st_mtime * 1000000000LL;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    signature->device = (uint64_t)st.st_dev;
+    signature->inode = (uint64_t)st.st_ino;
+#ifdef __APPLE__
+    signature->mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    signature->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+#endif
+    signature->size = (uint64_t)st.st_size;
+    return 0;
+}
+
+int platform_write_file_atomic(const char* path, const char* data, size_t size) {
+    // Unique per writer so concurrent tool calls never share a temporary
+    static volatile unsigned long counter = 0;
+    char temp_path[1024];
+#ifdef PLATFORM_WINDOWS
+    snprintf(temp_path, sizeof(temp_path), "%s.%lu.%lu.tmp", path,
+             (unsigned long)GetCurrentProcessId(), platform_atomic_increment(&counter));
+#else
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.%lu.tmp", path,
+             (long)getpid(), platform_atomic_increment(&counter));
+#endif
+    
+    FILE* file = fopen(temp_path, "wb");
+    if (!file) return -1;
+    
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    
+#ifdef PLATFORM_WINDOWS
+    // rename() does not replace an existing file on Windows
+    ok = ok && MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp_path, path) == 0;
+#endif
+    if (!ok) {
+        remove(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int platform_touch_file(const char* path) {
+#ifdef PLATFORM_WINDOWS
+    return _utime(path, NULL);
+#else
+    return utime(path, NULL);
+#endif
+}
+
+int platform_list_directory(const char* path, PlatformDirCallback callback, void* userdata) {
+#ifdef PLATFORM_WINDOWS
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", path);
+    
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA(pattern, &find_data);
+    if (find == INVALID_HANDLE_VALUE) return -1;
+    
+    do {
+        if (strcmp(find_data.cFileName, ".") == 0 || strcmp(find_data.cFileName, "..") == 0) continue;
+        callback(find_data.cFileName, userdata);
+    } while (FindNextFileA(find, &find_data));
+    
+    FindClose(find);
+    return 0;
+#else
+    DIR* dir = opendir(path);
+    if (!dir) return -1;
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        callback(entry->d_name, userdata);
+    }
+    
+    closedir(dir);
+    return 0;
+#endif
+}
+
+// Threads and synchronization
+#ifdef PLATFORM_WINDOWS
+typedef struct {
+    PlatformThreadFunc func;
+    void* arg;
+} ThreadStart;
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return 0;
+}
+#endif
+
+int platform_thread_create(PlatformThread* thread, PlatformThreadFunc func, void* arg) {
+#ifdef PLATFORM_WINDOWS
+    ThreadStart* start = safe_malloc(sizeof(ThreadStart));
+    start->func = func;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return -1;
+    }
+    return 0;
+#else
+    return pthread_create(thread, NULL, func, arg) == 0 ? 0 : -1;
+#endif
+}
+
+void platform_thread_join(PlatformThread thread) {
+#ifdef PLATFORM_WINDOWS
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+void platform_mutex_init(PlatformMutex* mutex) {
+#ifdef PLATFORM_WINDOWS
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void platform_mutex_lock(PlatformMutex* mutex) {
+#ifdef PLATFORM_WINDOWS
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void platform_mutex_unlock(PlatformMutex* mutex) {
+#ifdef PLATFORM_WINDOWS
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void platform_mutex_destroy(PlatformMutex* mutex) {
+#ifdef PLATFORM_WINDOWS
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+void platform_cond_init(PlatformCond* cond) {
+#ifdef PLATFORM_WINDOWS
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+void platform_cond_wait(PlatformCond* cond, PlatformMutex* mutex) {
+#ifdef PLATFORM_WINDOWS
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void platform_cond_broadcast(PlatformCond* cond) {
+#ifdef PLATFORM_WINDOWS
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+void platform_cond_destroy(PlatformCond* cond) {
+#ifdef PLATFORM_WINDOWS
+    (void)cond;
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+int platform_cpu_count(void) {
+#ifdef PLATFORM_WINDOWS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+unsigned long platform_atomic_increment(volatile unsigned long* value) {
+#ifdef PLATFORM_WINDOWS
+    return (unsigned long)InterlockedIncrement((volatile LONG*)value);
+#else
+    return __sync_add_and_fetch(value, 1);
+#endif
+}
+
+void platform_sleep_ms(unsigned int milliseconds) {
+#ifdef PLATFORM_WINDOWS
+    Sleep(milliseconds);
+#else
+    struct timespec delay;
+    delay.tv_sec = milliseconds / 1000;
+    delay.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+#endif
+}
+
+uint64_t platform_monotonic_ms(void) {
+#ifdef PLATFORM_WINDOWS
+    return (uint64_t)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+#endif
+}
+
+uint64_t platform_monotonic_ns(void) {
+#ifdef PLATFORM_WINDOWS
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+void platform_localtime(time_t time, struct tm* result) {
+#ifdef PLATFORM_WINDOWS
+    localtime_s(result, &time);
+#else
+    localtime_r(&time, result);
+#endif
+}
+
 // String utilities
 char* string_duplicate(const char* str) {
     if (!str) return NULL;
@@ -141,6 +479,143 @@ char* string_replace_char(char* str, char old_char, char new_char) {
     return str;
 }
 
+// String buffer
+void string_buffer_init(StringBuffer* buffer, size_t initial_capacity) {
+    if (initial_capacity < 16) initial_capacity = 16;
+    buffer->data = safe_malloc(initial_capacity);
+    buffer->data[0] = '\0';
+    buffer->size = 0;
+    buffer->capacity = initial_capacity;
+}
+
+void string_buffer_reserve(StringBuffer* buffer, size_t additional) {
+    if (buffer->size + additional < buffer->capacity) return;
+    
+    size_t capacity = buffer->capacity ? buffer->capacity : 16;
+    while (buffer->size + additional >= capacity) {
+        capacity *= 2;
+    }
+    buffer->data = safe_realloc(buffer->data, capacity);
+    buffer->capacity = capacity;
+}
+
+void string_buffer_append(StringBuffer* buffer, const char* data, size_t length) {
+    string_buffer_reserve(buffer, length);
+    memcpy(buffer->data + buffer->size, data, length);
+    buffer->size += length;
+    buffer->data[buffer->size] = '\0';
+}
+
+void string_buffer_clear(StringBuffer* buffer) {
+    buffer->size = 0;
+    if (buffer->data) buffer->data[0] = '\0';
+}
+
+void string_buffer_free(StringBuffer* buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+// Bump arena
+#define ARENA_ALIGNMENT 16
+
+static PLATFORM_THREAD_LOCAL Arena* current_arena = NULL;
+
+static ArenaBlock* arena_block_create(size_t size) {
+    ArenaBlock* block = safe_malloc(sizeof(ArenaBlock) + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+Arena* arena_create(size_t block_size) {
+    Arena* arena = safe_calloc(1, sizeof(Arena));
+    arena->block_size = block_size;
+    arena->blocks = arena_block_create(block_size);
+    return arena;
+}
+
+void arena_destroy(Arena* arena) {
+    if (!arena) return;
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    ArenaBlock* block = arena->blocks;
+    
+    if (block->size - block->used < size) {
+        if (size > arena->block_size / 2) {
+            // Large allocations get a dedicated block behind the current one
+            ArenaBlock* large = arena_block_create(size);
+            large->used = size;
+            large->next = block->next;
+            block->next = large;
+            return large->data;
+        }
+        block = arena_block_create(arena->block_size);
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char* arena_strndup(Arena* arena, const char* str, size_t length) {
+    char* copy = arena_alloc(arena, length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+bool arena_owns(const Arena* arena, const void* ptr) {
+    const char* p = ptr;
+    for (const ArenaBlock* block = arena->blocks; block; block = block->next) {
+        if (p >= block->data && p < block->data + block->size) return true;
+    }
+    return false;
+}
+
+void arena_reset(Arena* arena) {
+    // Keep the most recent regular-sized block, free the rest
+    ArenaBlock* keep = NULL;
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        if (!keep && block->size == arena->block_size) {
+            keep = block;
+        } else {
+            free(block);
+        }
+        block = next;
+    }
+    if (!keep) keep = arena_block_create(arena->block_size);
+    keep->next = NULL;
+    keep->used = 0;
+    arena->blocks = keep;
+}
+
+Arena* arena_set_current(Arena* arena) {
+    Arena* previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
+
+Arena* arena_current(void) {
+    return current_arena;
+}
+
 // Safe string functions
 #ifdef PLATFORM_WINDOWS
 size_t strlcpy(char* dst, const char* src, size_t size) {
@@ -204,42 +679,272 @@ char* safe_strdup(const char* str) {
 }
 
 // Logging
-void log_message(LogLevel level, const char* format, ...) {
-    const char* level_str[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+//
+// Lines are formatted on the calling thread, into a buffer of its own with
+// a timestamp it refreshes once a second, and copied into one ring that a
+// background writer drains to stderr. Callers then never wait for the
+// terminal, only for a memcpy under the ring's lock (or for room in the
+// ring if the writer falls that far behind). Without the writer, before
+// log_start and after log_shutdown, lines are written directly.
+#define LOG_RING_SIZE (256 * 1024)
+
+static struct {
+    volatile LogLevel level;
+    volatile long running;      // read without the lock: see log_running
+    bool stopping;
+    bool initialized;           // lock and condition variables, never destroyed
+    PlatformMutex lock;
+    PlatformCond ready;         // ring not empty, or stopping
+    PlatformCond space;         // ring drained
+    PlatformThread writer;
+    char* ring;
+    size_t head;                // next byte written
+    size_t used;
+    FILE* file;                 // log_to_file's, kept open while running
+    char* file_name;
+} log_state = {.level = LOG_INFO};
+
+static PLATFORM_THREAD_LOCAL time_t log_time_second = 0;
+static PLATFORM_THREAD_LOCAL char log_time_text[24];
+static PLATFORM_THREAD_LOCAL char log_line[LOG_LINE_MAX + 64];
+
+static const char* log_timestamp(void) {
+    time_t now = time(NULL);
+    if (now != log_time_second || log_time_text[0] == '\0') {
+        struct tm tm_buf;
+        platform_localtime(now, &tm_buf);
+        strftime(log_time_text, sizeof(log_time_text), "%Y-%m-%d %H:%M:%S", &tm_buf);
+        log_time_second = now;
+    }
+    return log_time_text;
+}
+
+// Formats "[time] prefix<message>\n" into log_line, cutting the message at
+// LOG_LINE_MAX
+static size_t log_format(const char* prefix, const char* format, va_list args) {
+    int start = snprintf(log_line, LOG_LINE_MAX, "[%s] %s", log_timestamp(), prefix);
+    size_t room = LOG_LINE_MAX - (size_t)start;
+    int length = vsnprintf(log_line + start, room, format, args);
+    if (length < 0) length = 0;
+    
+    size_t end = (size_t)start + (size_t)length;
+    if ((size_t)length >= room) {
+        end = LOG_LINE_MAX - 1;
+        end += snprintf(log_line + end, sizeof(log_line) - end - 1, " ... [%zu bytes cut]",
+                        (size_t)length - (room - 1));
+    }
+    log_line[end++] = '\n';
+    log_line[end] = '\0';
+    return end;
+}
+
+static void log_write_direct(const char* data, size_t size) {
+    // Keep lines from concurrent threads from interleaving
+#ifdef PLATFORM_WINDOWS
+    _lock_file(stderr);
+#else
+    flockfile(stderr);
+#endif
+    fwrite(data, 1, size, stderr);
+#ifdef PLATFORM_WINDOWS
+    _unlock_file(stderr);
+#else
+    funlockfile(stderr);
+#endif
+}
+
+// Threads still alive at exit() may log while log_shutdown runs from
+// atexit. The acquire pairs with the release in log_start, and a thread
+// that saw the writer running finds stopping set under the lock instead.
+static bool log_running(void) {
+#ifdef PLATFORM_WINDOWS
+    return InterlockedCompareExchange((volatile LONG*)&log_state.running, 0, 0) != 0;
+#else
+    return __atomic_load_n(&log_state.running, __ATOMIC_ACQUIRE) != 0;
+#endif
+}
+
+static void log_set_running(bool running) {
+#ifdef PLATFORM_WINDOWS
+    InterlockedExchange((volatile LONG*)&log_state.running, running ? 1 : 0);
+#else
+    __atomic_store_n(&log_state.running, running ? 1 : 0, __ATOMIC_RELEASE);
+#endif
+}
+
+static void log_emit(const char* line, size_t size) {
+    if (!log_running()) {
+        log_write_direct(line, size);
+        return;
+    }
     
-    time_t now;
-    time(&now);
-    struct tm* tm_info = localtime(&now);
-    char time_str[26];
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+    platform_mutex_lock(&log_state.lock);
+    while (log_state.used + size > LOG_RING_SIZE && !log_state.stopping) {
+        platform_cond_wait(&log_state.space, &log_state.lock);
+    }
+    if (log_state.stopping) {
+        platform_mutex_unlock(&log_state.lock);
+        log_write_direct(line, size);
+        return;
+    }
     
-    fprintf(stderr, "[%s] [%s] ", time_str, level_str[level]);
+    size_t first = LOG_RING_SIZE - log_state.head < size ? LOG_RING_SIZE - log_state.head : size;
+    memcpy(log_state.ring + log_state.head, line, first);
+    memcpy(log_state.ring, line + first, size - first);
+    log_state.head = (log_state.head + size) % LOG_RING_SIZE;
+    if (log_state.used == 0) platform_cond_broadcast(&log_state.ready);
+    log_state.used += size;
+    platform_mutex_unlock(&log_state.lock);
+}
+
+static void* log_writer(void* arg) {
+    (void)arg;
+    char* chunk = safe_malloc(LOG_RING_SIZE);
     
+    platform_mutex_lock(&log_state.lock);
+    for (;;) {
+        while (log_state.used == 0 && !log_state.stopping) {
+            platform_cond_wait(&log_state.ready, &log_state.lock);
+        }
+        if (log_state.used == 0) break;
+        
+        // Take everything queued, and write it without holding the lock
+        size_t size = log_state.used;
+        size_t tail = (log_state.head + LOG_RING_SIZE - size) % LOG_RING_SIZE;
+        size_t first = LOG_RING_SIZE - tail < size ? LOG_RING_SIZE - tail : size;
+        memcpy(chunk, log_state.ring + tail, first);
+        memcpy(chunk + first, log_state.ring, size - first);
+        log_state.used = 0;
+        platform_cond_broadcast(&log_state.space);
+        platform_mutex_unlock(&log_state.lock);
+        
+        log_write_direct(chunk, size);
+        fflush(stderr);
+        platform_mutex_lock(&log_state.lock);
+    }
+    platform_mutex_unlock(&log_state.lock);
+    
+    free(chunk);
+    return NULL;
+}
+
+void log_set_level(LogLevel level) {
+    log_state.level = level;
+}
+
+bool log_enabled(LogLevel level) {
+    return level >= log_state.level;
+}
+
+void log_start(void) {
+    if (log_running()) return;
+    
+    // Late loggers may still lock these after log_shutdown, so they live
+    // until the process ends
+    if (!log_state.initialized) {
+        platform_mutex_init(&log_state.lock);
+        platform_cond_init(&log_state.ready);
+        platform_cond_init(&log_state.space);
+        log_state.initialized = true;
+    }
+    log_state.ring = safe_malloc(LOG_RING_SIZE);
+    log_state.head = 0;
+    log_state.used = 0;
+    log_state.stopping = false;
+    if (platform_thread_create(&log_state.writer, log_writer, NULL) != 0) {
+        free(log_state.ring);
+        log_state.ring = NULL;
+        return;
+    }
+    log_set_running(true);
+    
+    // Lines queued when something calls exit() still get written
+    static bool registered = false;
+    if (!registered) {
+        registered = true;
+        atexit(log_shutdown);
+    }
+}
+
+void log_shutdown(void) {
+    if (!log_running()) return;
+    
+    // From here on, loggers that get the lock write directly
+    platform_mutex_lock(&log_state.lock);
+    log_state.stopping = true;
+    platform_cond_broadcast(&log_state.ready);
+    platform_cond_broadcast(&log_state.space);
+    platform_mutex_unlock(&log_state.lock);
+    platform_thread_join(log_state.writer);
+    
+    // Nothing touches the ring or the open file once stopping is set
+    platform_mutex_lock(&log_state.lock);
+    if (log_state.file) fclose(log_state.file);
+    log_state.file = NULL;
+    free(log_state.file_name);
+    log_state.file_name = NULL;
+    free(log_state.ring);
+    log_state.ring = NULL;
+    log_set_running(false);
+    platform_mutex_unlock(&log_state.lock);
+}
+
+void log_message(LogLevel level, const char* format, ...) {
+    if (level < log_state.level || level >= LOG_NONE) return;
+    
+    static const char* level_prefix[] = {"[DEBUG] ", "[INFO] ", "[WARNING] ", "[ERROR] "};
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    size_t size = log_format(level_prefix[level], format, args);
     va_end(args);
-    
-    fprintf(stderr, "\n");
+    log_emit(log_line, size);
 }
 
-void log_to_file(const char* filename, const char* format, ...) {
+bool log_level_parse(const char* name, LogLevel* level) {
+    static const char* names[] = {"debug", "info", "warning", "error", "off"};
+    for (int i = LOG_DEBUG; i <= LOG_NONE; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void log_append_file(const char* filename, const char* data, size_t size) {
     FILE* file = fopen(filename, "a");
     if (!file) return;
-    
-    time_t now;
-    time(&now);
-    struct tm* tm_info = localtime(&now);
-    char time_str[26];
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
-    
-    fprintf(file, "[%s] ", time_str);
-    
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+void log_to_file(const char* filename, const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vfprintf(file, format, args);
+    size_t size = log_format("", format, args);
     va_end(args);
     
-    fprintf(file, "\n");
-    fclose(file);
+    if (!log_running()) {
+        log_append_file(filename, log_line, size);
+        return;
+    }
+    
+    // While the writer runs the last file stays open
+    platform_mutex_lock(&log_state.lock);
+    if (log_state.stopping) {
+        log_append_file(filename, log_line, size);
+        platform_mutex_unlock(&log_state.lock);
+        return;
+    }
+    if (!log_state.file_name || strcmp(log_state.file_name, filename) != 0) {
+        if (log_state.file) fclose(log_state.file);
+        free(log_state.file_name);
+        log_state.file = fopen(filename, "a");
+        log_state.file_name = log_state.file ? safe_strdup(filename) : NULL;
+    }
+    if (log_state.file) {
+        fwrite(log_line, 1, size, log_state.file);
+        fflush(log_state.file);
+    }
+    platform_mutex_unlock(&log_state.lock);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 #ifdef _WIN32
@@ -12,6 +13,7 @@
     #include <windows.h>
     #include <direct.h>
     #include <io.h>
+    #include <sys/utime.h>
     #define PATH_SEPARATOR "\\"
     #define PATH_SEPARATOR_CHAR '\\'
     #define mkdir(path, mode) _mkdir(path)
@@ -29,6 +31,10 @@
     #include <sys/types.h>
     #include <sys/wait.h>
     #include <errno.h>
+    #include <pthread.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <utime.h>
     #define PATH_SEPARATOR "/"
     #define PATH_SEPARATOR_CHAR '/'
 #endif
@@ -41,6 +47,79 @@ int platform_is_directory(const char* path);
 char* platform_normalize_path(const char* path);
 int platform_execute_command(const char* command, char* output, size_t output_size);
 
+// Read-only file mapping
+typedef struct {
+    const char* data;
+    size_t size;
+#ifdef PLATFORM_WINDOWS
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} MappedFile;
+
+int platform_map_file(const char* path, MappedFile* mapped);
+void platform_unmap_file(MappedFile* mapped);
+
+// Identity and version of a file as reported by stat, without reading it
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    int64_t mtime_ns;
+    uint64_t size;
+} FileSignature;
+
+int platform_file_signature(const char* path, FileSignature* signature);
+// Write through a temporary file and rename it into place, so readers
+// never see a partial file
+int platform_write_file_atomic(const char* path, const char* data, size_t size);
+// Set a file's modification time to now
+int platform_touch_file(const char* path);
+
+// Calls callback with the name of every entry in a directory except . and ..
+typedef void (*PlatformDirCallback)(const char* name, void* userdata);
+int platform_list_directory(const char* path, PlatformDirCallback callback, void* userdata);
+
+// Thread-local storage
+#if defined(_MSC_VER)
+    #define PLATFORM_THREAD_LOCAL __declspec(thread)
+#else
+    #define PLATFORM_THREAD_LOCAL __thread
+#endif
+
+// Threads and synchronization
+#ifdef PLATFORM_WINDOWS
+typedef HANDLE PlatformThread;
+typedef CRITICAL_SECTION PlatformMutex;
+typedef CONDITION_VARIABLE PlatformCond;
+#else
+typedef pthread_t PlatformThread;
+typedef pthread_mutex_t PlatformMutex;
+typedef pthread_cond_t PlatformCond;
+#endif
+
+typedef void* (*PlatformThreadFunc)(void* arg);
+
+int platform_thread_create(PlatformThread* thread, PlatformThreadFunc func, void* arg);
+void platform_thread_join(PlatformThread thread);
+void platform_mutex_init(PlatformMutex* mutex);
+void platform_mutex_lock(PlatformMutex* mutex);
+void platform_mutex_unlock(PlatformMutex* mutex);
+void platform_mutex_destroy(PlatformMutex* mutex);
+void platform_cond_init(PlatformCond* cond);
+void platform_cond_wait(PlatformCond* cond, PlatformMutex* mutex);
+void platform_cond_broadcast(PlatformCond* cond);
+void platform_cond_destroy(PlatformCond* cond);
+int platform_cpu_count(void);
+// Returns the incremented value; safe to call from any thread
+unsigned long platform_atomic_increment(volatile unsigned long* value);
+void platform_sleep_ms(unsigned int milliseconds);
+// Milliseconds since an arbitrary fixed point, unaffected by clock changes
+uint64_t platform_monotonic_ms(void);
+// The same clock in nanoseconds, for timing short operations
+uint64_t platform_monotonic_ns(void);
+// Thread-safe localtime
+void platform_localtime(time_t time, struct tm* result);
+
 // String utilities
 char* string_duplicate(const char* str);
 char* string_trim(char* str);
@@ -48,6 +127,44 @@ int string_starts_with(const char* str, const char* prefix);
 int string_ends_with(const char* str, const char* suffix);
 char* string_replace_char(char* str, char old_char, char new_char);
 
+// Growable byte buffer, always NUL-terminated
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} StringBuffer;
+
+void string_buffer_init(StringBuffer* buffer, size_t initial_capacity);
+void string_buffer_reserve(StringBuffer* buffer, size_t additional);
+void string_buffer_append(StringBuffer* buffer, const char* data, size_t length);
+void string_buffer_clear(StringBuffer* buffer);
+void string_buffer_free(StringBuffer* buffer);
+
+// Bump arena for short-lived allocations, released all at once
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;     // current block first
+    size_t block_size;
+} Arena;
+
+Arena* arena_create(size_t block_size);
+void arena_destroy(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+char* arena_strndup(Arena* arena, const char* str, size_t length);
+bool arena_owns(const Arena* arena, const void* ptr);
+// Release everything at once, keeping one block for reuse
+void arena_reset(Arena* arena);
+// Arena used for the calling thread's step-scoped allocations (NULL: heap).
+// Returns the previous one so scopes can nest.
+Arena* arena_set_current(Arena* arena);
+Arena* arena_current(void);
+
 // Safe string functions
 #ifdef PLATFORM_WINDOWS
 size_t strlcpy(char* dst, const char* src, size_t size);
@@ -65,10 +182,25 @@ typedef enum {
     LOG_DEBUG,
     LOG_INFO,
     LOG_WARNING,
-    LOG_ERROR
+    LOG_ERROR,
+    LOG_NONE        // as a threshold: nothing is logged
 } LogLevel;
 
+#define LOG_LINE_MAX 8192  // longer messages, e.g. whole LLM responses, are cut
+
+// Messages below the level are dropped before they are formatted
+// (default LOG_INFO); log_enabled tells callers whether building an
+// expensive argument is worth it
+void log_set_level(LogLevel level);
+bool log_enabled(LogLevel level);
+// Hand lines to a background writer thread until log_shutdown, which
+// writes out what is still queued (also run at exit)
+void log_start(void);
+void log_shutdown(void);
+
 void log_message(LogLevel level, const char* format, ...);
+// "debug", "info", "warning", "error" or "off"
+bool log_level_parse(const char* name, LogLevel* level);
 void log_to_file(const char* filename, const char* format, ...);
 
 #endif // PLATFORM_H
\ No newline at end of file
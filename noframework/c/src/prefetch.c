@@ -0,0 +1,258 @@
+#include "prefetch.h"
+#include "tools.h"
+#include "cJSON.h"
+#include <ctype.h>
+
+// Likely next reads after a listing, by file name
+static const char* BUILD_FILES[] = {
+    "Makefile", "CMakeLists.txt", "meson.build", "configure.ac", "package.json", "Cargo.toml",
+    "go.mod", "pyproject.toml", "setup.py", "pom.xml", "build.gradle", "Gemfile", "composer.json",
+    NULL
+};
+static const char* ENTRY_POINTS[] = {
+    "main", "index", "app", "cli", "server", "__main__", "lib", "mod", NULL
+};
+
+#define SCORE_MENTIONED 1000
+#define SCORE_README 300
+#define SCORE_BUILD_FILE 200
+#define SCORE_ENTRY_POINT 100
+#define SCORE_PER_LEVEL 10      // shallower files first
+
+ReadPrefetch* read_prefetch_create(void) {
+    ReadPrefetch* prefetch = safe_calloc(1, sizeof(ReadPrefetch));
+    platform_mutex_init(&prefetch->lock);
+    platform_cond_init(&prefetch->changed);
+    return prefetch;
+}
+
+static void entry_clear(ReadPrefetchEntry* entry) {
+    free(entry->path);
+    free(entry->observation);
+    memset(entry, 0, sizeof(ReadPrefetchEntry));
+}
+
+void read_prefetch_destroy(ReadPrefetch* prefetch) {
+    if (!prefetch) return;
+    
+    platform_mutex_lock(&prefetch->lock);
+    prefetch->stopping = true;
+    platform_cond_broadcast(&prefetch->changed);
+    platform_mutex_unlock(&prefetch->lock);
+    if (prefetch->started) platform_thread_join(prefetch->thread);
+    
+    if (prefetch->queued > 0) {
+        log_message(LOG_INFO, "Prefetched reads: %zu queued, %zu used", prefetch->queued, prefetch->used);
+    }
+    for (size_t i = 0; i < READ_PREFETCH_MAX_ENTRIES; i++) {
+        entry_clear(&prefetch->entries[i]);
+    }
+    platform_cond_destroy(&prefetch->changed);
+    platform_mutex_destroy(&prefetch->lock);
+    free(prefetch);
+}
+
+// The queued entry queued first; called with the lock held
+static ReadPrefetchEntry* next_queued(ReadPrefetch* prefetch) {
+    ReadPrefetchEntry* next = NULL;
+    for (size_t i = 0; i < READ_PREFETCH_MAX_ENTRIES; i++) {
+        ReadPrefetchEntry* entry = &prefetch->entries[i];
+        if (entry->used && entry->state == PREFETCH_QUEUED && (!next || entry->sequence < next->sequence)) {
+            next = entry;
+        }
+    }
+    return next;
+}
+
+static void* prefetch_worker(void* arg) {
+    ReadPrefetch* prefetch = (ReadPrefetch*)arg;
+    
+    platform_mutex_lock(&prefetch->lock);
+    while (!prefetch->stopping) {
+        ReadPrefetchEntry* entry = next_queued(prefetch);
+        if (!entry) {
+            platform_cond_wait(&prefetch->changed, &prefetch->lock);
+            continue;
+        }
+        
+        // The slot is neither evicted nor taken while READING
+        entry->state = PREFETCH_READING;
+        platform_mutex_unlock(&prefetch->lock);
+        
+        FileSignature signature = {0};
+        bool has_signature = platform_file_signature(entry->path, &signature) == 0;
+        char* observation = has_signature ? read_file_observation(entry->path, NULL) : NULL;
+        
+        platform_mutex_lock(&prefetch->lock);
+        entry->signature = signature;
+        entry->has_signature = has_signature && observation;
+        entry->observation = observation;
+        entry->state = PREFETCH_READY;
+        platform_cond_broadcast(&prefetch->changed);
+    }
+    platform_mutex_unlock(&prefetch->lock);
+    
+    return NULL;
+}
+
+static ReadPrefetchEntry* find_entry(ReadPrefetch* prefetch, const char* path) {
+    for (size_t i = 0; i < READ_PREFETCH_MAX_ENTRIES; i++) {
+        ReadPrefetchEntry* entry = &prefetch->entries[i];
+        if (entry->used && strcmp(entry->path, path) == 0) return entry;
+    }
+    return NULL;
+}
+
+// A free slot, else the oldest one not being read; called with the lock held
+static ReadPrefetchEntry* claim_slot(ReadPrefetch* prefetch) {
+    ReadPrefetchEntry* oldest = NULL;
+    for (size_t i = 0; i < READ_PREFETCH_MAX_ENTRIES; i++) {
+        ReadPrefetchEntry* entry = &prefetch->entries[i];
+        if (!entry->used) return entry;
+        if (entry->state != PREFETCH_READING && (!oldest || entry->sequence < oldest->sequence)) {
+            oldest = entry;
+        }
+    }
+    if (oldest) entry_clear(oldest);
+    return oldest;
+}
+
+static bool has_prefix_ignore_case(const char* str, const char* prefix) {
+    for (; *prefix; str++, prefix++) {
+        if (tolower((unsigned char)*str) != *prefix) return false;
+    }
+    return true;
+}
+
+static bool is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '-' || c == '.';
+}
+
+// True if context mentions name as a whole word (a file name or path tail)
+static bool mentions(const char* context, const char* name, size_t length) {
+    if (!context || length < 3) return false;
+    for (const char* p = strstr(context, name); p; p = strstr(p + 1, name)) {
+        bool starts = p == context || !is_name_char(p[-1]);
+        bool ends = !is_name_char(p[length]) || (p[length] == '.' && !is_name_char(p[length + 1]));
+        if (starts && ends) return true;
+    }
+    return false;
+}
+
+static int candidate_score(const char* path, const char* context) {
+    const char* name = path;
+    int depth = 0;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            name = p + 1;
+            depth++;
+        }
+    }
+    size_t length = strlen(name);
+    const char* dot = strrchr(name, '.');
+    size_t stem = dot && dot != name ? (size_t)(dot - name) : length;
+    
+    int score = 0;
+    if (mentions(context, name, length)) {
+        score = SCORE_MENTIONED;
+    } else if (has_prefix_ignore_case(name, "readme")) {
+        score = SCORE_README;
+    } else {
+        for (size_t i = 0; BUILD_FILES[i] && score == 0; i++) {
+            if (strcmp(name, BUILD_FILES[i]) == 0) score = SCORE_BUILD_FILE;
+        }
+        for (size_t i = 0; ENTRY_POINTS[i] && score == 0; i++) {
+            if (strlen(ENTRY_POINTS[i]) == stem && strncmp(name, ENTRY_POINTS[i], stem) == 0) {
+                score = SCORE_ENTRY_POINT;
+            }
+        }
+    }
+    if (score == 0) return 0;
+    score -= depth * SCORE_PER_LEVEL;
+    return score > 0 ? score : 1;
+}
+
+void read_prefetch_listing(ReadPrefetch* prefetch, const char* listing_json, const char* context) {
+    // Queued paths outlive the caller's step
+    Arena* step_arena = arena_set_current(NULL);
+    cJSON* listing = cJSON_Parse(listing_json);
+    if (!cJSON_IsArray(listing)) {
+        cJSON_Delete(listing);
+        arena_set_current(step_arena);
+        return;
+    }
+    
+    // The best READ_PREFETCH_MAX_FILES, in listing order among equal scores
+    const char* best[READ_PREFETCH_MAX_FILES];
+    int best_score[READ_PREFETCH_MAX_FILES];
+    size_t best_count = 0;
+    size_t scanned = 0;
+    cJSON* item = NULL;
+    cJSON_ArrayForEach(item, listing) {
+        if (scanned++ >= READ_PREFETCH_SCAN_LIMIT) break;
+        if (!cJSON_IsString(item)) continue;
+        int score = candidate_score(item->valuestring, context);
+        if (score == 0) continue;
+        if (best_count == READ_PREFETCH_MAX_FILES && score <= best_score[best_count - 1]) continue;
+        
+        size_t at = best_count < READ_PREFETCH_MAX_FILES ? best_count++ : best_count - 1;
+        while (at > 0 && best_score[at - 1] < score) {
+            best[at] = best[at - 1];
+            best_score[at] = best_score[at - 1];
+            at--;
+        }
+        best[at] = item->valuestring;
+        best_score[at] = score;
+    }
+    
+    platform_mutex_lock(&prefetch->lock);
+    size_t added = 0;
+    for (size_t i = 0; i < best_count; i++) {
+        if (find_entry(prefetch, best[i])) continue;
+        ReadPrefetchEntry* entry = claim_slot(prefetch);
+        if (!entry) break;
+        entry->used = true;
+        entry->sequence = ++prefetch->sequence;
+        entry->path = safe_strdup(best[i]);
+        entry->state = PREFETCH_QUEUED;
+        added++;
+    }
+    prefetch->queued += added;
+    if (added > 0 && !prefetch->started && !prefetch->stopping) {
+        prefetch->started = platform_thread_create(&prefetch->thread, prefetch_worker, prefetch) == 0;
+    }
+    platform_cond_broadcast(&prefetch->changed);
+    platform_mutex_unlock(&prefetch->lock);
+    
+    cJSON_Delete(listing);
+    arena_set_current(step_arena);
+}
+
+char* read_prefetch_take(ReadPrefetch* prefetch, const char* path) {
+    platform_mutex_lock(&prefetch->lock);
+    ReadPrefetchEntry* entry = find_entry(prefetch, path);
+    while (entry && entry->state == PREFETCH_READING && prefetch->started) {
+        platform_cond_wait(&prefetch->changed, &prefetch->lock);
+        entry = find_entry(prefetch, path);
+    }
+    
+    char* observation = NULL;
+    if (entry && entry->state == PREFETCH_READY && entry->has_signature) {
+        // The file may have changed since it was read
+        FileSignature now;
+        if (platform_file_signature(path, &now) == 0 &&
+            memcmp(&now, &entry->signature, sizeof(FileSignature)) == 0) {
+            observation = entry->observation;
+            entry->observation = NULL;
+            prefetch->used++;
+        }
+    }
+    // Taken, stale, or not read yet (then the caller reads it itself)
+    if (entry) entry_clear(entry);
+    platform_mutex_unlock(&prefetch->lock);
+    
+    if (observation) {
+        log_message(LOG_INFO, "Tool invoked: read_file(file_path='%s'), served from prefetch", path);
+    }
+    return observation;
+}
@@ -0,0 +1,56 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "platform.h"
+
+// Speculative read_file: while the model thinks about a directory listing,
+// a background thread reads the files of it the model is likely to ask
+// for next (the ones its last turn mentioned, READMEs, build files, entry
+// points) and keeps their escaped observations in memory. A later
+// read_file of one of those paths takes the observation instead of
+// reading the file, provided the file's signature has not changed.
+#define READ_PREFETCH_MAX_FILES 8       // queued per listing
+#define READ_PREFETCH_MAX_ENTRIES 24    // queued, in flight and ready at once
+#define READ_PREFETCH_SCAN_LIMIT 4096   // listing entries examined per listing
+
+typedef enum {
+    PREFETCH_QUEUED,
+    PREFETCH_READING,
+    PREFETCH_READY
+} PrefetchState;
+
+typedef struct {
+    bool used;
+    unsigned long sequence;     // order of queueing; the oldest is evicted first
+    char* path;
+    char* observation;          // READY: the read_file result
+    FileSignature signature;    // taken before the read
+    bool has_signature;
+    PrefetchState state;
+} ReadPrefetchEntry;
+
+typedef struct ReadPrefetch {
+    PlatformMutex lock;
+    PlatformCond changed;       // work queued, a read finished, or stopping
+    PlatformThread thread;
+    bool started;
+    bool stopping;
+    ReadPrefetchEntry entries[READ_PREFETCH_MAX_ENTRIES];     // a slot stays put while READING
+    unsigned long sequence;
+    size_t queued;              // totals, logged on destroy
+    size_t used;
+} ReadPrefetch;
+
+ReadPrefetch* read_prefetch_create(void);
+// Waits for a read in progress and drops everything else
+void read_prefetch_destroy(ReadPrefetch* prefetch);
+
+// Queues the likely next reads among the paths of a find_all_matching_files
+// result; context is text whose mentions of those files rank them first
+// (the model's last turn), or NULL. Starts the thread on first use.
+void read_prefetch_listing(ReadPrefetch* prefetch, const char* listing_json, const char* context);
+// The prefetched observation for a full-file read of path, as a heap string
+// the caller owns, or NULL. Waits if that path is being read right now.
+char* read_prefetch_take(ReadPrefetch* prefetch, const char* path);
+
+#endif // PREFETCH_H
@@ -1,4 +1,6 @@
 #include "tools.h"
+#include "cache.h"
+#include "index.h"
 #include <string.h>
 #include <ctype.h>
 
@@ -7,6 +9,7 @@
 #else
 #include <dirent.h>
 #include <fnmatch.h>
+#include <regex.h>
 #endif
 
 // File list management
@@ -34,6 +37,27 @@ void file_list_add(FileList* list, const char* file) {
     list->files[list->count++] = safe_strdup(file);
 }
 
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+void file_list_sort(FileList* list) {
+    qsort(list->files, list->count, sizeof(char*), compare_paths);
+}
+
+// JSON output helpers
+void json_append_string(StringBuffer* buffer, const char* str, size_t length) {
+    size_t escaped_length = cJSON_EscapedLength(str, length);
+    string_buffer_reserve(buffer, escaped_length + 2);
+    
+    char* out = buffer->data + buffer->size;
+    *out++ = '"';
+    out = cJSON_EscapeTo(out, str, length);
+    *out++ = '"';
+    *out = '\0';
+    buffer->size += escaped_length + 2;
+}
+
 // Pattern matching
 bool match_pattern(const char* filename, const char* pattern) {
     if (strcmp(pattern, "*") == 0 || strcmp(pattern, "*.*") == 0) {
@@ -55,36 +79,267 @@ bool match_pattern(const char* filename, const char* pattern) {
 }
 
 // Gitignore handling
-GitIgnore* gitignore_load(const char* directory) {
-    char gitignore_path[1024];
-    snprintf(gitignore_path, sizeof(gitignore_path), "%s/.gitignore", directory);
+#define GITIGNORE_NO_RULE (-1)
+
+static size_t hash_string(const char* str, size_t len) {
+    // FNV-1a
+    size_t hash = (size_t)14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= (size_t)1099511628211ULL;
+    }
+    return hash;
+}
+
+static size_t table_slot(const GitIgnoreTable* table, const char* key, size_t len) {
+    size_t mask = table->capacity - 1;
+    size_t slot = hash_string(key, len) & mask;
+    while (table->keys[slot] &&
+           !(strncmp(table->keys[slot], key, len) == 0 && table->keys[slot][len] == '\0')) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void table_put(GitIgnoreTable* table, const char* key, int rule, bool dir_only) {
+    // Keep the load factor below one half
+    if ((table->count + 1) * 2 > table->capacity) {
+        GitIgnoreTable grown = {0};
+        grown.capacity = table->capacity ? table->capacity * 2 : 16;
+        grown.keys = safe_calloc(grown.capacity, sizeof(char*));
+        grown.any_rule = safe_malloc(grown.capacity * sizeof(int));
+        grown.dir_rule = safe_malloc(grown.capacity * sizeof(int));
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (!table->keys[i]) continue;
+            size_t slot = table_slot(&grown, table->keys[i], strlen(table->keys[i]));
+            grown.keys[slot] = table->keys[i];
+            grown.any_rule[slot] = table->any_rule[i];
+            grown.dir_rule[slot] = table->dir_rule[i];
+        }
+        grown.count = table->count;
+        free(table->keys);
+        free(table->any_rule);
+        free(table->dir_rule);
+        *table = grown;
+    }
     
-    GitIgnore* ignore = safe_calloc(1, sizeof(GitIgnore));
-    ignore->capacity = 16;
-    ignore->patterns = safe_calloc(ignore->capacity, sizeof(char*));
+    size_t slot = table_slot(table, key, strlen(key));
+    if (!table->keys[slot]) {
+        table->keys[slot] = safe_strdup(key);
+        table->any_rule[slot] = GITIGNORE_NO_RULE;
+        table->dir_rule[slot] = GITIGNORE_NO_RULE;
+        table->count++;
+    }
+    // Rules are added in file order, so the latest always wins
+    table->dir_rule[slot] = rule;
+    if (!dir_only) table->any_rule[slot] = rule;
+}
+
+static int table_get(const GitIgnoreTable* table, const char* key, size_t len, bool is_dir) {
+    if (table->count == 0) return GITIGNORE_NO_RULE;
+    size_t slot = table_slot(table, key, len);
+    if (!table->keys[slot]) return GITIGNORE_NO_RULE;
+    return is_dir ? table->dir_rule[slot] : table->any_rule[slot];
+}
+
+static void table_free(GitIgnoreTable* table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        free(table->keys[i]);
+    }
+    free(table->keys);
+    free(table->any_rule);
+    free(table->dir_rule);
+}
+
+static void trie_put(GitIgnoreTrieNode* root, const char* path, int rule, bool dir_only) {
+    GitIgnoreTrieNode* node = root;
+    while (*path) {
+        size_t len = strcspn(path, "/");
+        GitIgnoreTrieNode* child = node->children;
+        while (child && !(strncmp(child->name, path, len) == 0 && child->name[len] == '\0')) {
+            child = child->next;
+        }
+        if (!child) {
+            child = safe_calloc(1, sizeof(GitIgnoreTrieNode));
+            child->name = safe_malloc(len + 1);
+            memcpy(child->name, path, len);
+            child->name[len] = '\0';
+            child->any_rule = GITIGNORE_NO_RULE;
+            child->dir_rule = GITIGNORE_NO_RULE;
+            child->next = node->children;
+            node->children = child;
+        }
+        node = child;
+        path += len;
+        while (*path == '/') path++;
+    }
+    node->dir_rule = rule;
+    if (!dir_only) node->any_rule = rule;
+}
+
+static int trie_get(const GitIgnoreTrieNode* root, const char* path, bool is_dir) {
+    const GitIgnoreTrieNode* node = root;
+    if (!node->children) return GITIGNORE_NO_RULE;
+    while (*path) {
+        size_t len = strcspn(path, "/");
+        const GitIgnoreTrieNode* child = node->children;
+        while (child && !(strncmp(child->name, path, len) == 0 && child->name[len] == '\0')) {
+            child = child->next;
+        }
+        if (!child) return GITIGNORE_NO_RULE;
+        node = child;
+        path += len;
+        if (*path) path++;
+    }
+    return is_dir ? node->dir_rule : node->any_rule;
+}
+
+static void trie_free(GitIgnoreTrieNode* node) {
+    GitIgnoreTrieNode* child = node->children;
+    while (child) {
+        GitIgnoreTrieNode* next = child->next;
+        trie_free(child);
+        free(child->name);
+        free(child);
+        child = next;
+    }
+}
+
+static bool glob_match(const char* pattern, const char* string, bool pathname) {
+#ifdef PLATFORM_WINDOWS
+    (void)pathname;
+    return strcmp(pattern, string) == 0;
+#else
+    // "**" has to cross directory separators, which FNM_PATHNAME forbids
+    int flags = (pathname && !strstr(pattern, "**")) ? FNM_PATHNAME : 0;
+    if (fnmatch(pattern, string, flags) == 0) return true;
     
-    // Always ignore .git directory
-    ignore->patterns[ignore->count++] = safe_strdup(".git/");
+    // "a/**/b" also matches "a/b"
+    const char* globstar = strstr(pattern, "/**/");
+    if (!globstar) return false;
     
-    if (!platform_file_exists(gitignore_path)) {
-        return ignore;
+    char collapsed[1024];
+    snprintf(collapsed, sizeof(collapsed), "%.*s%s", (int)(globstar - pattern), pattern, globstar + 3);
+    return glob_match(collapsed, string, pathname);
+#endif
+}
+
+static void gitignore_add_rule(GitIgnore* ignore, const char* line) {
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer), "%s", line);
+    char* pattern = buffer;
+    
+    bool negated = false;
+    if (pattern[0] == '!') {
+        negated = true;
+        pattern++;
+    } else if (pattern[0] == '\\' && (pattern[1] == '#' || pattern[1] == '!')) {
+        pattern++;
     }
     
-    FILE* file = fopen(gitignore_path, "r");
-    if (!file) return ignore;
+    size_t len = strlen(pattern);
+    bool dir_only = false;
+    while (len > 0 && pattern[len - 1] == '/') {
+        dir_only = true;
+        pattern[--len] = '\0';
+    }
+    // "dir/**" ignores everything inside dir, which for pruning is dir itself
+    if (len >= 3 && strcmp(pattern + len - 3, "/**") == 0) {
+        dir_only = true;
+        len -= 3;
+        pattern[len] = '\0';
+    }
+    
+    bool any_depth = false;
+    while (strncmp(pattern, "**/", 3) == 0) {
+        any_depth = true;
+        pattern += 3;
+    }
+    
+    bool anchored = false;
+    if (pattern[0] == '/') {
+        anchored = true;
+        pattern++;
+    }
+    if (pattern[0] == '\0') return;
+    if (strchr(pattern, '/')) anchored = true;
+    
+    // "**/name" is the same as "name"
+    if (any_depth && !strchr(pattern, '/')) {
+        any_depth = false;
+        anchored = false;
+    }
+    
+    if (ignore->count >= ignore->capacity) {
+        ignore->capacity = ignore->capacity ? ignore->capacity * 2 : 16;
+        ignore->rules = safe_realloc(ignore->rules, ignore->capacity * sizeof(GitIgnoreRule));
+    }
+    int index = (int)ignore->count++;
+    GitIgnoreRule* rule = &ignore->rules[index];
+    rule->pattern = safe_strdup(pattern);
+    rule->negated = negated;
+    rule->dir_only = dir_only;
+    rule->anchored = anchored;
+    rule->any_depth = any_depth;
     
-    char line[256];
+    bool glob = strpbrk(pattern, "*?[\\") != NULL;
+    if (!glob && !anchored) {
+        table_put(&ignore->basenames, pattern, index, dir_only);
+    } else if (!glob && !any_depth) {
+        trie_put(&ignore->prefixes, pattern, index, dir_only);
+    } else if (!anchored && pattern[0] == '*' && pattern[1] == '.' && pattern[2] &&
+               !strpbrk(pattern + 2, "*?[\\")) {
+        table_put(&ignore->extensions, pattern + 2, index, dir_only);
+    } else {
+        ignore->globs = safe_realloc(ignore->globs, (ignore->glob_count + 1) * sizeof(int));
+        ignore->globs[ignore->glob_count++] = index;
+    }
+}
+
+static GitIgnore* gitignore_create(GitIgnore* parent, const char* base) {
+    GitIgnore* ignore = safe_calloc(1, sizeof(GitIgnore));
+    ignore->parent = parent;
+    ignore->base = safe_strdup(base);
+    ignore->base_len = strlen(base);
+    return ignore;
+}
+
+static void gitignore_read(GitIgnore* ignore, FILE* file) {
+    char line[1024];
     while (fgets(line, sizeof(line), file)) {
         char* trimmed = string_trim(line);
         if (strlen(trimmed) > 0 && trimmed[0] != '#') {
-            if (ignore->count >= ignore->capacity) {
-                ignore->capacity *= 2;
-                ignore->patterns = safe_realloc(ignore->patterns, ignore->capacity * sizeof(char*));
-            }
-            ignore->patterns[ignore->count++] = safe_strdup(trimmed);
+            gitignore_add_rule(ignore, trimmed);
         }
     }
+}
+
+GitIgnore* gitignore_load(const char* directory) {
+    GitIgnore* ignore = gitignore_create(NULL, "");
+    
+    // Always ignore .git directory
+    gitignore_add_rule(ignore, ".git/");
+    
+    char gitignore_path[1024];
+    snprintf(gitignore_path, sizeof(gitignore_path), "%s/.gitignore", directory);
+    
+    FILE* file = fopen(gitignore_path, "r");
+    if (!file) return ignore;
     
+    gitignore_read(ignore, file);
+    fclose(file);
+    return ignore;
+}
+
+GitIgnore* gitignore_load_nested(GitIgnore* parent, const char* directory, const char* rel_dir) {
+    char gitignore_path[2048];
+    snprintf(gitignore_path, sizeof(gitignore_path), "%s/%s/.gitignore", directory, rel_dir);
+    
+    FILE* file = fopen(gitignore_path, "r");
+    if (!file) return NULL;
+    
+    GitIgnore* ignore = gitignore_create(parent, rel_dir);
+    gitignore_read(ignore, file);
     fclose(file);
     return ignore;
 }
@@ -92,53 +347,127 @@ GitIgnore* gitignore_load(const char* directory) {
 void gitignore_destroy(GitIgnore* ignore) {
     if (!ignore) return;
     for (size_t i = 0; i < ignore->count; i++) {
-        free(ignore->patterns[i]);
+        free(ignore->rules[i].pattern);
     }
-    free(ignore->patterns);
+    free(ignore->rules);
+    table_free(&ignore->basenames);
+    table_free(&ignore->extensions);
+    trie_free(&ignore->prefixes);
+    free(ignore->globs);
+    free(ignore->base);
     free(ignore);
 }
 
-bool gitignore_should_ignore(GitIgnore* ignore, const char* path) {
-    if (!ignore) return false;
+// Index of the last rule of a single .gitignore matching local, or GITIGNORE_NO_RULE
+static int gitignore_match_local(const GitIgnore* ignore, const char* local, bool is_dir) {
+    const char* basename = strrchr(local, '/');
+    basename = basename ? basename + 1 : local;
+    size_t basename_len = strlen(basename);
     
-    for (size_t i = 0; i < ignore->count; i++) {
-        const char* pattern = ignore->patterns[i];
+    int best = table_get(&ignore->basenames, basename, basename_len, is_dir);
+    
+    for (const char* dot = strchr(basename, '.'); dot; dot = strchr(dot + 1, '.')) {
+        int rule = table_get(&ignore->extensions, dot + 1, basename_len - (dot + 1 - basename), is_dir);
+        if (rule > best) best = rule;
+    }
+    
+    int rule = trie_get(&ignore->prefixes, local, is_dir);
+    if (rule > best) best = rule;
+    
+    // Globs are checked newest first and only while they could still win
+    for (size_t i = ignore->glob_count; i-- > 0;) {
+        int index = ignore->globs[i];
+        if (index <= best) break;
         
-        // Simple pattern matching
-        if (strstr(path, pattern) != NULL) {
-            return true;
-        }
+        const GitIgnoreRule* glob = &ignore->rules[index];
+        if (glob->dir_only && !is_dir) continue;
         
-        // Check if path ends with pattern
-        if (string_ends_with(path, pattern)) {
-            return true;
+        bool matched = false;
+        if (glob->any_depth) {
+            for (const char* start = local; start && !matched; start = strchr(start, '/')) {
+                if (*start == '/') start++;
+                matched = glob_match(glob->pattern, start, true);
+            }
+        } else if (glob->anchored) {
+            matched = glob_match(glob->pattern, local, true);
+        } else {
+            matched = glob_match(glob->pattern, basename, false);
         }
         
-        // Check if any component matches
-        char* path_copy = safe_strdup(path);
-        char* token = strtok(path_copy, "/\\");
-        while (token) {
-            if (strcmp(token, pattern) == 0) {
-                free(path_copy);
-                return true;
+        if (matched) {
+            best = index;
+            break;
+        }
+    }
+    
+    return best;
+}
+
+GitIgnoreMatch gitignore_match(GitIgnore* ignore, const char* rel_path, bool is_dir) {
+    for (const GitIgnore* matcher = ignore; matcher; matcher = matcher->parent) {
+        const char* local = rel_path;
+        if (matcher->base_len > 0) {
+            if (strncmp(rel_path, matcher->base, matcher->base_len) != 0 ||
+                rel_path[matcher->base_len] != '/') {
+                continue;
             }
-            token = strtok(NULL, "/\\");
+            local = rel_path + matcher->base_len + 1;
+        }
+        
+        int rule = gitignore_match_local(matcher, local, is_dir);
+        if (rule != GITIGNORE_NO_RULE) {
+            return matcher->rules[rule].negated ? GITIGNORE_INCLUDE : GITIGNORE_IGNORE;
         }
-        free(path_copy);
     }
+    return GITIGNORE_NONE;
+}
+
+bool gitignore_should_ignore(GitIgnore* ignore, const char* path) {
+    if (!ignore) return false;
     
-    return false;
+    char rel_path[1024];
+    snprintf(rel_path, sizeof(rel_path), "%s", path);
+    string_replace_char(rel_path, '\\', '/');
+    
+    // A file inside an ignored directory is ignored no matter what
+    for (char* sep = strchr(rel_path, '/'); sep; sep = strchr(sep + 1, '/')) {
+        *sep = '\0';
+        GitIgnoreMatch match = gitignore_match(ignore, rel_path, true);
+        *sep = '/';
+        if (match == GITIGNORE_IGNORE) return true;
+    }
+    
+    return gitignore_match(ignore, rel_path, false) == GITIGNORE_IGNORE;
 }
 
 // Directory traversal
 void traverse_directory(const char* directory, const char* pattern, FileList* results, GitIgnore* gitignore, const char* base_dir) {
+    // Relative path of this directory, always with '/' separators for gitignore
+    char rel_dir[1024] = "";
+    if (base_dir && string_starts_with(directory, base_dir)) {
+        const char* rel = directory + strlen(base_dir);
+        while (*rel == '/' || *rel == '\\') rel++;
+        snprintf(rel_dir, sizeof(rel_dir), "%s", rel);
+        string_replace_char(rel_dir, '\\', '/');
+    }
+    
+    // Honor a nested .gitignore for this directory and everything below it
+    GitIgnore* nested = NULL;
+    if (gitignore && rel_dir[0]) {
+        nested = gitignore_load_nested(gitignore, base_dir, rel_dir);
+        if (nested) gitignore = nested;
+    }
+    
 #ifdef PLATFORM_WINDOWS
     WIN32_FIND_DATAA find_data;
     char search_path[MAX_PATH];
     snprintf(search_path, sizeof(search_path), "%s\\*", directory);
     
     HANDLE handle = FindFirstFileA(search_path, &find_data);
-    if (handle == INVALID_HANDLE_VALUE) return;
+    if (handle == INVALID_HANDLE_VALUE) {
+        gitignore_destroy(nested);
+        return;
+    }
     
     do {
         if (strcmp(find_data.cFileName, ".") == 0 || strcmp(find_data.cFileName, "..") == 0) {
@@ -148,18 +477,15 @@ void traverse_directory(const char* directory, const char* pattern, FileList* re
         char full_path[MAX_PATH];
         snprintf(full_path, sizeof(full_path), "%s\\%s", directory, find_data.cFileName);
         
-        // Calculate relative path from base directory
-        const char* rel_path = full_path;
-        if (base_dir && string_starts_with(full_path, base_dir)) {
-            rel_path = full_path + strlen(base_dir);
-            while (*rel_path == '\\' || *rel_path == '/') rel_path++;
-        }
+        char rel_path[1024];
+        snprintf(rel_path, sizeof(rel_path), "%s%s%s", rel_dir, rel_dir[0] ? "/" : "", find_data.cFileName);
         
-        if (gitignore && gitignore_should_ignore(gitignore, rel_path)) {
+        bool is_dir = (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        if (gitignore && gitignore_match(gitignore, rel_path, is_dir) == GITIGNORE_IGNORE) {
             continue;
         }
         
-        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        if (is_dir) {
             // Skip .git directory
             if (strcmp(find_data.cFileName, ".git") != 0) {
                 traverse_directory(full_path, pattern, results, gitignore, base_dir);
@@ -174,7 +500,10 @@ void traverse_directory(const char* directory, const char* pattern, FileList* re
     FindClose(handle);
 #else
     DIR* dir = opendir(directory);
-    if (!dir) return;
+    if (!dir) {
+        gitignore_destroy(nested);
+        return;
+    }
     
     struct dirent* entry;
     while ((entry = readdir(dir)) != NULL) {
@@ -185,123 +514,868 @@ void traverse_directory(const char* directory, const char* pattern, FileList* re
         char full_path[1024];
         snprintf(full_path, sizeof(full_path), "%s/%s", directory, entry->d_name);
         
-        // Calculate relative path from base directory
-        const char* rel_path = full_path;
-        if (base_dir && string_starts_with(full_path, base_dir)) {
-            rel_path = full_path + strlen(base_dir);
-            while (*rel_path == '/' || *rel_path == '\\') rel_path++;
+        char rel_path[1024];
+        snprintf(rel_path, sizeof(rel_path), "%s%s%s", rel_dir, rel_dir[0] ? "/" : "", entry->d_name);
+        
+        struct stat st;
+        if (stat(full_path, &st) != 0) continue;
+        
+        if (gitignore && gitignore_match(gitignore, rel_path, S_ISDIR(st.st_mode)) == GITIGNORE_IGNORE) {
+            continue;
         }
         
-        if (gitignore && gitignore_should_ignore(gitignore, rel_path)) {
+        if (S_ISDIR(st.st_mode)) {
+            // Skip .git directory
+            if (strcmp(entry->d_name, ".git") != 0) {
+                traverse_directory(full_path, pattern, results, gitignore, base_dir);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            if (match_pattern(entry->d_name, pattern)) {
+                file_list_add(results, full_path);
+            }
+        }
+    }
+    
+    closedir(dir);
+#endif
+    
+    gitignore_destroy(nested);
+}
+
+#ifndef PLATFORM_WINDOWS
+#include <fcntl.h>
+
+#define TRAVERSE_MAX_THREADS 8
+
+// A queued directory and the gitignore chain that applies inside it
+typedef struct {
+    char* rel_dir;
+    GitIgnore* gitignore;
+} DirJob;
+
+// Per-worker directory deque: the owner pushes and pops at the bottom,
+// idle workers steal from the top
+typedef struct {
+    DirJob* dirs;
+    size_t top;
+    size_t bottom;
+    size_t capacity;
+    PlatformMutex lock;
+} DirDeque;
+
+typedef struct TraversalPool TraversalPool;
+
+typedef struct {
+    TraversalPool* pool;
+    size_t id;
+    DirDeque deque;
+    FileList* results;
+} TraversalWorker;
+
+struct TraversalPool {
+    const char* root;
+    int root_fd;
+    const char* pattern;
+    TraversalWorker* workers;
+    size_t worker_count;
+    PlatformMutex lock;
+    PlatformCond work_available;
+    size_t pending;     // directories queued or being read
+    GitIgnore** nested; // matchers loaded from nested .gitignore files
+    size_t nested_count;
+};
+
+static void deque_push(DirDeque* deque, char* rel_dir, GitIgnore* gitignore) {
+    platform_mutex_lock(&deque->lock);
+    if (deque->bottom >= deque->capacity) {
+        deque->capacity = deque->capacity ? deque->capacity * 2 : 16;
+        deque->dirs = safe_realloc(deque->dirs, deque->capacity * sizeof(DirJob));
+    }
+    deque->dirs[deque->bottom].rel_dir = rel_dir;
+    deque->dirs[deque->bottom].gitignore = gitignore;
+    deque->bottom++;
+    platform_mutex_unlock(&deque->lock);
+}
+
+static bool deque_pop(DirDeque* deque, bool steal, DirJob* job) {
+    bool found = false;
+    platform_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        *job = steal ? deque->dirs[deque->top++] : deque->dirs[--deque->bottom];
+        found = true;
+        if (deque->top == deque->bottom) {
+            deque->top = deque->bottom = 0;
+        }
+    }
+    platform_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool deque_is_empty(DirDeque* deque) {
+    platform_mutex_lock(&deque->lock);
+    bool empty = deque->top == deque->bottom;
+    platform_mutex_unlock(&deque->lock);
+    return empty;
+}
+
+static bool traversal_steal(TraversalPool* pool, size_t thief, DirJob* job) {
+    for (size_t i = 1; i < pool->worker_count; i++) {
+        TraversalWorker* victim = &pool->workers[(thief + i) % pool->worker_count];
+        if (deque_pop(&victim->deque, true, job)) return true;
+    }
+    return false;
+}
+
+// Load rel_dir/.gitignore through the open directory fd, if there is one
+static GitIgnore* traversal_load_nested(TraversalPool* pool, int dir_fd, const char* rel_dir, GitIgnore* parent) {
+    int fd = openat(dir_fd, ".gitignore", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    
+    FILE* file = fdopen(fd, "r");
+    if (!file) {
+        close(fd);
+        return NULL;
+    }
+    
+    GitIgnore* nested = gitignore_create(parent, rel_dir);
+    gitignore_read(nested, file);
+    fclose(file);
+    
+    platform_mutex_lock(&pool->lock);
+    pool->nested = safe_realloc(pool->nested, (pool->nested_count + 1) * sizeof(GitIgnore*));
+    pool->nested[pool->nested_count++] = nested;
+    platform_mutex_unlock(&pool->lock);
+    
+    return nested;
+}
+
+// Read one directory given relative to the root; returns subdirectories queued
+static size_t traversal_read_dir(TraversalWorker* worker, const DirJob* job) {
+    TraversalPool* pool = worker->pool;
+    const char* rel_dir = job->rel_dir;
+    
+    int fd = openat(pool->root_fd, rel_dir[0] ? rel_dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return 0;
+    }
+    
+    // The root .gitignore was loaded by the caller
+    GitIgnore* gitignore = job->gitignore;
+    if (gitignore && rel_dir[0]) {
+        GitIgnore* nested = traversal_load_nested(pool, fd, rel_dir, gitignore);
+        if (nested) gitignore = nested;
+    }
+    
+    size_t queued = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
             continue;
         }
         
-        struct stat st;
-        if (stat(full_path, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                // Skip .git directory
-                if (strcmp(entry->d_name, ".git") != 0) {
-                    traverse_directory(full_path, pattern, results, gitignore, base_dir);
-                }
-            } else if (S_ISREG(st.st_mode)) {
-                if (match_pattern(entry->d_name, pattern)) {
-                    file_list_add(results, full_path);
+        char rel_path[1024];
+        int len = rel_dir[0]
+            ? snprintf(rel_path, sizeof(rel_path), "%s/%s", rel_dir, entry->d_name)
+            : snprintf(rel_path, sizeof(rel_path), "%s", entry->d_name);
+        if (len < 0 || (size_t)len >= sizeof(rel_path)) continue;
+        
+        // Only stat when readdir cannot tell us the type. Symlinks to files
+        // are followed; symlinked directories are not descended (like git),
+        // which also rules out cycles such as bin/X11 -> .
+        bool is_dir = false;
+        bool is_file = false;
+#ifdef DT_DIR
+        if (entry->d_type == DT_DIR) {
+            is_dir = true;
+        } else if (entry->d_type == DT_REG) {
+            is_file = true;
+        } else if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+#endif
+        {
+            struct stat st;
+            if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                if (S_ISLNK(st.st_mode) && fstatat(fd, entry->d_name, &st, 0) == 0) {
+                    is_file = S_ISREG(st.st_mode);
+                } else {
+                    is_dir = S_ISDIR(st.st_mode);
+                    is_file = S_ISREG(st.st_mode);
                 }
             }
         }
+        
+        if (!is_dir && !is_file) continue;
+        
+        // Ignored directories are pruned here and never read
+        if (gitignore && gitignore_match(gitignore, rel_path, is_dir) == GITIGNORE_IGNORE) {
+            continue;
+        }
+        
+        if (is_dir) {
+            // Skip .git directory
+            if (strcmp(entry->d_name, ".git") != 0) {
+                deque_push(&worker->deque, safe_strdup(rel_path), gitignore);
+                queued++;
+            }
+        } else if (is_file && match_pattern(entry->d_name, pool->pattern)) {
+            char full_path[2048];
+            snprintf(full_path, sizeof(full_path), "%s/%s", pool->root, rel_path);
+            file_list_add(worker->results, full_path);
+        }
     }
     
     closedir(dir);
+    return queued;
+}
+
+static void* traversal_worker_main(void* arg) {
+    TraversalWorker* worker = (TraversalWorker*)arg;
+    TraversalPool* pool = worker->pool;
+    
+    for (;;) {
+        DirJob job;
+        bool found = deque_pop(&worker->deque, false, &job);
+        if (!found) found = traversal_steal(pool, worker->id, &job);
+        
+        if (!found) {
+            // Nothing to do: wait until someone queues work or everything is done
+            platform_mutex_lock(&pool->lock);
+            bool idle = true;
+            while (pool->pending > 0 && idle) {
+                for (size_t i = 0; i < pool->worker_count && idle; i++) {
+                    if (!deque_is_empty(&pool->workers[i].deque)) idle = false;
+                }
+                if (idle) platform_cond_wait(&pool->work_available, &pool->lock);
+            }
+            bool finished = pool->pending == 0;
+            platform_mutex_unlock(&pool->lock);
+            if (finished) break;
+            continue;
+        }
+        
+        size_t queued = traversal_read_dir(worker, &job);
+        free(job.rel_dir);
+        
+        platform_mutex_lock(&pool->lock);
+        pool->pending += queued;
+        pool->pending--;
+        if (queued > 0 || pool->pending == 0) {
+            platform_cond_broadcast(&pool->work_available);
+        }
+        platform_mutex_unlock(&pool->lock);
+    }
+    
+    return NULL;
+}
+#endif
+
+void traverse_directory_parallel(const char* directory, const char* pattern, FileList* results, GitIgnore* gitignore) {
+#ifdef PLATFORM_WINDOWS
+    traverse_directory(directory, pattern, results, gitignore, directory);
+    file_list_sort(results);
+#else
+    TraversalPool pool = {0};
+    pool.root = directory;
+    pool.pattern = pattern;
+    pool.root_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (pool.root_fd < 0) return;
+    
+    int threads = platform_cpu_count();
+    pool.worker_count = threads > TRAVERSE_MAX_THREADS ? TRAVERSE_MAX_THREADS : (size_t)threads;
+    pool.workers = safe_calloc(pool.worker_count, sizeof(TraversalWorker));
+    platform_mutex_init(&pool.lock);
+    platform_cond_init(&pool.work_available);
+    
+    for (size_t i = 0; i < pool.worker_count; i++) {
+        pool.workers[i].pool = &pool;
+        pool.workers[i].id = i;
+        pool.workers[i].results = file_list_create();
+        platform_mutex_init(&pool.workers[i].deque.lock);
+    }
+    
+    pool.pending = 1;
+    deque_push(&pool.workers[0].deque, safe_strdup(""), gitignore);
+    
+    // The calling thread works as worker 0
+    PlatformThread* threads_started = safe_calloc(pool.worker_count, sizeof(PlatformThread));
+    bool* started = safe_calloc(pool.worker_count, sizeof(bool));
+    for (size_t i = 1; i < pool.worker_count; i++) {
+        started[i] = platform_thread_create(&threads_started[i], traversal_worker_main, &pool.workers[i]) == 0;
+    }
+    traversal_worker_main(&pool.workers[0]);
+    
+    // Join everyone before tearing down: idle workers may still probe any deque
+    for (size_t i = 1; i < pool.worker_count; i++) {
+        if (started[i]) platform_thread_join(threads_started[i]);
+    }
+    
+    for (size_t i = 0; i < pool.worker_count; i++) {
+        TraversalWorker* worker = &pool.workers[i];
+        
+        // Merge per-thread results by moving the strings over
+        for (size_t j = 0; j < worker->results->count; j++) {
+            if (results->count >= results->capacity) {
+                results->capacity *= 2;
+                results->files = safe_realloc(results->files, results->capacity * sizeof(char*));
+            }
+            results->files[results->count++] = worker->results->files[j];
+        }
+        worker->results->count = 0;
+        file_list_destroy(worker->results);
+        free(worker->deque.dirs);
+        platform_mutex_destroy(&worker->deque.lock);
+    }
+    
+    file_list_sort(results);
+    
+    for (size_t i = 0; i < pool.nested_count; i++) {
+        gitignore_destroy(pool.nested[i]);
+    }
+    free(pool.nested);
+    free(started);
+    free(threads_started);
+    free(pool.workers);
+    platform_cond_destroy(&pool.work_available);
+    platform_mutex_destroy(&pool.lock);
+    close(pool.root_fd);
 #endif
 }
 
 // Tool functions
+// Signatures a cached listing of a managed clone depends on: the git index
+// and HEAD of the enclosing work tree, which every clone, pull, checkout or
+// reset rewrites, plus the listed directory itself
+static bool listing_signatures(const char* directory, FileSignature deps[3]) {
+    if (!tool_cache_is_managed(directory)) return false;
+    
+    char root[1024];
+    snprintf(root, sizeof(root), "%s", directory);
+    
+    char path[1100];
+    while (true) {
+        snprintf(path, sizeof(path), "%s%c.git", root, PATH_SEPARATOR_CHAR);
+        if (platform_is_directory(path)) break;
+        
+        char* separator = strrchr(root, PATH_SEPARATOR_CHAR);
+        if (!separator || separator == root || !tool_cache_is_managed(root)) return false;
+        *separator = '\0';
+    }
+    
+    snprintf(path, sizeof(path), "%s%c.git%cindex", root, PATH_SEPARATOR_CHAR, PATH_SEPARATOR_CHAR);
+    if (platform_file_signature(path, &deps[0]) != 0) return false;
+    snprintf(path, sizeof(path), "%s%c.git%cHEAD", root, PATH_SEPARATOR_CHAR, PATH_SEPARATOR_CHAR);
+    if (platform_file_signature(path, &deps[1]) != 0) return false;
+    return platform_file_signature(directory, &deps[2]) == 0;
+}
+
+static char* file_list_to_json(const FileList* results) {
+    cJSON* json_array = cJSON_CreateArray();
+    for (size_t i = 0; i < results->count; i++) {
+        cJSON_AddItemToArray(json_array, cJSON_CreateString(results->files[i]));
+    }
+    
+    char* json_string = cJSON_PrintUnformatted(json_array);
+    cJSON_Delete(json_array);
+    return json_string;
+}
+
 char* find_all_matching_files(const char* directory, const char* pattern) {
+    return find_all_matching_files_indexed(NULL, directory, pattern);
+}
+
+char* find_all_matching_files_indexed(const RepoIndex* index, const char* directory, const char* pattern) {
     log_message(LOG_INFO, "Tool invoked: find_all_matching_files(directory='%s', pattern='%s')", directory, pattern);
     
+    FileList* indexed = file_list_create();
+    if (repo_index_find(index, directory, pattern, indexed)) {
+        char* json_string = file_list_to_json(indexed);
+        log_message(LOG_INFO, "Found %zu matching files in the repository index", indexed->count);
+        file_list_destroy(indexed);
+        return json_string;
+    }
+    file_list_destroy(indexed);
+    
     if (!platform_is_directory(directory)) {
         log_message(LOG_ERROR, "Directory not found: %s", directory);
         return safe_strdup("[]");
     }
     
+    // Only pristine clones are cached: the index cannot see untracked edits
+    FileSignature deps[3];
+    char key[1200];
+    bool cacheable = tool_cache_enabled() && listing_signatures(directory, deps);
+    if (cacheable) {
+        snprintf(key, sizeof(key), "find_all_matching_files\n%s\n%s", directory, pattern);
+        char* cached = tool_cache_get(key, deps, 3);
+        if (cached) {
+            log_message(LOG_INFO, "Listing served from tool cache");
+            return cached;
+        }
+    }
+    
     FileList* results = file_list_create();
     GitIgnore* gitignore = gitignore_load(directory);
     
-    traverse_directory(directory, pattern, results, gitignore, directory);
+    traverse_directory_parallel(directory, pattern, results, gitignore);
     
     // Convert to JSON array
-    cJSON* json_array = cJSON_CreateArray();
-    for (size_t i = 0; i < results->count; i++) {
-        cJSON_AddItemToArray(json_array, cJSON_CreateString(results->files[i]));
-    }
-    
-    char* json_string = cJSON_PrintUnformatted(json_array);
-    cJSON_Delete(json_array);
+    char* json_string = file_list_to_json(results);
     
     log_message(LOG_INFO, "Found %zu matching files", results->count);
     
     file_list_destroy(results);
     gitignore_destroy(gitignore);
     
+    if (cacheable) {
+        tool_cache_put(key, deps, 3, json_string, strlen(json_string));
+    }
+    
     return json_string;
 }
 
+static char* read_file_error(const char* message) {
+    cJSON* error = cJSON_CreateObject();
+    cJSON_AddStringToObject(error, "error", message);
+    char* result = cJSON_PrintUnformatted(error);
+    cJSON_Delete(error);
+    return result;
+}
+
+static void json_append_size(StringBuffer* buffer, const char* key, size_t value) {
+    char field[64];
+    int len = snprintf(field, sizeof(field), ",\"%s\":%zu", key, value);
+    string_buffer_append(buffer, field, (size_t)len);
+}
+
+// Byte offset of the start of 1-based line, or size if the file is shorter
+static size_t line_offset(const char* data, size_t size, size_t line) {
+    size_t offset = 0;
+    for (size_t current = 1; current < line && offset < size; current++) {
+        const char* newline = memchr(data + offset, '\n', size - offset);
+        if (!newline) return size;
+        offset = (size_t)(newline - data) + 1;
+    }
+    return offset;
+}
+
+// Backs offset up to the first byte of the UTF-8 sequence it falls in
+static size_t utf8_boundary(const char* data, size_t size, size_t offset) {
+    for (int i = 0; i < 3 && offset > 0 && offset < size && ((unsigned char)data[offset] & 0xC0) == 0x80; i++) {
+        offset--;
+    }
+    return offset;
+}
+
 char* read_file(const char* file_path) {
+    return read_file_range(file_path, NULL);
+}
+
+// The read_file observation for a window of the file; *length receives
+// the result size on success and stays 0 for errors
+static char* read_file_window(const char* file_path, const ReadFileRange* range, size_t* length) {
+    MappedFile mapped;
+    if (platform_map_file(file_path, &mapped) != 0) {
+        return read_file_error("File not found");
+    }
+    
+    // Work out the window to return
+    size_t start = 0;
+    size_t end = mapped.size;
+    bool by_lines = range && (range->start_line > 0 || range->end_line > 0);
+    
+    if (by_lines) {
+        size_t first = range->start_line > 0 ? range->start_line : 1;
+        start = line_offset(mapped.data, mapped.size, first);
+        if (range->end_line >= first) {
+            end = start + line_offset(mapped.data + start, mapped.size - start, range->end_line - first + 2);
+        }
+    } else if (range) {
+        // Byte windows never start or end inside a character
+        start = utf8_boundary(mapped.data, mapped.size, range->offset < mapped.size ? range->offset : mapped.size);
+        if (range->length > 0 && range->length < mapped.size - start) {
+            end = utf8_boundary(mapped.data, mapped.size, start + range->length);
+            // A window shorter than its first character still returns it
+            if (end == start) {
+                end = start + 1;
+                while (end < mapped.size && ((unsigned char)mapped.data[end] & 0xC0) == 0x80) end++;
+            }
+        }
+    }
+    
+    // Every window is capped, at a line boundary where there is one and
+    // never inside a character, so paging with next_offset stays bounded
+    bool truncated = false;
+    if (end - start > READ_FILE_MAX_CONTENT) {
+        const char* cut = mapped.data + start + READ_FILE_MAX_CONTENT;
+        const char* last_newline = cut;
+        while (last_newline > mapped.data + start && last_newline[-1] != '\n') last_newline--;
+        end = last_newline > mapped.data + start
+            ? (size_t)(last_newline - mapped.data)
+            : utf8_boundary(mapped.data, mapped.size, (size_t)(cut - mapped.data));
+        truncated = true;
+    }
+    
+    // Check if binary (contains null bytes); memchr is vectorized by libc
+    if (memchr(mapped.data + start, '\0', end - start) != NULL) {
+        platform_unmap_file(&mapped);
+        log_message(LOG_DEBUG, "File detected as binary: %s", file_path);
+        return read_file_error("Cannot read binary file");
+    }
+    
+    log_message(LOG_INFO, "Successfully read file: %s (%zu of %zu chars)", file_path, end - start, mapped.size);
+    
+    // Escape straight from the mapping into the result
+    size_t content_length = end - start;
+    StringBuffer json;
+    string_buffer_init(&json, cJSON_EscapedLength(mapped.data + start, content_length) + strlen(file_path) + 128);
+    string_buffer_append(&json, "{\"file\":", 8);
+    json_append_string(&json, file_path, strlen(file_path));
+    string_buffer_append(&json, ",\"content\":", 11);
+    json_append_string(&json, mapped.data + start, content_length);
+    
+    if (range || truncated) {
+        json_append_size(&json, "total_size", mapped.size);
+        if (by_lines) {
+            size_t first = range->start_line > 0 ? range->start_line : 1;
+            size_t lines = 0;
+            for (const char* p = mapped.data + start; (p = memchr(p, '\n', mapped.data + end - p)); p++) lines++;
+            if (end > start && mapped.data[end - 1] != '\n') lines++;
+            json_append_size(&json, "start_line", first);
+            json_append_size(&json, "end_line", first + lines - 1);
+        } else {
+            json_append_size(&json, "offset", start);
+        }
+        if (end < mapped.size) {
+            if (truncated) string_buffer_append(&json, ",\"truncated\":true", 17);
+            json_append_size(&json, "next_offset", end);
+        }
+    }
+    string_buffer_append(&json, "}", 1);
+    
+    platform_unmap_file(&mapped);
+    *length = json.size;
+    return json.data;
+}
+
+char* read_file_range(const char* file_path, const ReadFileRange* range) {
     log_message(LOG_INFO, "Tool invoked: read_file(file_path='%s')", file_path);
+    return read_file_observation(file_path, range);
+}
+
+char* read_file_observation(const char* file_path, const ReadFileRange* range) {
+    // Escaped observations of larger files are cached across runs, keyed by
+    // the path and window and validated against the file's signature
+    FileSignature signature;
+    char key[1200];
+    bool cacheable = tool_cache_enabled() &&
+                     platform_file_signature(file_path, &signature) == 0 &&
+                     signature.size >= TOOL_CACHE_MIN_FILE_SIZE;
+    if (cacheable) {
+        ReadFileRange window = {0};
+        if (range) window = *range;
+        snprintf(key, sizeof(key), "read_file\n%s\n%d:%zu:%zu:%zu:%zu", file_path, range != NULL,
+                 window.offset, window.length, window.start_line, window.end_line);
+        
+        char* cached = tool_cache_get(key, &signature, 1);
+        if (cached) {
+            log_message(LOG_INFO, "Read file from tool cache: %s", file_path);
+            return cached;
+        }
+    }
     
-    FILE* file = fopen(file_path, "rb");
-    if (!file) {
-        cJSON* error = cJSON_CreateObject();
-        cJSON_AddStringToObject(error, "error", "File not found");
-        char* result = cJSON_PrintUnformatted(error);
-        cJSON_Delete(error);
-        return result;
-    }
-    
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    // Check if file is too large
-    if (file_size > 10 * 1024 * 1024) {
-        fclose(file);
-        cJSON* error = cJSON_CreateObject();
-        cJSON_AddStringToObject(error, "error", "File too large");
-        char* result = cJSON_PrintUnformatted(error);
-        cJSON_Delete(error);
-        return result;
-    }
-    
-    // Read file content
-    char* content = safe_malloc(file_size + 1);
-    size_t read_size = fread(content, 1, file_size, file);
-    content[read_size] = '\0';
-    fclose(file);
+    size_t length = 0;
+    char* result = read_file_window(file_path, range, &length);
+    if (cacheable && length > 0) {
+        tool_cache_put(key, &signature, 1, result, length);
+    }
+    return result;
+}
+
+// Code search
+#define SEARCH_MAX_LITERALS 32
+
+// The ']' closing the bracket expression that starts at p (or the end)
+static const char* skip_bracket(const char* p) {
+    p++;
+    if (*p == '^') p++;
+    if (*p == ']') p++;
+    while (*p && *p != ']') {
+        if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+            char kind = p[1];
+            p += 2;
+            while (*p && !(*p == kind && p[1] == ']')) p++;
+            if (*p) p++;
+        }
+        if (*p) p++;
+    }
+    return p;
+}
+
+// Literal runs that every match of an extended regex contains, used to
+// pick candidate files. Conservative: a top-level alternation yields none;
+// groups, bracket expressions, anchors, '.' and escapes such as \w end a
+// run; a quantifier that allows zero repetitions drops the byte before it.
+static size_t regex_literals(const char* regex, char* storage, const char** runs, size_t max_runs) {
+    // Alternatives inside a group are skipped with the group; one at the
+    // top level means no run is required
+    int depth = 0;
+    for (const char* p = regex; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+        } else if (*p == '[') {
+            p = skip_bracket(p);
+            if (!*p) break;
+        } else if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            depth--;
+        } else if (*p == '|' && depth <= 0) {
+            return 0;
+        }
+    }
+    
+    size_t run_count = 0;
+    char* run = storage;
+    char* out = storage;
+#define END_RUN() do { \
+        *out = '\0'; \
+        if (out - run >= 3 && run_count < max_runs) runs[run_count++] = run; \
+        run = ++out; \
+    } while (0)
+    
+    for (const char* p = regex; *p; p++) {
+        char c = *p;
+        if (c == '\\' && p[1]) {
+            p++;
+            if (isalnum((unsigned char)*p)) {
+                END_RUN();
+            } else {
+                *out++ = *p;
+            }
+        } else if (c == '[') {
+            END_RUN();
+            p = skip_bracket(p);
+            if (!*p) break;
+        } else if (c == '(') {
+            // The group may be optional or repeated: none of it is required
+            END_RUN();
+            int depth = 1;
+            while (depth > 0 && *++p) {
+                if (*p == '\\' && p[1]) {
+                    p++;
+                } else if (*p == '[') {
+                    p = skip_bracket(p);
+                    if (!*p) break;
+                } else if (*p == '(') {
+                    depth++;
+                } else if (*p == ')') {
+                    depth--;
+                }
+            }
+            if (!*p) break;
+        } else if (c == '*' || c == '?' || c == '{') {
+            if (out > run) out--;
+            END_RUN();
+            if (c == '{') {
+                while (p[1] && *p != '}') p++;
+            }
+        } else if (c == '+') {
+            // The byte occurs, but what follows may come after a repeat of it
+            char last = out > run ? out[-1] : '\0';
+            END_RUN();
+            if (last) *out++ = last;
+        } else if (c == '.' || c == '^' || c == '$' || c == ')') {
+            END_RUN();
+        } else {
+            *out++ = c;
+        }
+    }
+    END_RUN();
+#undef END_RUN
+    return run_count;
+}
+
+static char fold_ascii(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+// Offset of needle in text, or SIZE_MAX
+static size_t find_literal(const char* text, size_t length, const char* needle, size_t needle_length,
+                           bool ignore_case) {
+    if (needle_length == 0) return 0;
+    if (needle_length > length) return SIZE_MAX;
     
-    // Check if binary (contains null bytes)
-    for (size_t i = 0; i < read_size; i++) {
-        if (content[i] == '\0') {
-            free(content);
-            log_message(LOG_DEBUG, "File detected as binary: %s", file_path);
-            cJSON* error = cJSON_CreateObject();
-            cJSON_AddStringToObject(error, "error", "Cannot read binary file");
-            char* result = cJSON_PrintUnformatted(error);
-            cJSON_Delete(error);
-            return result;
+    size_t last = length - needle_length;
+    for (size_t i = 0; i <= last; i++) {
+        if (!ignore_case) {
+            const char* first = memchr(text + i, needle[0], last - i + 1);
+            if (!first) return SIZE_MAX;
+            i = (size_t)(first - text);
+            if (memcmp(text + i, needle, needle_length) == 0) return i;
+            continue;
         }
+        size_t j = 0;
+        while (j < needle_length && fold_ascii(text[i + j]) == fold_ascii(needle[j])) j++;
+        if (j == needle_length) return i;
     }
+    return SIZE_MAX;
+}
+
+// Appends one match; long lines are cut around the match without
+// splitting a UTF-8 sequence
+static void search_append_match(StringBuffer* json, size_t match_count, const char* path, size_t line_number,
+                                const char* line, size_t length, size_t match_offset) {
+    if (length > 0 && line[length - 1] == '\r') length--;
+    size_t start = 0;
+    size_t end = length;
+    if (length > SEARCH_MAX_LINE) {
+        start = match_offset > SEARCH_MAX_LINE / 4 ? match_offset - SEARCH_MAX_LINE / 4 : 0;
+        if (start > length - SEARCH_MAX_LINE) start = length - SEARCH_MAX_LINE;
+        end = start + SEARCH_MAX_LINE;
+        while (start < end && ((unsigned char)line[start] & 0xC0) == 0x80) start++;
+        while (end > start && end < length && ((unsigned char)line[end] & 0xC0) == 0x80) end--;
+    }
+    
+    string_buffer_append(json, match_count == 0 ? "{\"path\":" : ",{\"path\":", match_count == 0 ? 8 : 9);
+    json_append_string(json, path, strlen(path));
+    json_append_size(json, "line", line_number);
+    string_buffer_append(json, ",\"text\":", 8);
+    json_append_string(json, line + start, end - start);
+    string_buffer_append(json, "}", 1);
+}
+
+char* search_code(const RepoIndex* index, const SearchQuery* query) {
+    log_message(LOG_INFO, "Tool invoked: search_code(pattern='%s', regex=%s)", query->pattern,
+                query->regex ? "true" : "false");
     
-    log_message(LOG_INFO, "Successfully read file: %s (%ld chars)", file_path, file_size);
+    if (!index || !index->trigrams) {
+        return read_file_error("No repository index to search");
+    }
+    if (!query->pattern || !query->pattern[0]) {
+        return read_file_error("pattern parameter required");
+    }
     
-    // Create JSON response
-    cJSON* response = cJSON_CreateObject();
-    cJSON_AddStringToObject(response, "file", file_path);
-    cJSON_AddStringToObject(response, "content", content);
+    uint32_t base = REPO_INDEX_ROOT;
+    const char* prefix = index->root;
+    if (query->directory && query->directory[0]) {
+        if (!repo_index_lookup_dir(index, query->directory, &base)) {
+            return read_file_error("Directory is not part of the repository being analysed");
+        }
+        prefix = query->directory;
+    }
     
-    char* json_string = cJSON_PrintUnformatted(response);
-    cJSON_Delete(response);
-    free(content);
+    size_t max_results = query->max_results > 0 ? query->max_results : SEARCH_DEFAULT_RESULTS;
+    if (max_results > SEARCH_MAX_RESULTS) max_results = SEARCH_MAX_RESULTS;
     
-    return json_string;
-}
\ No newline at end of file
+    // Pick candidate files from the literals a match must contain
+    size_t pattern_length = strlen(query->pattern);
+    char* storage = safe_malloc(2 * pattern_length + 2);
+    const char* literals[SEARCH_MAX_LITERALS];
+    size_t literal_count = 0;
+#ifdef PLATFORM_WINDOWS
+    if (query->regex) {
+        free(storage);
+        return read_file_error("Regular expressions are not supported on this platform");
+    }
+#else
+    regex_t compiled;
+    if (query->regex) {
+        int flags = REG_EXTENDED | REG_NEWLINE | (query->ignore_case ? REG_ICASE : 0);
+        int error = regcomp(&compiled, query->pattern, flags);
+        if (error != 0) {
+            char message[256];
+            char text[300];
+            regerror(error, &compiled, message, sizeof(message));
+            snprintf(text, sizeof(text), "Invalid regular expression: %s", message);
+            free(storage);
+            return read_file_error(text);
+        }
+        literal_count = regex_literals(query->pattern, storage, literals, SEARCH_MAX_LITERALS);
+    }
+#endif
+    if (!query->regex) {
+        memcpy(storage, query->pattern, pattern_length + 1);
+        literals[literal_count++] = storage;
+    }
+    
+    uint64_t started = platform_monotonic_ms();
+    size_t candidate_count = 0;
+    uint32_t* candidates = repo_trigrams_candidates(index, literals, literal_count, &candidate_count);
+    
+    StringBuffer json;
+    string_buffer_init(&json, 4096);
+    string_buffer_append(&json, "{\"query\":", 9);
+    json_append_string(&json, query->pattern, pattern_length);
+    string_buffer_append(&json, ",\"matches\":[", 12);
+    
+    size_t match_count = 0;
+    size_t files_searched = 0;
+    bool truncated = false;
+    StringBuffer line_copy;
+    string_buffer_init(&line_copy, 256);
+    char path[2048];
+    
+    for (size_t c = 0; c < candidate_count && !truncated; c++) {
+        uint32_t file = candidates[c];
+        if (query->file_pattern && query->file_pattern[0] &&
+            !match_pattern(index->names + index->files[file].name, query->file_pattern)) {
+            continue;
+        }
+        if (!repo_index_file_path(index, file, base, prefix, path, sizeof(path))) continue;
+        
+        MappedFile mapped;
+        if (platform_map_file(path, &mapped) != 0) continue;
+        files_searched++;
+        
+        size_t line_number = 0;
+        const char* line = mapped.data;
+        const char* data_end = mapped.data + mapped.size;
+        while (line < data_end && !truncated) {
+            const char* newline = memchr(line, '\n', (size_t)(data_end - line));
+            size_t length = newline ? (size_t)(newline - line) : (size_t)(data_end - line);
+            line_number++;
+            
+            size_t offset = SIZE_MAX;
+            if (!query->regex) {
+                offset = find_literal(line, length, query->pattern, pattern_length, query->ignore_case);
+            }
+#ifndef PLATFORM_WINDOWS
+            else {
+                string_buffer_clear(&line_copy);
+                string_buffer_append(&line_copy, line, length);
+                regmatch_t match;
+                if (regexec(&compiled, line_copy.data, 1, &match, 0) == 0) offset = (size_t)match.rm_so;
+            }
+#endif
+            
+            if (offset != SIZE_MAX) {
+                if (match_count == max_results) {
+                    truncated = true;
+                } else {
+                    search_append_match(&json, match_count++, path, line_number, line, length, offset);
+                }
+            }
+            line = newline ? newline + 1 : data_end;
+        }
+        platform_unmap_file(&mapped);
+    }
+    
+    string_buffer_append(&json, "]", 1);
+    json_append_size(&json, "files_searched", files_searched);
+    if (truncated) string_buffer_append(&json, ",\"truncated\":true", 17);
+    string_buffer_append(&json, "}", 1);
+    
+    log_message(LOG_INFO, "Found %zu matches in %zu of %zu text files in %llu ms", match_count, files_searched,
+                index->trigrams->searchable_count, (unsigned long long)(platform_monotonic_ms() - started));
+    
+#ifndef PLATFORM_WINDOWS
+    if (query->regex) regfree(&compiled);
+#endif
+    string_buffer_free(&line_copy);
+    free(candidates);
+    free(storage);
+    return json.data;
+}
@@ -11,30 +11,124 @@ typedef struct {
     size_t capacity;
 } FileList;
 
+// JSON output helpers: append a quoted, escaped JSON string
+void json_append_string(StringBuffer* buffer, const char* str, size_t length);
+
+// Optional window for read_file: bytes [offset, offset + length), or the
+// 1-based inclusive line range [start_line, end_line]. Zero means unset.
+typedef struct {
+    size_t offset;
+    size_t length;
+    size_t start_line;
+    size_t end_line;
+} ReadFileRange;
+
+// Most content one read_file window returns; larger windows are truncated
+#define READ_FILE_MAX_CONTENT (256 * 1024)
+
+struct RepoIndex;
+
 // Tool functions matching the agent's requirements
 char* find_all_matching_files(const char* directory, const char* pattern);
+// Answered from the index when it covers directory, else as above
+char* find_all_matching_files_indexed(const struct RepoIndex* index, const char* directory, const char* pattern);
 char* read_file(const char* file_path);
+char* read_file_range(const char* file_path, const ReadFileRange* range);
+// read_file_range without logging a tool call, for speculative reads
+char* read_file_observation(const char* file_path, const ReadFileRange* range);
+
+// search_code query; only pattern is required
+typedef struct {
+    const char* pattern;
+    bool regex;                 // POSIX extended regular expression rather than a literal
+    bool ignore_case;
+    const char* directory;      // only files below this directory of the repository
+    const char* file_pattern;   // only file names matching this glob, as in find_all_matching_files
+    size_t max_results;         // 0: SEARCH_DEFAULT_RESULTS
+} SearchQuery;
+
+#define SEARCH_DEFAULT_RESULTS 50
+#define SEARCH_MAX_RESULTS 500
+// Longer lines are cut to this many bytes around the match
+#define SEARCH_MAX_LINE 240
+
+// Matching lines of the repository's text files as
+// {"query":..., "matches":[{"path","line","text"}], "files_searched":N},
+// plus "truncated":true when max_results was reached. The index must have
+// its trigrams built (repo_index_build_trigrams).
+char* search_code(const struct RepoIndex* index, const SearchQuery* query);
 
 // File list management
 FileList* file_list_create(void);
 void file_list_destroy(FileList* list);
 void file_list_add(FileList* list, const char* file);
+void file_list_sort(FileList* list);
 
 // Pattern matching
 bool match_pattern(const char* filename, const char* pattern);
 
-// Gitignore handling
+// Gitignore handling: each .gitignore is compiled once into a matcher.
+// Literal basenames and extensions live in hash tables, anchored literal
+// paths in a component trie, and only real globs are run through fnmatch.
+typedef enum {
+    GITIGNORE_NONE,     // no pattern matched
+    GITIGNORE_IGNORE,
+    GITIGNORE_INCLUDE   // matched a negated (!) pattern
+} GitIgnoreMatch;
+
+typedef struct {
+    char* pattern;      // glob text, relative to the .gitignore directory
+    bool negated;
+    bool dir_only;      // pattern ended with '/'
+    bool anchored;      // pattern contained '/', match against the whole path
+    bool any_depth;     // anchored pattern that started with "**/"
+} GitIgnoreRule;
+
+// Literal lookup table: key -> index of the last rule for files and
+// directories (dir_rule also covers dir-only patterns); -1 when unset
 typedef struct {
-    char** patterns;
+    char** keys;
+    int* any_rule;
+    int* dir_rule;
+    size_t count;
+    size_t capacity;
+} GitIgnoreTable;
+
+typedef struct GitIgnoreTrieNode {
+    char* name;
+    int any_rule;
+    int dir_rule;
+    struct GitIgnoreTrieNode* children;
+    struct GitIgnoreTrieNode* next;
+} GitIgnoreTrieNode;
+
+typedef struct GitIgnore {
+    struct GitIgnore* parent;   // matcher of an enclosing directory
+    char* base;                 // directory of this .gitignore relative to the root
+    size_t base_len;
+    GitIgnoreRule* rules;
     size_t count;
     size_t capacity;
+    GitIgnoreTable basenames;
+    GitIgnoreTable extensions;
+    GitIgnoreTrieNode prefixes;
+    int* globs;
+    size_t glob_count;
 } GitIgnore;
 
 GitIgnore* gitignore_load(const char* directory);
+// Load rel_dir/.gitignore below directory; NULL if the directory has none
+GitIgnore* gitignore_load_nested(GitIgnore* parent, const char* directory, const char* rel_dir);
 void gitignore_destroy(GitIgnore* ignore);
+// Match one path (relative to the root) against the matcher chain, deepest
+// .gitignore first. Ancestors are not checked: traversal prunes them.
+GitIgnoreMatch gitignore_match(GitIgnore* ignore, const char* rel_path, bool is_dir);
+// Full check of a relative path, including its ancestor directories
 bool gitignore_should_ignore(GitIgnore* ignore, const char* path);
 
 // Directory traversal
 void traverse_directory(const char* directory, const char* pattern, FileList* results, GitIgnore* gitignore, const char* base_dir);
+// Work-stealing traversal over a pool of worker threads; results are sorted
+void traverse_directory_parallel(const char* directory, const char* pattern, FileList* results, GitIgnore* gitignore);
 
 #endif // TOOLS_H
\ No newline at end of file
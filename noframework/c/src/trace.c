@@ -0,0 +1,233 @@
+#include "trace.h"
+#include "cJSON.h"
+
+// Chrome layout: every run is a process; its steps, LLM requests and
+// tool slots (parallel calls overlap) are threads of it
+#define TRACE_TID_STEPS 0
+#define TRACE_TID_LLM 1
+#define TRACE_TID_TOOLS 2
+
+static FILE* trace_file = NULL;
+static TraceFormat trace_format = TRACE_FORMAT_JSONL;
+static PlatformMutex trace_lock;
+static uint64_t trace_origin_ns = 0;
+static unsigned long trace_runs = 0;
+static bool trace_first_event = true;
+static size_t* trace_tool_tracks = NULL;    // per run: tool slots named so far
+static size_t trace_tool_tracks_capacity = 0;
+
+void trace_init(const char* path, TraceFormat format) {
+    trace_shutdown();
+    if (!path) return;
+    
+    trace_file = fopen(path, "w");
+    if (!trace_file) {
+        log_message(LOG_WARNING, "Cannot create trace file: %s", path);
+        return;
+    }
+    trace_format = format;
+    trace_origin_ns = platform_monotonic_ns();
+    trace_runs = 0;
+    trace_first_event = true;
+    platform_mutex_init(&trace_lock);
+    if (format == TRACE_FORMAT_CHROME) {
+        fputs("[\n", trace_file);
+    }
+}
+
+void trace_shutdown(void) {
+    if (!trace_file) return;
+    if (trace_format == TRACE_FORMAT_CHROME) {
+        fputs("\n]\n", trace_file);
+    }
+    fclose(trace_file);
+    trace_file = NULL;
+    platform_mutex_destroy(&trace_lock);
+    free(trace_tool_tracks);
+    trace_tool_tracks = NULL;
+    trace_tool_tracks_capacity = 0;
+}
+
+bool trace_enabled(void) {
+    return trace_file != NULL;
+}
+
+static double trace_ms(uint64_t start_ns, uint64_t end_ns) {
+    return end_ns > start_ns ? (double)(end_ns - start_ns) / 1e6 : 0;
+}
+
+static double trace_us(uint64_t ns) {
+    return ns > trace_origin_ns ? (double)(ns - trace_origin_ns) / 1e3 : 0;
+}
+
+// Writes one JSON line or Chrome event; called with trace_lock held
+static void trace_emit(cJSON* record) {
+    char* json = cJSON_PrintUnformatted(record);
+    if (trace_format == TRACE_FORMAT_CHROME) {
+        fputs(trace_first_event ? "" : ",\n", trace_file);
+        trace_first_event = false;
+        fputs(json, trace_file);
+    } else {
+        fputs(json, trace_file);
+        fputc('\n', trace_file);
+    }
+    cJSON_free(json);
+    cJSON_Delete(record);
+}
+
+static void trace_emit_name(const char* kind, unsigned long run, int tid, const char* name) {
+    cJSON* event = cJSON_CreateObject();
+    cJSON_AddStringToObject(event, "name", kind);
+    cJSON_AddStringToObject(event, "ph", "M");
+    cJSON_AddNumberToObject(event, "pid", (double)run);
+    cJSON_AddNumberToObject(event, "tid", tid);
+    cJSON* args = cJSON_AddObjectToObject(event, "args");
+    cJSON_AddStringToObject(args, "name", name);
+    trace_emit(event);
+}
+
+unsigned long trace_begin_run(const char* label) {
+    if (!trace_file) return 0;
+    
+    platform_mutex_lock(&trace_lock);
+    unsigned long run = ++trace_runs;
+    if (trace_format == TRACE_FORMAT_CHROME) {
+        trace_emit_name("process_name", run, TRACE_TID_STEPS, label);
+        trace_emit_name("thread_name", run, TRACE_TID_STEPS, "steps");
+        trace_emit_name("thread_name", run, TRACE_TID_LLM, "llm");
+    } else {
+        cJSON* record = cJSON_CreateObject();
+        cJSON_AddNumberToObject(record, "run", (double)run);
+        cJSON_AddStringToObject(record, "label", label);
+        trace_emit(record);
+    }
+    fflush(trace_file);
+    platform_mutex_unlock(&trace_lock);
+    return run;
+}
+
+static cJSON* trace_http_json(const HttpTiming* timing) {
+    cJSON* http = cJSON_CreateObject();
+    cJSON_AddNumberToObject(http, "dns_ms", timing->ms[HTTP_PHASE_DNS]);
+    cJSON_AddNumberToObject(http, "connect_ms", timing->ms[HTTP_PHASE_CONNECT]);
+    cJSON_AddNumberToObject(http, "tls_ms", timing->ms[HTTP_PHASE_TLS]);
+    cJSON_AddNumberToObject(http, "ttfb_ms", timing->ms[HTTP_PHASE_TTFB]);
+    cJSON_AddNumberToObject(http, "total_ms", timing->ms[HTTP_PHASE_TOTAL]);
+    cJSON_AddBoolToObject(http, "reused_connection", timing->reused);
+    return http;
+}
+
+static void trace_add_llm_fields(cJSON* object, const TraceStep* step) {
+    cJSON_AddNumberToObject(object, "requests", (double)step->llm_requests);
+    cJSON_AddBoolToObject(object, "cached", step->cached);
+    cJSON_AddNumberToObject(object, "request_bytes", (double)step->request_bytes);
+    cJSON_AddNumberToObject(object, "response_bytes", (double)step->response_bytes);
+    if (step->prompt_tokens >= 0) cJSON_AddNumberToObject(object, "prompt_tokens", step->prompt_tokens);
+    if (step->cached_tokens >= 0) cJSON_AddNumberToObject(object, "cached_tokens", step->cached_tokens);
+    if (step->completion_tokens >= 0) cJSON_AddNumberToObject(object, "completion_tokens", step->completion_tokens);
+}
+
+static void trace_add_memory_fields(cJSON* object, const TraceStep* step) {
+    cJSON_AddNumberToObject(object, "memory_messages", (double)step->memory_messages);
+    cJSON_AddNumberToObject(object, "memory_tokens", (double)step->memory_tokens);
+    cJSON_AddNumberToObject(object, "memory_bytes", (double)step->memory_bytes);
+}
+
+static void trace_write_jsonl(unsigned long run, const TraceStep* step) {
+    cJSON* record = cJSON_CreateObject();
+    cJSON_AddNumberToObject(record, "run", (double)run);
+    cJSON_AddNumberToObject(record, "step", step->step);
+    cJSON_AddNumberToObject(record, "start_ms", trace_us(step->start_ns) / 1e3);
+    cJSON_AddNumberToObject(record, "duration_ms", trace_ms(step->start_ns, step->end_ns));
+    
+    if (step->llm_requests > 0) {
+        cJSON* llm = cJSON_AddObjectToObject(record, "llm");
+        trace_add_llm_fields(llm, step);
+        cJSON_AddNumberToObject(llm, "duration_ms", trace_ms(step->llm_start_ns, step->llm_end_ns));
+        if (!step->cached) cJSON_AddItemToObject(llm, "http", trace_http_json(&step->http));
+    }
+    
+    cJSON* tools = cJSON_AddArrayToObject(record, "tools");
+    for (size_t i = 0; i < step->tool_count; i++) {
+        const TraceTool* tool = &step->tools[i];
+        cJSON* entry = cJSON_CreateObject();
+        cJSON_AddStringToObject(entry, "name", tool->name);
+        cJSON_AddNumberToObject(entry, "start_ms", trace_us(tool->start_ns) / 1e3);
+        cJSON_AddNumberToObject(entry, "duration_ms", trace_ms(tool->start_ns, tool->end_ns));
+        cJSON_AddNumberToObject(entry, "result_bytes", (double)tool->result_bytes);
+        cJSON_AddItemToArray(tools, entry);
+    }
+    
+    cJSON* memory = cJSON_AddObjectToObject(record, "memory");
+    cJSON_AddNumberToObject(memory, "messages", (double)step->memory_messages);
+    cJSON_AddNumberToObject(memory, "tokens", (double)step->memory_tokens);
+    cJSON_AddNumberToObject(memory, "bytes", (double)step->memory_bytes);
+    trace_emit(record);
+}
+
+static cJSON* trace_span(const char* name, const char* category, unsigned long run, int tid,
+                         uint64_t start_ns, uint64_t end_ns) {
+    cJSON* event = cJSON_CreateObject();
+    cJSON_AddStringToObject(event, "name", name);
+    cJSON_AddStringToObject(event, "cat", category);
+    cJSON_AddStringToObject(event, "ph", "X");
+    cJSON_AddNumberToObject(event, "ts", trace_us(start_ns));
+    cJSON_AddNumberToObject(event, "dur", end_ns > start_ns ? (double)(end_ns - start_ns) / 1e3 : 0);
+    cJSON_AddNumberToObject(event, "pid", (double)run);
+    cJSON_AddNumberToObject(event, "tid", tid);
+    return event;
+}
+
+static void trace_write_chrome(unsigned long run, const TraceStep* step) {
+    char name[32];
+    snprintf(name, sizeof(name), "step %d", step->step);
+    cJSON* event = trace_span(name, "step", run, TRACE_TID_STEPS, step->start_ns, step->end_ns);
+    trace_add_memory_fields(cJSON_AddObjectToObject(event, "args"), step);
+    trace_emit(event);
+    
+    if (step->llm_requests > 0) {
+        event = trace_span(step->cached ? "llm (cached)" : "llm", "llm", run, TRACE_TID_LLM,
+                           step->llm_start_ns, step->llm_end_ns);
+        cJSON* args = cJSON_AddObjectToObject(event, "args");
+        trace_add_llm_fields(args, step);
+        if (!step->cached) cJSON_AddItemToObject(args, "http", trace_http_json(&step->http));
+        trace_emit(event);
+    }
+    
+    // Name the tool tracks of this run the first time they are used
+    if (run >= trace_tool_tracks_capacity) {
+        size_t capacity = trace_tool_tracks_capacity ? trace_tool_tracks_capacity : 16;
+        while (capacity <= run) capacity *= 2;
+        trace_tool_tracks = safe_realloc(trace_tool_tracks, capacity * sizeof(size_t));
+        memset(trace_tool_tracks + trace_tool_tracks_capacity, 0,
+               (capacity - trace_tool_tracks_capacity) * sizeof(size_t));
+        trace_tool_tracks_capacity = capacity;
+    }
+    for (size_t i = trace_tool_tracks[run]; i < step->tool_count; i++) {
+        char track[32];
+        snprintf(track, sizeof(track), "tool %zu", i + 1);
+        trace_emit_name("thread_name", run, TRACE_TID_TOOLS + (int)i, track);
+        trace_tool_tracks[run] = i + 1;
+    }
+    
+    for (size_t i = 0; i < step->tool_count; i++) {
+        const TraceTool* tool = &step->tools[i];
+        event = trace_span(tool->name, "tool", run, TRACE_TID_TOOLS + (int)i, tool->start_ns, tool->end_ns);
+        cJSON* args = cJSON_AddObjectToObject(event, "args");
+        cJSON_AddNumberToObject(args, "result_bytes", (double)tool->result_bytes);
+        trace_emit(event);
+    }
+}
+
+void trace_write_step(unsigned long run, const TraceStep* step) {
+    if (!trace_file || run == 0) return;
+    
+    platform_mutex_lock(&trace_lock);
+    if (trace_format == TRACE_FORMAT_CHROME) {
+        trace_write_chrome(run, step);
+    } else {
+        trace_write_jsonl(run, step);
+    }
+    fflush(trace_file);
+    platform_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,56 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "platform.h"
+#include "http.h"
+
+// Per-step trace of agent runs, for finding the step or tool that
+// dominates latency and cost. One file per process, shared by every agent
+// of a batch; each run gets an id of its own. Written either as JSON lines
+// (one object per step) or as Chrome trace events, which chrome://tracing
+// and Perfetto show as one process per run with the LLM requests and each
+// tool slot on tracks of their own.
+typedef enum {
+    TRACE_FORMAT_JSONL,
+    TRACE_FORMAT_CHROME
+} TraceFormat;
+
+typedef struct {
+    const char* name;
+    uint64_t start_ns;          // platform_monotonic_ns
+    uint64_t end_ns;
+    size_t result_bytes;
+} TraceTool;
+
+// Everything one ReAct step cost
+typedef struct {
+    int step;                   // 1-based
+    uint64_t start_ns;
+    uint64_t end_ns;
+    size_t llm_requests;        // more than one after a function calling fallback
+    bool cached;                // answered from the response cache
+    uint64_t llm_start_ns;      // request built
+    uint64_t llm_end_ns;        // response received
+    size_t request_bytes;
+    size_t response_bytes;
+    long prompt_tokens;         // from the response's usage; -1 if not reported
+    long cached_tokens;         // of prompt_tokens, from the provider's prompt cache
+    long completion_tokens;
+    HttpTiming http;            // summed over the step's requests
+    const TraceTool* tools;
+    size_t tool_count;
+    size_t memory_messages;     // conversation after the step
+    size_t memory_tokens;
+    size_t memory_bytes;        // encoded request messages
+} TraceStep;
+
+// NULL path disables tracing (the default)
+void trace_init(const char* path, TraceFormat format);
+void trace_shutdown(void);
+bool trace_enabled(void);
+
+// Id for the records of a new run, labelled e.g. with its model and directory
+unsigned long trace_begin_run(const char* label);
+void trace_write_step(unsigned long run, const TraceStep* step);
+
+#endif // TRACE_H